@@ -13,28 +13,43 @@ const size_t Buffer::initialSize = 1024;
 int Buffer::readFd(int fd_, int* savedErrno_)
 {
   char buf[65536];
+  return readFd(fd_, savedErrno_, buf, sizeof(buf), nullptr);
+}
+
+int Buffer::readFd(int fd_, int* savedErrno_, char* overflow_,
+                   size_t overflowLen_, size_t* spilled_)
+{
+  allocateIfReleased(0);
   struct iovec vec[2];
   const size_t writableLen = writableBytes();
   vec[0].iov_base = begin() + _writeIndex;
   vec[0].iov_len = writableLen;
-  vec[1].iov_base = buf;
-  vec[1].iov_len = sizeof(buf);
+  vec[1].iov_base = overflow_;
+  vec[1].iov_len = overflowLen_;
 
-  const int iovcnt = (writableLen < sizeof(buf)) ? 2 : 1;
+  const int iovcnt = (writableLen < overflowLen_) ? 2 : 1;
   const ssize_t n = ::readv(fd_, vec, iovcnt);
+  size_t spilled = 0;
   if (n < 0)
   {
     *savedErrno_ = errno;
   }
-  else if (implicit_cast<size_t>(n) < writableLen)
+  else if (implicit_cast<size_t>(n) <= writableLen)
   {
     _writeIndex += n;
   }
   else
   {
+    // The second copy the caller wants to avoid by
+    // making enough room beforehand
     _writeIndex = _data.size();
-    append(buf, n - writableLen);
+    spilled = n - writableLen;
+    append(overflow_, spilled);
   }
 
+  if (spilled_ != nullptr)
+  {
+    *spilled_ = spilled;
+  }
   return n;
 }
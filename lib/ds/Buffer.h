@@ -1,6 +1,8 @@
 #ifndef OPLIB_DS_BUFFER_H
 #define OPLIB_DS_BUFFER_H
 
+#include "BufferPool.h"
+
 #include <vector>
 #include <cassert>
 #include <algorithm>
@@ -25,12 +27,39 @@ namespace ds
       _data(prependable_ + initialSize)
     {}
 
+    // Storage comes from pool_ and is only allocated by the first
+    // append/readFd, so the buffer can be created in any thread
+    explicit Buffer(BufferPool* pool_, size_t prependable_ = prependSize)
+    : _prependable(prependable_),
+      _readIndex(_prependable),
+      _writeIndex(_prependable),
+      _data(PoolAllocator<char>(pool_))
+    {}
+
+    // Give the storage back if nothing is buffered, the next
+    // append/readFd allocates it again. Returns true if released
+    bool release()
+    {
+      if (readableBytes() != 0 || _data.empty())
+      {
+        return false;
+      }
+      Storage empty(_data.get_allocator());
+      _data.swap(empty);
+      reset();
+      return true;
+    }
+
+    // Bytes of storage held
+    size_t capacity() const
+    { return _data.capacity(); }
+
 
     size_t readableBytes() const
     { return _writeIndex - _readIndex; }
 
     size_t writableBytes() const
-    { return _data.size() - _writeIndex; }
+    { return _data.empty() ? 0 : _data.size() - _writeIndex; }
 
     size_t prependableBytes() const
     { return _readIndex; }
@@ -76,6 +105,7 @@ namespace ds
 
     void prepend(const char* data_, size_t len_)
     {
+      allocateIfReleased(0);
       assert(len_ <= prependableBytes());
       _readIndex -= len_;
       std::copy(data_, data_ + len_, begin() + _readIndex);
@@ -89,9 +119,19 @@ namespace ds
       swap(_writeIndex, buf_._writeIndex);
     }
 
-    // TODO
+    // Make sure len_ bytes can be written without reallocating
+    void ensureWritableBytes(size_t len_)
+    { extendIfNeeded(len_); }
+
+    // Reads with a 64KB spill area on the stack
     int readFd(int fd_, int* savedErrno_);
 
+    // readv into the writable bytes then into overflow_, whatever
+    // went into overflow_ is appended (a second copy) and its
+    // size stored in spilled_ if not null
+    int readFd(int fd_, int* savedErrno_, char* overflow_,
+               size_t overflowLen_, size_t* spilled_);
+
    private:
 
     char* begin()
@@ -104,15 +144,35 @@ namespace ds
       _writeIndex = _prependable;
     }
 
+    // Storage size for size_ bytes: a whole size class of the pool
+    size_t storageSize(size_t size_) const
+    {
+      if (_data.get_allocator().pool() == nullptr)
+      {
+        return size_;
+      }
+      int cls = BufferPool::classOf(size_);
+      return cls < 0 ? size_ : BufferPool::classSize(cls);
+    }
+
+    void allocateIfReleased(size_t len_)
+    {
+      if (_data.empty())
+      {
+        _data.resize(storageSize(_prependable + std::max(initialSize, len_)));
+      }
+    }
+
     void extendIfNeeded(size_t len_)
     {
+      allocateIfReleased(len_);
       if (len_ <= writableBytes()) return;
 
       // The actual "writable" bytes is prependableBytes() + writableBytes()
       else if (prependableBytes() + writableBytes() < len_ + prependSize)
       {
         // Make space by resizing
-        _data.resize(_writeIndex + len_);
+        _data.resize(storageSize(_writeIndex + len_));
       }
       else
       {
@@ -126,10 +186,12 @@ namespace ds
 
     }
 
+    typedef std::vector<char, PoolAllocator<char>> Storage;
+
     const size_t _prependable;
     int _readIndex;
     int _writeIndex;
-    std::vector<char> _data;
+    Storage _data;
   };
 }
 }
@@ -0,0 +1,104 @@
+#include "BufferPool.h"
+
+using namespace oplib::ds;
+
+const size_t BufferPool::defaultMaxCachedBytes = 1024 * 1024;
+
+BufferPool::BufferPool(size_t maxCachedBytes_)
+: _maxCachedBytes(maxCachedBytes_),
+  _largeBytes(0)
+{
+  for (auto& sizeClass : _classes)
+  {
+    sizeClass._inUse = 0;
+  }
+}
+
+BufferPool::~BufferPool()
+{
+  trim();
+}
+
+int BufferPool::classOf(size_t size_)
+{
+  if (size_ > classSize(kNumClasses - 1))
+  {
+    return -1;
+  }
+  int cls = 0;
+  while (classSize(cls) < size_)
+  {
+    ++cls;
+  }
+  return cls;
+}
+
+char* BufferPool::allocate(size_t size_)
+{
+  int cls = classOf(size_);
+  if (cls < 0)
+  {
+    _largeBytes += size_;
+    return new char[size_];
+  }
+
+  SizeClass& sizeClass = _classes[cls];
+  ++sizeClass._inUse;
+  if (sizeClass._free.empty())
+  {
+    return new char[classSize(cls)];
+  }
+  char* chunk = sizeClass._free.back();
+  sizeClass._free.pop_back();
+  return chunk;
+}
+
+void BufferPool::deallocate(char* chunk_, size_t size_)
+{
+  int cls = classOf(size_);
+  if (cls < 0)
+  {
+    _largeBytes -= size_;
+    delete[] chunk_;
+    return;
+  }
+
+  SizeClass& sizeClass = _classes[cls];
+  --sizeClass._inUse;
+  if ((sizeClass._free.size() + 1) * classSize(cls) <= _maxCachedBytes ||
+      sizeClass._free.empty())
+  {
+    sizeClass._free.push_back(chunk_);
+  }
+  else
+  {
+    delete[] chunk_;
+  }
+}
+
+void BufferPool::trim()
+{
+  for (auto& sizeClass : _classes)
+  {
+    for (char* chunk : sizeClass._free)
+    {
+      delete[] chunk;
+    }
+    sizeClass._free.clear();
+    sizeClass._free.shrink_to_fit();
+  }
+}
+
+BufferPool::Occupancy BufferPool::occupancy() const
+{
+  Occupancy result = { 0, 0, 0, 0, _largeBytes };
+  for (int cls = 0; cls < kNumClasses; ++cls)
+  {
+    const SizeClass& sizeClass = _classes[cls];
+    result.inUseChunks += sizeClass._inUse;
+    result.inUseBytes += sizeClass._inUse * classSize(cls);
+    result.cachedChunks += sizeClass._free.size();
+    result.cachedBytes += sizeClass._free.size() * classSize(cls);
+  }
+  return result;
+}
@@ -0,0 +1,142 @@
+#ifndef OPLIB_DS_BUFFERPOOL_H
+#define OPLIB_DS_BUFFERPOOL_H
+
+#include <stddef.h>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace oplib
+{
+namespace ds
+{
+  // Slab allocator for buffer storage: power of two size classes from
+  // 64 bytes to 128KB, each one with its own free list. Bigger requests
+  // go straight to the heap. Not thread-safe: one pool per EventLoop,
+  // only used from the loop thread.
+  class BufferPool
+  {
+   public:
+    static const int kMinShift = 6;
+    static const int kMaxShift = 17;
+    static const int kNumClasses = kMaxShift - kMinShift + 1;
+    // Idle memory kept per size class, at least one chunk
+    static const size_t defaultMaxCachedBytes;
+
+    struct Occupancy
+    {
+      // Handed out to buffers, rounded up to the size class
+      size_t inUseBytes;
+      size_t inUseChunks;
+      // Idle in the free lists
+      size_t cachedBytes;
+      size_t cachedChunks;
+      // Requests over the largest class, served by the heap
+      size_t largeBytes;
+    };
+
+    explicit BufferPool(size_t maxCachedBytes_ = defaultMaxCachedBytes);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator = (const BufferPool&) = delete;
+
+    char* allocate(size_t size_);
+    // size_ must be the size passed to allocate()
+    void deallocate(char* chunk_, size_t size_);
+
+    // Give every cached chunk back to the heap
+    void trim();
+
+    Occupancy occupancy() const;
+
+    // Chunks of class cls_ (64 << cls_ bytes) in use and cached
+    size_t inUseChunks(int cls_) const { return _classes[cls_]._inUse; }
+    size_t cachedChunks(int cls_) const { return _classes[cls_]._free.size(); }
+
+    static size_t classSize(int cls_) { return size_t(1) << (cls_ + kMinShift); }
+
+    // Size class of size_, -1 if too large
+    static int classOf(size_t size_);
+
+   private:
+    struct SizeClass
+    {
+      std::vector<char*> _free;
+      size_t _inUse;
+    };
+
+    const size_t _maxCachedBytes;
+    SizeClass _classes[kNumClasses];
+    size_t _largeBytes;
+  };
+
+  // std allocator on top of a BufferPool, plain heap without a pool.
+  // Elements are default-initialized: a resized buffer is not zero-filled
+  template <typename T>
+  class PoolAllocator
+  {
+   public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    PoolAllocator(BufferPool* pool_ = nullptr) noexcept
+    : _pool(pool_)
+    {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& rhs_) noexcept
+    : _pool(rhs_.pool())
+    {}
+
+    T* allocate(size_t n_)
+    {
+      if (_pool == nullptr)
+      {
+        return std::allocator<T>().allocate(n_);
+      }
+      return reinterpret_cast<T*>(_pool->allocate(n_ * sizeof(T)));
+    }
+
+    void deallocate(T* p_, size_t n_)
+    {
+      if (_pool == nullptr)
+      {
+        std::allocator<T>().deallocate(p_, n_);
+        return;
+      }
+      _pool->deallocate(reinterpret_cast<char*>(p_), n_ * sizeof(T));
+    }
+
+    template <typename U>
+    void construct(U* p_) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+      ::new (static_cast<void*>(p_)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p_, Args&&... args_)
+    {
+      ::new (static_cast<void*>(p_)) U(std::forward<Args>(args_)...);
+    }
+
+    BufferPool* pool() const { return _pool; }
+
+   private:
+    BufferPool* _pool;
+  };
+
+  template <typename T, typename U>
+  bool operator == (const PoolAllocator<T>& lhs_, const PoolAllocator<U>& rhs_)
+  { return lhs_.pool() == rhs_.pool(); }
+
+  template <typename T, typename U>
+  bool operator != (const PoolAllocator<T>& lhs_, const PoolAllocator<U>& rhs_)
+  { return !(lhs_ == rhs_); }
+}
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef OPLIB_DS_FLATHASHMAP_H
+#define OPLIB_DS_FLATHASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace oplib
+{
+namespace ds
+{
+  // Open addressing hash map: the slots are one flat array with a
+  // power of two size, collisions probe the next slots (linear
+  // probing) and erase shifts the following entries back instead of
+  // leaving tombstones. Lookups touch one or two cache lines and
+  // insert/erase allocate nothing until the table grows.
+  // Key and Value must be default-constructible and movable.
+  template <typename Key, typename Value, typename Hash = std::hash<Key>>
+  class FlatHashMap
+  {
+   public:
+    static const size_t kMinCapacity = 16;
+
+    explicit FlatHashMap(size_t capacity_ = kMinCapacity)
+    : _size(0)
+    {
+      size_t capacity = kMinCapacity;
+      while (capacity < capacity_)
+      {
+        capacity <<= 1;
+      }
+      rehash(capacity);
+    }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    size_t capacity() const { return _slots.size(); }
+
+    // Returns false and leaves the map unchanged if key_ is present
+    bool insert(const Key& key_, Value value_)
+    {
+      // Max load factor 3/4
+      if ((_size + 1) * 4 > _slots.size() * 3)
+      {
+        rehash(_slots.size() * 2);
+      }
+
+      size_t i = home(key_);
+      while (_slots[i]._used)
+      {
+        if (_slots[i]._key == key_)
+        {
+          return false;
+        }
+        i = (i + 1) & _mask;
+      }
+      _slots[i]._key = key_;
+      _slots[i]._value = std::move(value_);
+      _slots[i]._used = true;
+      ++_size;
+      return true;
+    }
+
+    // nullptr if key_ is absent
+    Value* find(const Key& key_)
+    {
+      size_t i = indexOf(key_);
+      return i == npos ? nullptr : &_slots[i]._value;
+    }
+
+    const Value* find(const Key& key_) const
+    {
+      size_t i = indexOf(key_);
+      return i == npos ? nullptr : &_slots[i]._value;
+    }
+
+    size_t count(const Key& key_) const
+    { return indexOf(key_) == npos ? 0 : 1; }
+
+    size_t erase(const Key& key_)
+    {
+      size_t hole = indexOf(key_);
+      if (hole == npos)
+      {
+        return 0;
+      }
+
+      // Move back every following entry whose probe sequence
+      // crosses the hole, until an empty slot ends the run
+      size_t i = (hole + 1) & _mask;
+      while (_slots[i]._used)
+      {
+        size_t h = home(_slots[i]._key);
+        // Cyclic distances from the home slot
+        if (((i - h) & _mask) >= ((i - hole) & _mask))
+        {
+          _slots[hole]._key = std::move(_slots[i]._key);
+          _slots[hole]._value = std::move(_slots[i]._value);
+          hole = i;
+        }
+        i = (i + 1) & _mask;
+      }
+
+      _slots[hole]._used = false;
+      _slots[hole]._key = Key();
+      _slots[hole]._value = Value();
+      --_size;
+      return 1;
+    }
+
+    void clear()
+    {
+      for (auto& slot : _slots)
+      {
+        slot = Slot();
+      }
+      _size = 0;
+    }
+
+    // func_(const Key&, Value&) on every entry, in slot order.
+    // func_ must not insert nor erase
+    template <typename Func>
+    void forEach(const Func& func_)
+    {
+      for (auto& slot : _slots)
+      {
+        if (slot._used)
+        {
+          func_(slot._key, slot._value);
+        }
+      }
+    }
+
+   private:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    struct Slot
+    {
+      Key _key {};
+      Value _value {};
+      bool _used { false };
+    };
+
+    // Fibonacci hashing: the top bits of the product spread
+    // sequential and strided keys over the whole table
+    size_t home(const Key& key_) const
+    {
+      uint64_t h = static_cast<uint64_t>(_hash(key_)) * 0x9E3779B97F4A7C15ull;
+      return static_cast<size_t>(h >> _shift);
+    }
+
+    size_t indexOf(const Key& key_) const
+    {
+      size_t i = home(key_);
+      while (_slots[i]._used)
+      {
+        if (_slots[i]._key == key_)
+        {
+          return i;
+        }
+        i = (i + 1) & _mask;
+      }
+      return npos;
+    }
+
+    void rehash(size_t capacity_)
+    {
+      std::vector<Slot> old(capacity_);
+      old.swap(_slots);
+      _mask = capacity_ - 1;
+      _shift = 64;
+      for (size_t n = capacity_; n > 1; n >>= 1)
+      {
+        --_shift;
+      }
+
+      _size = 0;
+      for (auto& slot : old)
+      {
+        if (slot._used)
+        {
+          insert(slot._key, std::move(slot._value));
+        }
+      }
+    }
+
+    Hash _hash;
+    std::vector<Slot> _slots;
+    size_t _mask;
+    int _shift;
+    size_t _size;
+  };
+}
+}
+
+#endif
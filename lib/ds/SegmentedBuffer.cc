@@ -0,0 +1,173 @@
+#include "SegmentedBuffer.h"
+
+#include <errno.h>
+#include <sys/uio.h>
+#include <string.h>
+
+#include <algorithm>
+
+using namespace oplib::ds;
+
+const size_t SegmentedBuffer::defaultBlockSize = 16 * 1024;
+
+void SegmentedBuffer::pushBlock(char* block_, size_t readIndex_, size_t writeIndex_)
+{
+  Segment segment = { block_, readIndex_, writeIndex_ };
+  _segments.push_back(segment);
+}
+
+size_t SegmentedBuffer::peek(char* data_, size_t len_) const
+{
+  size_t copied = 0;
+  for (auto it = _segments.begin(); it != _segments.end() && copied < len_; ++it)
+  {
+    size_t n = std::min(len_ - copied, it->readableBytes());
+    ::memcpy(data_ + copied, it->peek(), n);
+    copied += n;
+  }
+  return copied;
+}
+
+void SegmentedBuffer::retrieve(size_t len_)
+{
+  len_ = std::min(len_, _readable);
+  _readable -= len_;
+  while (len_ > 0)
+  {
+    Segment& front = _segments.front();
+    size_t n = std::min(len_, front.readableBytes());
+    front._readIndex += n;
+    len_ -= n;
+    if (front.readableBytes() == 0)
+    {
+      deallocateBlock(front._data);
+      _segments.pop_front();
+    }
+  }
+
+  // Segments never stay empty
+  assert(_readable != 0 || _segments.empty());
+}
+
+std::string SegmentedBuffer::retrieveAsString(size_t len_)
+{
+  assert(len_ <= readableBytes());
+  std::string result(len_, '\0');
+  peek(&result[0], len_);
+  retrieve(len_);
+  return result;
+}
+
+void SegmentedBuffer::append(const char* data_, size_t len_)
+{
+  _readable += len_;
+  while (len_ > 0)
+  {
+    if (tailWritable() == 0)
+    {
+      pushBlock(allocateBlock(), 0, 0);
+    }
+    Segment& tail = _segments.back();
+    size_t n = std::min(len_, _blockSize - tail._writeIndex);
+    ::memcpy(tail._data + tail._writeIndex, data_, n);
+    tail._writeIndex += n;
+    data_ += n;
+    len_ -= n;
+  }
+}
+
+void SegmentedBuffer::prepend(const char* data_, size_t len_)
+{
+  assert(len_ <= _blockSize);
+  if (_segments.empty() || _segments.front()._readIndex < len_)
+  {
+    // Fill a new front block from its end
+      Segment segment = { allocateBlock(), _blockSize, _blockSize };
+    _segments.push_front(segment);
+  }
+  Segment& front = _segments.front();
+  front._readIndex -= len_;
+  ::memcpy(front._data + front._readIndex, data_, len_);
+  _readable += len_;
+}
+
+int SegmentedBuffer::fillIovec(struct iovec* vec_, int maxIov_) const
+{
+  int iovcnt = 0;
+  for (auto it = _segments.begin(); it != _segments.end() && iovcnt < maxIov_; ++it)
+  {
+    vec_[iovcnt].iov_base = const_cast<char*>(it->peek());
+    vec_[iovcnt].iov_len = it->readableBytes();
+    ++iovcnt;
+  }
+  return iovcnt;
+}
+
+ssize_t SegmentedBuffer::readFd(int fd_, int* savedErrno_)
+{
+  struct iovec vec[kReadBlocks + 1];
+  char* blocks[kReadBlocks];
+  int iovcnt = 0;
+
+  const size_t writable = tailWritable();
+  if (writable > 0)
+  {
+    Segment& tail = _segments.back();
+    vec[iovcnt].iov_base = tail._data + tail._writeIndex;
+    vec[iovcnt].iov_len = writable;
+    ++iovcnt;
+  }
+  for (int i = 0; i < kReadBlocks; ++i)
+  {
+    blocks[i] = allocateBlock();
+    vec[iovcnt].iov_base = blocks[i];
+    vec[iovcnt].iov_len = _blockSize;
+    ++iovcnt;
+  }
+
+  const ssize_t n = ::readv(fd_, vec, iovcnt);
+  if (n < 0)
+  {
+    *savedErrno_ = errno;
+  }
+
+  size_t left = n > 0 ? static_cast<size_t>(n) : 0;
+  _readable += left;
+  if (writable > 0)
+  {
+    size_t inTail = std::min(left, writable);
+    _segments.back()._writeIndex += inTail;
+    left -= inTail;
+  }
+  for (int i = 0; i < kReadBlocks; ++i)
+  {
+    if (left > 0)
+    {
+      size_t inBlock = std::min(left, _blockSize);
+      pushBlock(blocks[i], 0, inBlock);
+      left -= inBlock;
+    }
+    else
+    {
+      deallocateBlock(blocks[i]);
+    }
+  }
+
+  return n;
+}
+
+ssize_t SegmentedBuffer::writeFd(int fd_, int* savedErrno_)
+{
+  struct iovec vec[kMaxIovecs];
+  const int iovcnt = fillIovec(vec, kMaxIovecs);
+  const ssize_t n = ::writev(fd_, vec, iovcnt);
+  if (n < 0)
+  {
+    *savedErrno_ = errno;
+  }
+  else
+  {
+    retrieve(static_cast<size_t>(n));
+  }
+  return n;
+}
@@ -0,0 +1,114 @@
+#ifndef OPLIB_DS_SEGMENTEDBUFFER_H
+#define OPLIB_DS_SEGMENTEDBUFFER_H
+
+#include "BufferPool.h"
+
+#include <sys/uio.h>
+#include <cassert>
+#include <deque>
+#include <string>
+
+namespace oplib
+{
+namespace ds
+{
+  // Buffer made of fixed-size blocks taken from a BufferPool.
+  // Appending never moves the bytes already buffered and retrieving
+  // gives the drained blocks back to the pool, so multi-MB messages
+  // cost no realloc and no memmove. Data is read and written with
+  // readv/writev across the blocks.
+  class SegmentedBuffer
+  {
+   public:
+    static const size_t defaultBlockSize;
+
+    explicit SegmentedBuffer(BufferPool* pool_, size_t blockSize_ = defaultBlockSize)
+    : _pool(pool_),
+      _blockSize(blockSize_),
+      _readable(0)
+    {}
+
+    ~SegmentedBuffer()
+    { retrieveAll(); }
+
+    SegmentedBuffer(const SegmentedBuffer&) = delete;
+    SegmentedBuffer& operator = (const SegmentedBuffer&) = delete;
+
+    size_t readableBytes() const
+    { return _readable; }
+
+    // Readable bytes of the first segment, starting at peek()
+    size_t frontBytes() const
+    { return _segments.empty() ? 0 : _segments.front().readableBytes(); }
+
+    const char* peek() const
+    { return _segments.empty() ? nullptr : _segments.front().peek(); }
+
+    // Copy up to len_ readable bytes across segments, returns the count
+    size_t peek(char* data_, size_t len_) const;
+
+    void retrieve(size_t len_);
+
+    void retrieveAll()
+    { retrieve(readableBytes()); }
+
+    std::string retrieveAsString()
+    { return retrieveAsString(readableBytes()); }
+
+    std::string retrieveAsString(size_t len_);
+
+    void append(const char* data_, size_t len_);
+
+    void append(const std::string& str_)
+    { append(str_.data(), str_.size()); }
+
+    // Small headers: goes in front of the first segment,
+    // len_ must not exceed the block size
+    void prepend(const char* data_, size_t len_);
+
+    // Fill up to maxIov_ iovecs with the readable segments,
+    // returns the number of iovecs used
+    int fillIovec(struct iovec* vec_, int maxIov_) const;
+
+    // readv into the free space of the last segment plus
+    // fresh blocks, unused blocks go back to the pool
+    ssize_t readFd(int fd_, int* savedErrno_);
+
+    // writev the readable segments and retrieve what was written
+    ssize_t writeFd(int fd_, int* savedErrno_);
+
+    size_t numSegments() const { return _segments.size(); }
+
+    static const int kMaxIovecs = 64;
+    // Fresh blocks offered to one readv
+    static const int kReadBlocks = 4;
+
+   private:
+    struct Segment
+    {
+      char* _data;
+      size_t _readIndex;
+      size_t _writeIndex;
+
+      size_t readableBytes() const { return _writeIndex - _readIndex; }
+      const char* peek() const { return _data + _readIndex; }
+    };
+
+    size_t tailWritable() const
+    {
+      return _segments.empty() ? 0 : _blockSize - _segments.back()._writeIndex;
+    }
+
+    char* allocateBlock() { return _pool->allocate(_blockSize); }
+    void deallocateBlock(char* block_) { _pool->deallocate(block_, _blockSize); }
+    void pushBlock(char* block_, size_t readIndex_, size_t writeIndex_);
+
+    BufferPool* _pool;
+    const size_t _blockSize;
+    std::deque<Segment> _segments;
+    size_t _readable;
+  };
+}
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "AsyncLogging.h"
+#include "LogBuffer.h"
+#include "Logging.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cassert>
+
+namespace oplib
+{
+  AsyncLogging::AsyncLogging(const std::string& path_, double flushInterval_)
+  : _flushInterval(flushInterval_),
+    _file(stderr),
+    _ownsFile(false),
+    _thread(std::bind(&AsyncLogging::writerThread, this), "AsyncLogging"),
+    _cond(_mutex),
+    _flushRequested(0),
+    _flushCompleted(0),
+    _reportedDropped(0)
+  {
+    if (!path_.empty())
+    {
+      _file = ::fopen(path_.c_str(), "ae");
+      if (_file == nullptr)
+      {
+        // Nowhere else to report it
+        fprintf(stderr, "AsyncLogging: cannot open %s: %s\n", path_.c_str(), ::strerror(errno));
+        abort();
+      }
+      _ownsFile = true;
+    }
+  }
+
+  AsyncLogging::~AsyncLogging()
+  {
+    if (_running)
+    {
+      stop();
+    }
+    if (_ownsFile)
+    {
+      ::fclose(_file);
+    }
+  }
+
+  void AsyncLogging::start()
+  {
+    assert(!_running);
+    // One writer at a time
+    assert(log::detail::writer() == nullptr);
+    _running = true;
+    log::detail::setWriter(this);
+    _thread.start();
+  }
+
+  void AsyncLogging::stop()
+  {
+    assert(_running);
+    // Logging threads write to stderr from now on, the writer
+    // drains what they queued before it exits. Its last collect()
+    // takes every thread's lock after this: a thread which still
+    // saw the writer has added its line by then
+    log::detail::setWriter(nullptr);
+    _running = false;
+    log::detail::wakeWriter();
+    _thread.join();
+  }
+
+  void AsyncLogging::flush()
+  {
+    if (!_running)
+    {
+      return;
+    }
+    MutexLockGuard lock(_mutex);
+    const uint64_t request = ++_flushRequested;
+    log::detail::wakeWriter();
+    while (_flushCompleted < request)
+    {
+      _cond.wait();
+    }
+  }
+
+  void AsyncLogging::writerThread()
+  {
+    while (_running)
+    {
+      log::detail::waitForBuffers(_flushInterval);
+      uint64_t request = 0;
+      {
+        MutexLockGuard lock(_mutex);
+        request = _flushRequested;
+      }
+      drain();
+      {
+        MutexLockGuard lock(_mutex);
+        _flushCompleted = request;
+        _cond.notifyAll();
+      }
+    }
+    drain();
+
+    // flush() calls which came with the stop
+    MutexLockGuard lock(_mutex);
+    _flushCompleted = _flushRequested;
+    _cond.notifyAll();
+  }
+
+  void AsyncLogging::drain()
+  {
+    log::LogBufferList buffers;
+    log::detail::collect(&buffers);
+    for (const auto& buffer : buffers)
+    {
+      ::fwrite(buffer->data(), 1, buffer->length(), _file);
+    }
+
+    const uint64_t dropped = log::dropped();
+    if (dropped != _reportedDropped)
+    {
+      fprintf(_file, "AsyncLogging: %llu messages dropped, the writer fell behind\n",
+              static_cast<unsigned long long>(dropped - _reportedDropped));
+      _reportedDropped = dropped;
+    }
+    if (!buffers.empty())
+    {
+      ::fflush(_file);
+    }
+    log::detail::recycle(&buffers);
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef OPLIB_ASYNCLOGGING_H
+#define OPLIB_ASYNCLOGGING_H
+
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <util/Common.h>
+#include <thread/Condition.h>
+#include <thread/Mutex.h>
+#include <thread/Thread.h>
+
+namespace oplib
+{
+  // Background writer of the LOG_ macros. Every logging thread formats
+  // into a buffer of its own, under a lock no other logging thread
+  // takes; a full buffer is queued for the writer and the thread goes
+  // on with a spare one (double buffering). The writer thread takes the
+  // queued buffers, and the partly filled ones every flushInterval_
+  // seconds, and writes them out of the logging threads' way. One
+  // AsyncLogging at a time, the messages go to stderr when none runs
+  class AsyncLogging : Noncopyable
+  {
+   public:
+    // Appends to path_, stderr if empty
+    explicit AsyncLogging(const std::string& path_ = std::string(),
+                          double flushInterval_ = 1.0);
+    ~AsyncLogging();
+
+    void start();
+    // Writes what is pending and joins the writer. Messages logged
+    // from then on go to stderr
+    void stop();
+
+    // Wait until what was logged so far is written
+    void flush();
+
+   private:
+    void writerThread();
+    // Write the buffers taken from the logging threads
+    void drain();
+
+    const double _flushInterval;
+    FILE* _file;
+    bool _ownsFile;
+    std::atomic_bool _running { false };
+    Thread _thread;
+
+    Mutex _mutex;
+    Condition _cond;
+    // flush(): drains requested and completed
+    uint64_t _flushRequested;
+    uint64_t _flushCompleted;
+    // log::dropped() as last reported in the log
+    uint64_t _reportedDropped;
+  };
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef OPLIB_LOGBUFFER_H
+#define OPLIB_LOGBUFFER_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include <util/Common.h>
+
+// Between the LOG_ macros and AsyncLogging, not for the users
+namespace oplib
+{
+  class AsyncLogging;
+
+  namespace log
+  {
+    // Formatted lines of one thread
+    class LogBuffer : Noncopyable
+    {
+     public:
+      static const size_t kSize = 64 * 1024;
+
+      LogBuffer() : _length(0) {}
+
+      char* cursor() { return _data + _length; }
+      size_t avail() const { return kSize - _length; }
+      void add(size_t len_) { _length += len_; }
+
+      const char* data() const { return _data; }
+      size_t length() const { return _length; }
+      void reset() { _length = 0; }
+
+     private:
+      char _data[kSize];
+      size_t _length;
+    };
+
+    typedef std::unique_ptr<LogBuffer> LogBufferPtr;
+    typedef std::vector<LogBufferPtr> LogBufferList;
+
+    namespace detail
+    {
+      // The writer the logging threads fill buffers for, nullptr
+      // to log to stderr right away
+      void setWriter(AsyncLogging* writer_);
+      AsyncLogging* writer();
+
+      // Writer side: sleep until a thread queued a full buffer, a
+      // wakeWriter() or seconds_ passed
+      void waitForBuffers(double seconds_);
+      void wakeWriter();
+      // Take the full and then the partly filled buffers of every
+      // thread, in the order they were written per thread
+      void collect(LogBufferList* buffers_);
+      // Written buffers go back to the spares of the logging threads
+      void recycle(LogBufferList* buffers_);
+    }
+  }
+}
+
+#endif
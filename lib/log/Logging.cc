@@ -0,0 +1,409 @@
+#include "Logging.h"
+#include "LogBuffer.h"
+#include "AsyncLogging.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <util/Timestamp.h>
+#include <thread/Condition.h>
+#include <thread/Mutex.h>
+#include <thread/Thread.h>
+
+namespace oplib
+{
+namespace log
+{
+  namespace
+  {
+    // Longest line, longer messages are truncated
+    const size_t kMaxLine = 1024;
+    // Room kept for " - file:line\n" after the message
+    const size_t kSuffixRoom = 128;
+    // Full buffers a thread may have queued, messages are dropped
+    // beyond: the writer can't keep up and memory must stay bounded
+    const size_t kMaxQueuedBuffers = 64;
+    // Queued buffers from which a thread yields after queueing one more,
+    // the writer may be runnable but not running when the CPUs are busy
+    const size_t kYieldQueuedBuffers = kMaxQueuedBuffers / 4;
+
+    const char* const kLevelNames[] = {
+      "TRACE ", "DEBUG ", "INFO  ", "WARN  ", "ERROR ", "FATAL "
+    };
+
+    std::atomic<int> gLevel { static_cast<int>(LogLevel::INFO) };
+    std::atomic<AsyncLogging*> gWriter { nullptr };
+    std::atomic<uint64_t> gDropped { 0 };
+
+    // The buffers of one logging thread. Its mutex is only taken
+    // by that thread, and by the writer when it collects
+    struct ThreadBuffers
+    {
+      Mutex mutex;
+      LogBufferPtr current;
+      LogBufferList full;
+      bool exited { false };
+    };
+
+    // Threads logging to the writer, and the spare buffers. Leaked:
+    // threads may log while the statics are destroyed
+    struct Registry
+    {
+      Registry() : cond(mutex) {}
+
+      Mutex mutex;
+      Condition cond;
+      // A full buffer is queued, or wakeWriter()
+      bool pending { false };
+      std::vector<std::shared_ptr<ThreadBuffers>> threads;
+      LogBufferList spares;
+    };
+
+    Registry& registry()
+    {
+      static Registry* instance = new Registry();
+      return *instance;
+    }
+
+    // Hands what is left over to the writer when the thread exits
+    struct ThreadBuffersHolder
+    {
+      ~ThreadBuffersHolder()
+      {
+        if (!buffers)
+        {
+          return;
+        }
+        {
+          MutexLockGuard lock(buffers->mutex);
+          buffers->exited = true;
+        }
+        detail::wakeWriter();
+      }
+
+      std::shared_ptr<ThreadBuffers> buffers;
+    };
+
+    thread_local ThreadBuffersHolder tl_buffers;
+
+    ThreadBuffers* threadBuffers()
+    {
+      if (UNLIKELY(!tl_buffers.buffers))
+      {
+        tl_buffers.buffers = std::make_shared<ThreadBuffers>();
+        Registry& reg = registry();
+        MutexLockGuard lock(reg.mutex);
+        reg.threads.push_back(tl_buffers.buffers);
+      }
+      return tl_buffers.buffers.get();
+    }
+
+    LogBufferPtr takeSpare()
+    {
+      Registry& reg = registry();
+      {
+        MutexLockGuard lock(reg.mutex);
+        if (!reg.spares.empty())
+        {
+          LogBufferPtr spare = std::move(reg.spares.back());
+          reg.spares.pop_back();
+          return spare;
+        }
+      }
+      return LogBufferPtr(new LogBuffer());
+    }
+
+    // "20261018 12:34:56." of the last second a thread logged in
+    __thread int64_t tl_lastSecond = -1;
+    __thread char tl_time[32];
+    __thread size_t tl_timeLength = 0;
+    // " 12345 ", formatted once
+    __thread char tl_tid[16];
+    __thread size_t tl_tidLength = 0;
+
+    // Decimal digits of value_ into buf_, returns how many
+    size_t formatInt(char* buf_, unsigned value_)
+    {
+      char digits[16];
+      size_t n = 0;
+      do
+      {
+        digits[n++] = static_cast<char>('0' + value_ % 10);
+        value_ /= 10;
+      } while (value_ != 0);
+      for (size_t i = 0; i < n; ++i)
+      {
+        buf_[i] = digits[n - 1 - i];
+      }
+      return n;
+    }
+
+    // "YYYYmmdd HH:MM:SS.uuuuuu tid LEVEL " into buf_, which has room.
+    // Formatted by hand, snprintf() is left to the message
+    size_t formatHeader(char* buf_, LogLevel level_)
+    {
+      const int64_t now = Timestamp::now().microseconds();
+      const int64_t second = now / Timestamp::numMicroSecondsInSeconds;
+      int microSecond = static_cast<int>(now % Timestamp::numMicroSecondsInSeconds);
+      if (second != tl_lastSecond)
+      {
+        tl_lastSecond = second;
+        time_t seconds = static_cast<time_t>(second);
+        struct tm tmval;
+        ::gmtime_r(&seconds, &tmval);
+        tl_timeLength = ::strftime(tl_time, sizeof(tl_time), "%Y%m%d %H:%M:%S.", &tmval);
+      }
+      if (UNLIKELY(tl_tidLength == 0))
+      {
+        tl_tid[0] = ' ';
+        tl_tidLength = 1 + formatInt(tl_tid + 1, static_cast<unsigned>(CurrentThread::tid()));
+        tl_tid[tl_tidLength++] = ' ';
+      }
+
+      size_t len = tl_timeLength;
+      ::memcpy(buf_, tl_time, len);
+      for (int i = 5; i >= 0; --i)
+      {
+        buf_[len + i] = static_cast<char>('0' + microSecond % 10);
+        microSecond /= 10;
+      }
+      len += 6;
+      ::memcpy(buf_ + len, tl_tid, tl_tidLength);
+      len += tl_tidLength;
+      ::memcpy(buf_ + len, kLevelNames[static_cast<int>(level_)], 6);
+      return len + 6;
+    }
+
+    // One line of at most kMaxLine bytes into buf_
+    size_t formatLine(char* buf_, LogLevel level_, const char* file_, int line_,
+                      const char* format_, va_list args_)
+    {
+      size_t len = formatHeader(buf_, level_);
+      const size_t room = kMaxLine - kSuffixRoom - len;
+      int n = ::vsnprintf(buf_ + len, room, format_, args_);
+      if (n > 0)
+      {
+        // Truncated, or a message ending with a newline of its own
+        len += std::min(static_cast<size_t>(n), room - 1);
+        if (buf_[len - 1] == '\n')
+        {
+          --len;
+        }
+      }
+
+      // " - file:line\n", the file name cut to fit kSuffixRoom
+      const char* slash = ::strrchr(file_, '/');
+      const char* base = slash != nullptr ? slash + 1 : file_;
+      const size_t baseLength = std::min(::strlen(base), kSuffixRoom - 16);
+      ::memcpy(buf_ + len, " - ", 3);
+      len += 3;
+      ::memcpy(buf_ + len, base, baseLength);
+      len += baseLength;
+      buf_[len++] = ':';
+      len += formatInt(buf_ + len, static_cast<unsigned>(line_));
+      buf_[len++] = '\n';
+      return len;
+    }
+
+    void writeStderr(LogLevel level_, const char* file_, int line_,
+                     const char* format_, va_list args_)
+    {
+      char line[kMaxLine];
+      size_t len = formatLine(line, level_, file_, line_, format_, args_);
+      ::fwrite(line, 1, len, stderr);
+    }
+
+    void writeLine(LogLevel level_, const char* file_, int line_,
+                   const char* format_, va_list args_)
+    {
+      if (gWriter.load(std::memory_order_acquire) == nullptr)
+      {
+        writeStderr(level_, file_, line_, format_, args_);
+        return;
+      }
+
+      ThreadBuffers* buffers = threadBuffers();
+      bool stopped = false;
+      bool queued = false;
+      size_t queuedBuffers = 0;
+      {
+        MutexLockGuard lock(buffers->mutex);
+        // Read again under the lock: the writer's last collect() takes
+        // it after setWriter(nullptr), so the line is either added
+        // before it or goes to stderr
+        stopped = gWriter.load(std::memory_order_acquire) == nullptr;
+        if (!stopped)
+        {
+          if (!buffers->current || buffers->current->avail() < kMaxLine)
+          {
+            if (buffers->current)
+            {
+              if (buffers->full.size() >= kMaxQueuedBuffers)
+              {
+                gDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+              }
+              buffers->full.push_back(std::move(buffers->current));
+              queued = true;
+              queuedBuffers = buffers->full.size();
+            }
+            buffers->current = takeSpare();
+          }
+          LogBuffer* buffer = buffers->current.get();
+          buffer->add(formatLine(buffer->cursor(), level_, file_, line_, format_, args_));
+        }
+      }
+      if (stopped)
+      {
+        writeStderr(level_, file_, line_, format_, args_);
+      }
+      else if (queued)
+      {
+        detail::wakeWriter();
+        if (queuedBuffers >= kYieldQueuedBuffers)
+        {
+          ::sched_yield();
+        }
+      }
+    }
+  }
+
+  void setLevel(LogLevel level_)
+  {
+    gLevel.store(static_cast<int>(level_), std::memory_order_relaxed);
+  }
+
+  LogLevel level()
+  {
+    return static_cast<LogLevel>(gLevel.load(std::memory_order_relaxed));
+  }
+
+  void write(LogLevel level_, const char* file_, int line_, const char* format_, ...)
+  {
+    va_list args;
+    va_start(args, format_);
+    writeLine(level_, file_, line_, format_, args);
+    va_end(args);
+  }
+
+  void fatal(const char* file_, int line_, const char* format_, ...)
+  {
+    va_list args;
+    va_start(args, format_);
+    writeLine(LogLevel::FATAL, file_, line_, format_, args);
+    va_end(args);
+
+    AsyncLogging* writer = gWriter.load(std::memory_order_acquire);
+    if (writer != nullptr)
+    {
+      writer->flush();
+    }
+    ::abort();
+  }
+
+  uint64_t dropped()
+  {
+    return gDropped.load(std::memory_order_relaxed);
+  }
+
+  namespace detail
+  {
+    void setWriter(AsyncLogging* writer_)
+    {
+      gWriter.store(writer_, std::memory_order_release);
+    }
+
+    AsyncLogging* writer()
+    {
+      return gWriter.load(std::memory_order_acquire);
+    }
+
+    void waitForBuffers(double seconds_)
+    {
+      Registry& reg = registry();
+      MutexLockGuard lock(reg.mutex);
+      if (!reg.pending)
+      {
+        reg.cond.waitForSeconds(seconds_);
+      }
+      reg.pending = false;
+    }
+
+    void wakeWriter()
+    {
+      Registry& reg = registry();
+      MutexLockGuard lock(reg.mutex);
+      reg.pending = true;
+      reg.cond.notify();
+    }
+
+    void collect(LogBufferList* buffers_)
+    {
+      Registry& reg = registry();
+      std::vector<std::shared_ptr<ThreadBuffers>> threads;
+      {
+        MutexLockGuard lock(reg.mutex);
+        threads = reg.threads;
+      }
+
+      // Drained for the last time
+      std::vector<ThreadBuffers*> exited;
+      for (auto& thread : threads)
+      {
+        MutexLockGuard lock(thread->mutex);
+        for (auto& buffer : thread->full)
+        {
+          buffers_->push_back(std::move(buffer));
+        }
+        thread->full.clear();
+        if (thread->current && thread->current->length() > 0)
+        {
+          // The thread takes a spare on its next message
+          buffers_->push_back(std::move(thread->current));
+        }
+        if (thread->exited)
+        {
+          exited.push_back(thread.get());
+        }
+      }
+
+      if (!exited.empty())
+      {
+        MutexLockGuard lock(reg.mutex);
+        reg.threads.erase(std::remove_if(reg.threads.begin(), reg.threads.end(),
+                                         [&exited] (const std::shared_ptr<ThreadBuffers>& thread) {
+                                           return std::find(exited.begin(), exited.end(),
+                                                            thread.get()) != exited.end();
+                                         }),
+                          reg.threads.end());
+      }
+    }
+
+    void recycle(LogBufferList* buffers_)
+    {
+      // Enough spares for a burst, the rest is freed
+      const size_t kMaxSpares = 16;
+      Registry& reg = registry();
+      MutexLockGuard lock(reg.mutex);
+      for (auto& buffer : *buffers_)
+      {
+        if (reg.spares.size() < kMaxSpares)
+        {
+          buffer->reset();
+          reg.spares.push_back(std::move(buffer));
+        }
+      }
+      buffers_->clear();
+    }
+  }
+}
+}
@@ -0,0 +1,70 @@
+#ifndef OPLIB_LOGGING_H
+#define OPLIB_LOGGING_H
+
+#include <stdint.h>
+
+// Levels below OPLIB_LOG_LEVEL are compiled out: their arguments are
+// not even evaluated. Build with -DOPLIB_LOG_LEVEL=0 to get the TRACE
+// and DEBUG messages, INFO and above by default
+#define OPLIB_LOG_LEVEL_TRACE 0
+#define OPLIB_LOG_LEVEL_DEBUG 1
+#define OPLIB_LOG_LEVEL_INFO  2
+#define OPLIB_LOG_LEVEL_WARN  3
+#define OPLIB_LOG_LEVEL_ERROR 4
+#define OPLIB_LOG_LEVEL_FATAL 5
+
+#ifndef OPLIB_LOG_LEVEL
+#define OPLIB_LOG_LEVEL OPLIB_LOG_LEVEL_INFO
+#endif
+
+namespace oplib
+{
+  enum class LogLevel { TRACE, DEBUG, INFO, WARN, ERROR, FATAL };
+
+  namespace log
+  {
+    // Runtime threshold, on top of OPLIB_LOG_LEVEL
+    void setLevel(LogLevel level_);
+    LogLevel level();
+
+    inline bool enabled(LogLevel level_)
+    { return level_ >= level(); }
+
+    // Formats one line: time, thread id, level, message, file:line.
+    // Into the thread's buffer while an AsyncLogging runs, else
+    // written to stderr right away. Use the LOG_ macros.
+    // The calling thread always formats the line: vsnprintf and the
+    // clock read cost about 150ns and 40ns on its own, far from tens
+    // of nanoseconds. The AsyncLogging only takes the write(2) of
+    // every line off the thread, about half the cost of a line to the
+    // unbuffered stderr. It is not cheaper than a buffered FILE
+    void write(LogLevel level_, const char* file_, int line_, const char* format_, ...)
+      __attribute__((format(printf, 4, 5)));
+
+    // write() then abort(), once the pending messages are out
+    [[noreturn]] void fatal(const char* file_, int line_, const char* format_, ...)
+      __attribute__((format(printf, 3, 4)));
+
+    // Messages lost because the writer fell behind, see AsyncLogging
+    uint64_t dropped();
+  }
+}
+
+#define OPLIB_LOG(level_, levelNumber_, ...)                                   \
+  do                                                                           \
+  {                                                                            \
+    if (levelNumber_ >= OPLIB_LOG_LEVEL && oplib::log::enabled(level_))        \
+    {                                                                          \
+      oplib::log::write(level_, __FILE__, __LINE__, __VA_ARGS__);              \
+    }                                                                          \
+  } while (0)
+
+#define LOG_TRACE(...) OPLIB_LOG(oplib::LogLevel::TRACE, OPLIB_LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) OPLIB_LOG(oplib::LogLevel::DEBUG, OPLIB_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  OPLIB_LOG(oplib::LogLevel::INFO, OPLIB_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)  OPLIB_LOG(oplib::LogLevel::WARN, OPLIB_LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) OPLIB_LOG(oplib::LogLevel::ERROR, OPLIB_LOG_LEVEL_ERROR, __VA_ARGS__)
+// Never filtered, aborts
+#define LOG_FATAL(...) oplib::log::fatal(__FILE__, __LINE__, __VA_ARGS__)
+
+#endif
@@ -19,8 +19,7 @@ Connector::Connector(EventLoop* loop_, const InetAddress& serverAddr_)
 
 Connector::~Connector()
 {
-  // TODO: cancel the timer
-  printf("Connector::~Connector()\n");
+  LOG_DEBUG("Connector::~Connector()");
   _loop->cancel(_timerId);
   assert(!_dispatcher);
 }
@@ -35,15 +34,14 @@ void Connector::startInLoop()
 {
   _loop->inLoopThreadOrDie();
   assert(_state == State::DISCONNECTED);
-  printf("Connector::startInLoop()\n");
+  LOG_DEBUG("Connector::startInLoop()");
   if (_connect)
   {
     connect();
   }
   else
   {
-    //TODO log
-    printf("Connector::startInLoop(): do not connect\n");
+    LOG_DEBUG("Connector::startInLoop(): do not connect");
   }
 }
 
@@ -60,7 +58,7 @@ void Connector::connect()
    case EINPROGRESS:
    case EINTR:
    case EISCONN:
-     printf("Connector::connect(): connecting\n");
+     LOG_DEBUG("Connector::connect(): connecting");
      connecting(sockfd);
      break;
    case EACCES:
@@ -70,12 +68,13 @@ void Connector::connect()
    case EBADF:
    case EFAULT:
    case ENOTSOCK:
-     // TODO: log
-     printf("connect error in Connector::startInLoop\n");
+     LOG_ERROR("Connector::connect() to %s error %s",
+               _serverAddr.toHostPort().c_str(), ::strerror(savedErrno));
      socketutils::close(sockfd);
      break;
    default:
-     printf("unexpected error in Connector::startInLoop with errno: %d\n", savedErrno);
+     LOG_ERROR("Connector::connect() to %s unexpected error %s",
+               _serverAddr.toHostPort().c_str(), ::strerror(savedErrno));
      socketutils::close(sockfd);
      break;
   }
@@ -93,15 +92,28 @@ void Connector::restart()
 void Connector::stop()
 {
   _connect = false;
-  //_loop->cancel(timerID);
+  _loop->runInLoop(std::bind(&Connector::stopInLoop, this));
+}
+
+void Connector::stopInLoop()
+{
+  _loop->inLoopThreadOrDie();
+  _loop->cancel(_timerId);
+  if (_state == State::CONNECTING)
+  {
+    setState(State::DISCONNECTED);
+    int sockfd = removeAndResetDispatcher();
+    socketutils::close(sockfd);
+  }
 }
 
 void Connector::connecting(int sockfd_)
 {
-  printf("Connector()::connecting()\n");
+  LOG_DEBUG("Connector::connecting() fd %d", sockfd_);
   setState(State::CONNECTING);
   assert(!_dispatcher);
   _dispatcher.reset(new EventDispatcher(_loop, sockfd_));
+  _dispatcher->setType(DispatcherType::CONNECTOR);
   _dispatcher->setWriteCallback(std::bind(&Connector::handleWrite, this));
   _dispatcher->setErrorCallback(std::bind(&Connector::handleError, this));
   _dispatcher->enableWriting();
@@ -125,7 +137,7 @@ void Connector::resetDispatcher()
 
 void Connector::handleWrite()
 {
-  printf("Connector::handleWrite\n");
+  LOG_TRACE("Connector::handleWrite()");
 
   if (_state == State::CONNECTING)
   {
@@ -133,12 +145,12 @@ void Connector::handleWrite()
     int err = socketutils::getSocketError(sockfd);
     if (err)
     {
-      printf("Connector::handleWrite - SO_ERROR = %d\n", err);
+      LOG_WARN("Connector::handleWrite() SO_ERROR %s", ::strerror(err));
       retry(sockfd);
     }
     else if (socketutils::isSelfConnect(sockfd))
     {
-      printf("Connector::handleWrite - Self connect\n");
+      LOG_WARN("Connector::handleWrite() self connect");
       retry(sockfd);
     }
     else
@@ -162,12 +174,11 @@ void Connector::handleWrite()
 
 void Connector::handleError()
 {
-  printf("Connector::handleError\n");
   assert(_state == State::CONNECTING);
 
   int sockfd = removeAndResetDispatcher();
   int err = socketutils::getSocketError(sockfd);
-  printf("SO_ERROR = %d %s\n", err, ::strerror(err));
+  LOG_ERROR("Connector::handleError() SO_ERROR %s", ::strerror(err));
   retry(sockfd);
 }
 
@@ -183,6 +194,6 @@ void Connector::retry(int sockfd)
   }
   else
   {
-    printf("Do not connect\n");
+    LOG_DEBUG("Connector::retry(): do not connect");
   }
 }
@@ -10,6 +10,7 @@
 #include <memory>
 
 #include <util/Common.h>
+#include <log/Logging.h>
 
 namespace oplib
 {
@@ -28,6 +29,7 @@ namespace net
 
      void start();
      void restart();
+     // Cancel the retry timer and drop a connect in progress
      void stop();
 
 
@@ -37,22 +39,14 @@ namespace net
 
      void setState(State s_) 
      {
-       switch (s_)
-       {
-           case State::DISCONNECTED:
-          printf("SetState to DISCONNECTED\n");
-          break;
-           case State::CONNECTING:
-          printf("SetState to CONNECTING\n");
-          break;
-           case State::CONNECTED:
-          printf("SetState to CONNECTED\n");
-          break;
-       }
+       LOG_TRACE("Connector::setState() %s",
+                 s_ == State::DISCONNECTED ? "DISCONNECTED" :
+                 s_ == State::CONNECTING ? "CONNECTING" : "CONNECTED");
        _state = s_;
      }
 
      void startInLoop();
+     void stopInLoop();
      void connect();
      void connecting(int sockfd_);
 
@@ -0,0 +1,144 @@
+#include "EPollPoller.h"
+#include "EventDispatcher.h"
+#include "EventLoop.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cassert>
+
+#include <log/Logging.h>
+
+namespace oplib
+{
+  const int EPollPoller::kNew = -1;
+  const int EPollPoller::kAdded = 1;
+  const int EPollPoller::kDeleted = 2;
+
+  const int EPollPoller::kInitEventListSize = 16;
+
+  namespace epollfd
+  {
+    int createEpollfd()
+    {
+      int epollfd = ::epoll_create1(EPOLL_CLOEXEC);
+      if (epollfd < 0)
+      {
+        LOG_FATAL("epoll_create1 error: %s", ::strerror(errno));
+      }
+      return epollfd;
+    }
+  }
+
+  EPollPoller::EPollPoller(EventLoop* loop_)
+  : Poller(loop_),
+    _epollfd(epollfd::createEpollfd()),
+    _events(kInitEventListSize)
+  {}
+
+  EPollPoller::~EPollPoller()
+  {
+    ::close(_epollfd);
+  }
+
+  Timestamp EPollPoller::poll(int timeout_, EventDispatcherList *activeDispatchers_)
+  {
+    // can only be called from loop thread
+    inLoopThreadOrDie();
+
+    int numEvents = ::epoll_wait(_epollfd, _events.data(),
+                                 static_cast<int>(_events.size()), timeout_);
+    ++_syscalls;
+    int savedErrno = errno;
+    Timestamp pollReturnTime { Timestamp::now() };
+    if (numEvents > 0)
+    {
+      fillDispatchers(numEvents, activeDispatchers_);
+      if (implicit_cast<size_t>(numEvents) == _events.size())
+      {
+        // The event list is full, there may be more ready fds
+        _events.resize(_events.size() * 2);
+      }
+    }
+    else if (numEvents < 0 && savedErrno != EINTR)
+    {
+      LOG_FATAL("epoll_wait error: %s", ::strerror(savedErrno));
+    }
+    return pollReturnTime;
+  }
+
+  void EPollPoller::fillDispatchers(int activeEventCnt_, EventDispatcherList* list_) const
+  {
+    // Only the ready fds are returned by epoll_wait, no lookup needed
+    for (int i = 0; i < activeEventCnt_; ++i)
+    {
+      auto dispatcher = static_cast<EventDispatcher*>(_events[i].data.ptr);
+      dispatcher->setRevents(static_cast<int>(_events[i].events));
+      list_->push_back(dispatcher);
+    }
+  }
+
+  void EPollPoller::updateEventDispatcher(EventDispatcher* dispatcher_)
+  {
+    const int index = dispatcher_->index();
+    if (index == kNew || index == kDeleted)
+    {
+      // A new dispatcher, or one which was ignored before
+      if (dispatcher_->isIgnored())
+      {
+        // Nothing to watch, don't bother the kernel
+        return;
+      }
+      dispatcher_->setIndex(kAdded);
+      update(EPOLL_CTL_ADD, dispatcher_);
+    }
+    else
+    {
+      assert(index == kAdded);
+      if (dispatcher_->isIgnored())
+      {
+        update(EPOLL_CTL_DEL, dispatcher_);
+        dispatcher_->setIndex(kDeleted);
+      }
+      else
+      {
+        update(EPOLL_CTL_MOD, dispatcher_);
+      }
+    }
+  }
+
+  void EPollPoller::removeEventDispatcher(EventDispatcher* dispatcher_)
+  {
+    const int index = dispatcher_->index();
+    if (index == kNew)
+    {
+      LOG_FATAL("EPollPoller: fd %d removed but never added", dispatcher_->fd());
+    }
+
+    if (index == kAdded)
+    {
+      update(EPOLL_CTL_DEL, dispatcher_);
+    }
+    dispatcher_->setIndex(kNew);
+  }
+
+  void EPollPoller::update(int operation_, EventDispatcher* dispatcher_)
+  {
+    struct epoll_event event;
+    event.events = static_cast<uint32_t>(dispatcher_->events());
+    event.data.ptr = dispatcher_;
+    ++_syscalls;
+    if (::epoll_ctl(_epollfd, operation_, dispatcher_->fd(), &event) < 0)
+    {
+      if (operation_ != EPOLL_CTL_DEL)
+      {
+        LOG_FATAL("epoll_ctl error %s, op = %d, fd = %d",
+                  ::strerror(errno), operation_, dispatcher_->fd());
+      }
+      LOG_ERROR("epoll_ctl error %s, op = %d, fd = %d",
+                ::strerror(errno), operation_, dispatcher_->fd());
+    }
+  }
+}
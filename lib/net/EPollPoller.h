@@ -0,0 +1,45 @@
+#ifndef OPLIB_EPOLLPOLLER_H
+#define OPLIB_EPOLLPOLLER_H
+
+#include "Poller.h"
+
+#include <vector>
+
+// This structure is defined in <sys/epoll.h>
+// at global namespace
+struct epoll_event;
+
+namespace oplib
+{
+  // epoll(7) backend: the EventDispatcher* is stored in
+  // epoll_event.data.ptr, so a wakeup only costs O(active fds)
+  class EPollPoller : public Poller
+  {
+   public:
+    EPollPoller(EventLoop* loop_);
+    ~EPollPoller() override;
+
+    void updateEventDispatcher(EventDispatcher* dispatcher_) override;
+    void removeEventDispatcher(EventDispatcher* dispatcher_) override;
+
+    Timestamp poll(int timeout_, EventDispatcherList *activeDispatchers_) override;
+
+   private:
+    void fillDispatchers(int activeEventCnt_, EventDispatcherList* list_) const;
+    void update(int operation_, EventDispatcher* dispatcher_);
+
+    // EventDispatcher::index() is used as the registration state
+    static const int kNew;
+    static const int kAdded;
+    static const int kDeleted;
+
+    static const int kInitEventListSize;
+
+    using EventList = std::vector<struct epoll_event>;
+
+    const int _epollfd;
+    EventList _events;
+  };
+}
+
+#endif
@@ -2,17 +2,22 @@
 #include "EventLoop.h"
 
 #include <poll.h>
+#include <sys/epoll.h>
 #include <cassert>
 
+#include <log/Logging.h>
+
 namespace oplib
 {
   const int EventDispatcher::kNoEvent = 0;
   const int EventDispatcher::kReadEvent = POLLIN | POLLPRI;
   const int EventDispatcher::kWriteEvent = POLLOUT;
+  const int EventDispatcher::kEdgeTriggered = static_cast<int>(EPOLLET);
 
   EventDispatcher::EventDispatcher(EventLoop* loop_, int fd_)
   : _handlingEvent(false),
     _fd(fd_), _loop(loop_),
+    _type(DispatcherType::OTHER),
     _events(0),
     _revents(0),
     _index(-1)
@@ -33,11 +38,6 @@ namespace oplib
   {
     _handlingEvent = true;
 
-    if (_revents & POLLNVAL)
-    {
-      // TODO log warning
-    }
-
     if ((_revents & POLLHUP) && !(_revents & POLLIN))
     {
       // Peer closed, bust stil data to read, read
@@ -48,7 +48,7 @@ namespace oplib
 
     if (_revents & POLLNVAL)
     {
-      printf("EventDispatcher::handleEvent() : POLLNVAL\n");
+      LOG_WARN("EventDispatcher::handleEvent() fd %d POLLNVAL", _fd);
     }
 
     if (_revents & (POLLERR | POLLNVAL))
@@ -37,6 +37,10 @@ namespace oplib
       _closeCallback = cb_;
     }
 
+    // OTHER unless set by the owner
+    void setType(DispatcherType type_) { _type = type_; }
+    DispatcherType type() const { return _type; }
+
     int fd() const { return _fd; }
     int events() const { return _events; }
     int revents() const { return _revents; }
@@ -48,6 +52,15 @@ namespace oplib
       updateLoop();
     }
 
+    void disableReading()
+    {
+      _events &= ~kReadEvent;
+      updateLoop();
+    }
+
+    bool isReading() const
+    { return _events & kReadEvent; }
+
     void enableWriting()
     {
       _events |= kWriteEvent;
@@ -63,6 +76,18 @@ namespace oplib
     bool isWriting()
     { return _events & kWriteEvent; }
 
+    // Edge-triggered mode (epoll only): watch reading and writing
+    // once, the dispatcher is not re-armed afterwards, so the owner
+    // must read/write until EAGAIN on every event
+    void enableEdgeTriggered()
+    {
+      _events |= kReadEvent | kWriteEvent | kEdgeTriggered;
+      updateLoop();
+    }
+
+    bool isEdgeTriggered() const
+    { return _events & kEdgeTriggered; }
+
     void disable()
     {
       _events = kNoEvent;
@@ -85,12 +110,14 @@ namespace oplib
     static const int kNoEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
+    static const int kEdgeTriggered;
 
     bool _handlingEvent;
 
     // EventDispatcher does not own the fd
     const int _fd;
     EventLoop* _loop;
+    DispatcherType _type;
 
     int _events;
     int _revents;
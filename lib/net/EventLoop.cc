@@ -4,6 +4,7 @@
 #include "TimerManager.h"
 
 #include <util/Timestamp.h>
+#include <log/Logging.h>
 
 #include <assert.h>
 #include <unistd.h>
@@ -15,22 +16,28 @@ namespace oplib
   // Thread local pointer: every thread can only have one loop
   __thread EventLoop* gLoopInThread { nullptr };
 
-  EventLoop::EventLoop()
+  const size_t EventLoop::kOverflowBufferSize = 64 * 1024;
+
+  EventLoop::EventLoop(PollerType pollerType_, TimerQueueType timerQueueType_)
   : _threadId(CurrentThread::tid()),
-    _poller(std::make_unique<Poller>(this)),
-    _timerMgr(std::make_unique<TimerManager>(this)),
+    _pollerType(Poller::available(pollerType_)),
+    _poller(Poller::newPoller(this, _pollerType)),
+    _timerMgr(std::make_unique<TimerManager>(this, timerQueueType_)),
     _wakeupfd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
-    _wakeupDispatcher(std::make_unique<EventDispatcher>(this, _wakeupfd))
+    _wakeupDispatcher(std::make_unique<EventDispatcher>(this, _wakeupfd)),
+    _overflowBuffer(new char[kOverflowBufferSize]),
+    _readStats(),
+    _busyWindowStart(Timestamp::now())
   {
     if (gLoopInThread != nullptr)
     {
-      // TODO: add log here
-      abort();
+      LOG_FATAL("Another EventLoop exists in thread %d", _threadId);
     }
     gLoopInThread = this;
 
     // When this eventfd is readable: execute all pending functors
     // bind: take the address of a function
+    _wakeupDispatcher->setType(DispatcherType::WAKEUP);
     _wakeupDispatcher->setReadCallback(
       std::bind(&EventLoop::handleRead, this));
     _wakeupDispatcher->enableReading();
@@ -40,18 +47,27 @@ namespace oplib
   {
     if (!inLoopThread())
     {
-      // TODO: add log here
-      abort();
-    } 
+      LOG_FATAL("EventLoop of thread %d used from thread %d",
+                _threadId, CurrentThread::tid());
+    }
   }
 
   EventLoop::~EventLoop()
   {
     // If the loop is still looping, it cannot be destroyed
     assert(!_looping);
+    while (PendingFunctor* pending = _pendingFunctors.pop())
+    {
+      delete pending;
+    }
     gLoopInThread = nullptr;
   }
 
+  uint64_t EventLoop::pollerSyscalls() const
+  {
+    return _poller->syscalls();
+  }
+
   void EventLoop::updateEventDispatcher(EventDispatcher* dp_)
   {
     _poller->updateEventDispatcher(dp_);
@@ -70,43 +86,56 @@ namespace oplib
     assert(!_looping);
     Poller::EventDispatcherList activeDispatchers;
     _looping.exchange(true);
+    _iterationEnd = Timestamp::now();
 
     while (!_done)
     {
       activeDispatchers.clear();
-      oplib::Timestamp pollReturn = _poller->poll(_timeout, &activeDispatchers);
+      // Busy polling: don't block until the spin budget granted
+      // by the last activity is used up
+      const bool spinning = busyPoll() > 0 && _iterationEnd < _spinDeadline;
+      oplib::Timestamp pollReturn = _poller->poll(spinning ? 0 : _timeout, &activeDispatchers);
 
+      Timestamp callbackStart(pollReturn);
       for (auto dispatcher : activeDispatchers)
       {
+        // The dispatcher may be gone once handled
+        const int type = static_cast<int>(dispatcher->type());
         // When the events are filled, 
         // call handleEvent on all the dispatchers
         dispatcher->handleEvent(pollReturn);
+        Timestamp callbackEnd(Timestamp::now());
+        _metrics.callback[type].record(callbackEnd - callbackStart);
+        callbackStart = callbackEnd;
       }
 
       // Execute pending functors here
       executePendingFunctors();
+      const bool active = !activeDispatchers.empty() ||
+                          _load.functorsLastIteration.load(std::memory_order_relaxed) > 0;
+      updateBusyTime(pollReturn, spinning, active);
     }
 
     _looping.exchange(false);
   }
 
-  TimerId EventLoop::runAt(const Timestamp& when_, const TimerCallback& cb_)
+  TimerId EventLoop::runAt(const Timestamp& when_, TimerCallback&& cb_)
   {
-    return _timerMgr->addTimer(cb_, when_, 0.0);
+    return _timerMgr->addTimer(std::move(cb_), when_, 0.0);
   }
 
-  TimerId EventLoop::runEvery(double interval_, const TimerCallback& cb_)
+  TimerId EventLoop::runEvery(double interval_, TimerCallback&& cb_, double slack_)
   {
     Timestamp fire { Timestamp::now() };
     fire += interval_;
-    return _timerMgr->addTimer(cb_, fire, interval_);
+    return _timerMgr->addTimer(std::move(cb_), fire, interval_, slack_);
   }
 
-  TimerId EventLoop::runAfter(double delay_, const TimerCallback& cb_)
+  TimerId EventLoop::runAfter(double delay_, TimerCallback&& cb_, double slack_)
   {
     Timestamp fire { Timestamp::now() };
     fire += delay_; 
-    return _timerMgr->addTimer(cb_, fire, 0.0);
+    return _timerMgr->addTimer(std::move(cb_), fire, 0.0, slack_);
   }
 
   void EventLoop::cancel(TimerId timerId_)
@@ -114,29 +143,33 @@ namespace oplib
     _timerMgr->cancel(timerId_);
   }
 
-  void EventLoop::runInLoop(const Functor& func_)
+  void EventLoop::runInLoop(Functor&& func_)
   {
     // If in loop thread, call this functor directly
     if (inLoopThread())
       func_();
     else
     {
-      enqueue(func_);
+      enqueue(std::move(func_));
     }
   }
 
-  void EventLoop::enqueue(const Functor& func_)
+  void EventLoop::enqueue(Functor&& func_)
   {
+    _pendingFunctors.push(new PendingFunctor(std::move(func_)));
+
+    // In the loop thread and not executing functors: the functor
+    // runs at the end of this iteration, no need to wakeup
+    if (inLoopThread() && !_executingFunctors)
     {
-      oplib::MutexLockGuard guard(_mutex);
-      _pendingFunctors.push_back(func_);
+      return;
     }
 
-    // (1) currently not in loop thread, must wake up or the functor
-    // won't get executed in time
-    // (2) Currently executing functors, need to wakeup
-    // so the functors newly added can be executed in time
-    if (!inLoopThread() || _executingFunctors)
+    // Only the first producer since the loop drained the queue
+    // writes the eventfd, the others ride on its wakeup.
+    // The exchange comes after the push, so the loop clearing
+    // the flag is guaranteed to see the functor
+    if (!_wakeupPending.exchange(true))
     {
       wakeup();
     }
@@ -154,20 +187,84 @@ namespace oplib
   void EventLoop::executePendingFunctors()
   {
     _executingFunctors.exchange(true);
-    std::vector<Functor> toExecute;
+    // Producers coming after this point wakeup the loop again
+    _wakeupPending.exchange(false);
+
+    // Only run what was queued so far, functors queued by
+    // the functors themselves wait for the next iteration.
+    // Stopping short on a producer still linking its functor
+    // is fine: it wakes the loop once its push is complete
+    const size_t queued = _pendingFunctors.size();
+    int executed = 0;
+    while (static_cast<size_t>(executed) < queued)
     {
-      // Minimize the critical section
-      MutexLockGuard guard(_mutex);
-      toExecute.swap(_pendingFunctors);
+      PendingFunctor* pending = _pendingFunctors.pop();
+      if (pending == nullptr)
+      {
+        break;
+      }
+      ++executed;
+      pending->_func();
+      delete pending;
     }
 
-    // Execute the functors sequentially
-    for (auto& func : toExecute)
+    _executingFunctors.exchange(false);
+    _load.functorsLastIteration.store(executed, std::memory_order_relaxed);
+    if (executed > 0)
     {
-      func();
+      _metrics.pendingFunctors.record(executed);
     }
+  }
 
-    _executingFunctors.exchange(false);
+  void EventLoop::updateBusyTime(Timestamp pollReturn_, bool spinning_, bool active_)
+  {
+    Timestamp now(Timestamp::now());
+    const int64_t waited = pollReturn_ - _iterationEnd;
+    const int64_t handled = now - pollReturn_;
+    _iterationEnd = now;
+    _metrics.pollWait.record(std::max<int64_t>(waited, 0));
+    _metrics.iteration.record(std::max<int64_t>(waited + handled, 0));
+
+    if (spinning_)
+    {
+      // An empty spin is no work, it doesn't count as busy
+      // for the placement of new connections either
+      _timeSplit.spinningMicroSeconds.fetch_add(active_ ? waited : waited + handled,
+                                                std::memory_order_relaxed);
+    }
+    else
+    {
+      _timeSplit.blockedMicroSeconds.fetch_add(waited, std::memory_order_relaxed);
+    }
+    if (active_ || !spinning_)
+    {
+      _timeSplit.busyMicroSeconds.fetch_add(handled, std::memory_order_relaxed);
+      _busyMicroSeconds += handled;
+    }
+
+    const int64_t spinBudget = busyPoll();
+    if (active_ && spinBudget > 0)
+    {
+      _spinDeadline = now;
+      _spinDeadline += static_cast<double>(spinBudget) / Timestamp::numMicroSecondsInSeconds;
+    }
+
+    const int64_t window = now - _busyWindowStart;
+    if (window >= kBusyWindowMicroSeconds)
+    {
+      _load.busyPermille.store(static_cast<int>(_busyMicroSeconds * 1000 / window),
+                               std::memory_order_relaxed);
+      _busyWindowStart = now;
+      _busyMicroSeconds = 0;
+    }
+  }
+
+  double EventLoop::spinningFraction() const
+  {
+    const int64_t spinning = _timeSplit.spinningMicroSeconds.load(std::memory_order_relaxed);
+    const int64_t waiting = spinning +
+                            _timeSplit.blockedMicroSeconds.load(std::memory_order_relaxed);
+    return waiting > 0 ? static_cast<double>(spinning) / waiting : 0.0;
   }
 
   void EventLoop::wakeup()
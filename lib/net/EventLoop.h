@@ -3,16 +3,18 @@
 
 #include "Types.h"
 #include "TimerManager.h"
+#include "LoopMetrics.h"
 
 #include <sys/types.h>
 #include <atomic>
 #include <memory>
 #include <vector>
 
+#include <ds/BufferPool.h>
 #include <util/Common.h>
 #include <util/Timestamp.h>
 #include <thread/Thread.h>
-#include <thread/Mutex.h>
+#include <thread/MpscQueue.h>
 
 namespace oplib
 {
@@ -23,10 +25,46 @@ namespace oplib
   class EventLoop : public Noncopyable
   {
    public:
-    EventLoop();
+    // Load of the loop, published for the connection placement
+    // of EventLoopThreadPool. Any thread reads it, relaxed
+    struct Load
+    {
+      // TCPConnections created on the loop and not closed yet
+      std::atomic_int connections { 0 };
+      // Bytes queued in the output of those connections
+      std::atomic<int64_t> pendingOutputBytes { 0 };
+      // Functors run by the last iteration
+      std::atomic_int functorsLastIteration { 0 };
+      // Time spent outside of poll in the last window, in permille
+      std::atomic_int busyPermille { 0 };
+    };
+
+    // Window of Load::busyPermille
+    static const int64_t kBusyWindowMicroSeconds = 100 * 1000;
+
+    // Where the time of the loop went since it started. Any thread
+    // reads it, relaxed
+    struct TimeSplit
+    {
+      // Handling events and running functors
+      std::atomic<int64_t> busyMicroSeconds { 0 };
+      // Polling without blocking, see setBusyPoll()
+      std::atomic<int64_t> spinningMicroSeconds { 0 };
+      // Blocked in the poller
+      std::atomic<int64_t> blockedMicroSeconds { 0 };
+    };
+
+    explicit EventLoop(PollerType pollerType_ = PollerType::POLL,
+                       TimerQueueType timerQueueType_ = TimerQueueType::WHEEL);
     ~EventLoop();
 
     void loop();
+
+    // The backend in use, EPOLL if IO_URING was asked for
+    // and the kernel doesn't support it
+    PollerType pollerType() const { return _pollerType; }
+    // Syscalls made by the poller, loop thread only
+    uint64_t pollerSyscalls() const;
     void inLoopThreadOrDie();
     bool inLoopThread() const
     {
@@ -52,26 +90,76 @@ namespace oplib
     void removeEventDispatcher(EventDispatcher* dp_);
 
     // Run at a time
-    TimerId runAt(const Timestamp& when_, const TimerCallback& cb_);
+    TimerId runAt(const Timestamp& when_, TimerCallback&& cb_);
 
     // Run every time interval
-    TimerId runEvery(double interval_, const TimerCallback& cb_);
+    // slack_: the callback may run up to slack_ seconds late, timers
+    // within each other's slack share one timerfd expiration
+    TimerId runEvery(double interval_, TimerCallback&& cb_, double slack_ = 0.0);
 
-    // Run after a period of time
-    TimerId runAfter(double delay_, const TimerCallback& cb_);
+    // Run after a period of time, with an optional slack_ as in runEvery
+    TimerId runAfter(double delay_, TimerCallback&& cb_, double slack_ = 0.0);
 
     // Cancel a timer
     void cancel(TimerId timerId_);
 
     // Run a functor callback in the loop thread
-    void runInLoop(const Functor& func_);
-    void enqueue(const Functor& func_);
+    // Functors are moved along, never copied
+    void runInLoop(Functor&& func_);
+    // Lock-free, callable from any thread: the loop is only
+    // woken up by the first functor queued since the last run
+    void enqueue(Functor&& func_);
+
+    // Storage of the buffers of the connections served by
+    // this loop, only used in the loop thread
+    ds::BufferPool* bufferPool() { return &_bufferPool; }
+
+    // Spill area shared by the socket reads of this loop
+    char* overflowBuffer() { return _overflowBuffer.get(); }
+    static const size_t kOverflowBufferSize;
+
+    // Updated by the connections in the loop thread
+    ReadStats& readStats() { return _readStats; }
+
+    Load& load() { return _load; }
+
+    // Counters and histograms of the loop, updated by the loop thread
+    // and its connections and timers. metrics().snapshot() can be
+    // called from any thread while the loop runs
+    LoopMetrics& metrics() { return _metrics; }
+    const LoopMetrics& metrics() const { return _metrics; }
+
+    // Adaptive busy polling, off by default. After an iteration which
+    // handled events or functors, the loop polls without blocking for
+    // up to spinMicroSeconds_ before it blocks again: an event coming
+    // meanwhile is picked up without the wakeup of a blocked thread,
+    // at the cost of a busy core. 0 turns it off, thread-safe
+    void setBusyPoll(int64_t spinMicroSeconds_)
+    { _busyPollMicroSeconds.store(spinMicroSeconds_, std::memory_order_relaxed); }
+    int64_t busyPoll() const
+    { return _busyPollMicroSeconds.load(std::memory_order_relaxed); }
+
+    const TimeSplit& timeSplit() const { return _timeSplit; }
+    // Share of the waiting time spent spinning rather than blocked
+    double spinningFraction() const;
 
    private:
+    struct PendingFunctor : MpscNode
+    {
+      explicit PendingFunctor(Functor&& func_)
+      : _func(std::move(func_))
+      {}
+
+      Functor _func;
+    };
 
     void handleRead();
     void executePendingFunctors();
     void wakeup();
+    // Account the time waited before pollReturn_ as spinning_ or
+    // blocked, and the time from pollReturn_ to now as busy, or as
+    // spinning if the iteration found nothing to do
+    void updateBusyTime(Timestamp pollReturn_, bool spinning_, bool active_);
 
     std::atomic_bool _looping { false };
     std::atomic_bool _executingFunctors { false };
@@ -79,12 +167,28 @@ namespace oplib
     bool _done { false };
 
     const pid_t _threadId;
+    const PollerType _pollerType;
     std::unique_ptr<Poller> _poller;
     std::unique_ptr<TimerManager> _timerMgr;
     int _wakeupfd;
     std::unique_ptr<EventDispatcher> _wakeupDispatcher;
-    std::vector<Functor> _pendingFunctors;
-    oplib::Mutex _mutex;   
+    MpscQueue<PendingFunctor> _pendingFunctors;
+    // Set by the producer that has to write the wakeupfd,
+    // cleared by the loop before running the pending functors
+    std::atomic_bool _wakeupPending { false };
+    ds::BufferPool _bufferPool;
+    std::unique_ptr<char[]> _overflowBuffer;
+    ReadStats _readStats;
+    Load _load;
+    LoopMetrics _metrics;
+    Timestamp _busyWindowStart;
+    int64_t _busyMicroSeconds { 0 };
+    std::atomic<int64_t> _busyPollMicroSeconds { 0 };
+    TimeSplit _timeSplit;
+    // End of the last iteration, when the poller was entered
+    Timestamp _iterationEnd;
+    // Poll without blocking until then
+    Timestamp _spinDeadline;
   };
 }
 
@@ -4,13 +4,17 @@
 
 namespace oplib
 {
-  EventLoopThread::EventLoopThread()
+  EventLoopThread::EventLoopThread(PollerType pollerType_, TimerQueueType timerQueueType_,
+                                   const std::vector<int>& cpus_)
   : _thread(std::bind(&EventLoopThread::threadFunc, this)),
+    _pollerType(pollerType_),
+    _timerQueueType(timerQueueType_),
     _loop(nullptr),
     _mutex(),
     _cond(_mutex),
     _running(false)
   {
+    _thread.setCpuAffinity(cpus_);
   }
 
   EventLoopThread::~EventLoopThread()
@@ -25,7 +29,7 @@ namespace oplib
 
   void EventLoopThread::threadFunc()
   {
-    EventLoop loop;
+    EventLoop loop(_pollerType, _timerQueueType);
 
     {
       MutexLockGuard guard(_mutex);
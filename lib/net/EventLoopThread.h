@@ -12,15 +12,25 @@ namespace oplib
   {
    public:
 
-    EventLoopThread();
+    // The loop is created in its thread, pinned to cpus_ if not
+    // empty: its poller, timers and buffers are first touched there
+    explicit EventLoopThread(PollerType pollerType_ = PollerType::POLL,
+                             TimerQueueType timerQueueType_ = TimerQueueType::WHEEL,
+                             const std::vector<int>& cpus_ = std::vector<int>());
     ~EventLoopThread();
 
     EventLoop* startLoop();
 
+    // Once started: bound to cpus_, see Thread::pinned()
+    bool pinned() const
+    { return _thread.pinned(); }
+
    private:
     void threadFunc();
 
     Thread _thread;
+    PollerType _pollerType;
+    TimerQueueType _timerQueueType;
     EventLoop* _loop;
     Mutex _mutex;
     Condition _cond;
@@ -1,5 +1,6 @@
 #include "EventLoopThreadPool.h"
 
+#include <sched.h>
 #include <cassert>
 
 using namespace oplib;
@@ -8,7 +9,12 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop* masterLoop_)
 : _masterLoop(masterLoop_),
   _started(false),
   _nThreads(0),
-  _next(0)
+  _pollerType(PollerType::POLL),
+  _timerQueueType(TimerQueueType::WHEEL),
+  _busyPollMicroSeconds(0),
+  _next(0),
+  _placementPolicy(PlacementPolicy::ROUND_ROBIN),
+  _random(2463534242u)
 {
 }
 
@@ -25,9 +31,50 @@ void EventLoopThreadPool::start()
 
   for (size_t i = 0; i < _nThreads; ++i)
   {
-    auto loopThread = std::make_shared<EventLoopThread>();
+    std::vector<int> cpus;
+    if (!_threadCpus.empty())
+    {
+      cpus = _threadCpus[i % _threadCpus.size()];
+    }
+    auto loopThread = std::make_shared<EventLoopThread>(_pollerType, _timerQueueType, cpus);
     _threads.push_back(loopThread);
     _loops.push_back(loopThread->startLoop());
+    warnAffinity(i, cpus, loopThread->pinned());
+    _loops.back()->setBusyPoll(_busyPollMicroSeconds);
+  }
+  if (_loops.empty() && _busyPollMicroSeconds > 0)
+  {
+    // The master loop serves the connections
+    _masterLoop->setBusyPoll(_busyPollMicroSeconds);
+  }
+}
+
+void EventLoopThreadPool::warnAffinity(size_t thread_, const std::vector<int>& cpus_, bool pinned_)
+{
+  for (int cpu : cpus_)
+  {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      LOG_WARN("EventLoopThreadPool: CPU %d of IO thread %zu out of range, skipped", cpu, thread_);
+    }
+  }
+  if (!cpus_.empty() && !pinned_)
+  {
+    LOG_WARN("EventLoopThreadPool: IO thread %zu runs unpinned, none of its CPUs can be used",
+             thread_);
+  }
+}
+
+void EventLoopThreadPool::setBusyPoll(int64_t spinMicroSeconds_)
+{
+  _masterLoop->inLoopThreadOrDie();
+  _busyPollMicroSeconds = spinMicroSeconds_;
+  if (_started)
+  {
+    for (EventLoop* loop : getAllLoops())
+    {
+      loop->setBusyPoll(spinMicroSeconds_);
+    }
   }
 }
 
@@ -36,17 +83,92 @@ EventLoop* EventLoopThreadPool::getNextLoop()
   _masterLoop->inLoopThreadOrDie();
 
   // If single-threaded, just use the master loop
-  EventLoop* loop = _masterLoop;
+  if (_loops.empty())
+  {
+    return _masterLoop;
+  }
 
-  if (!_loops.empty())
+  if (_loopSelector)
   {
-    loop = _loops[_next];
-    ++_next;
-    if (static_cast<size_t>(_next) >= _loops.size())
+    return _loopSelector(_loops);
+  }
+
+  switch (_placementPolicy)
+  {
+    case PlacementPolicy::LEAST_CONNECTIONS:
+      return leastLoaded([] (EventLoop* loop_) -> int64_t {
+        return loop_->load().connections.load(std::memory_order_relaxed);
+      });
+    case PlacementPolicy::LEAST_PENDING_BYTES:
+      return leastLoaded([] (EventLoop* loop_) -> int64_t {
+        return loop_->load().pendingOutputBytes.load(std::memory_order_relaxed);
+      });
+    case PlacementPolicy::POWER_OF_TWO_CHOICES:
+      return powerOfTwoChoices();
+    case PlacementPolicy::ROUND_ROBIN:
+      break;
+  }
+
+  EventLoop* loop = _loops[_next];
+  ++_next;
+  if (static_cast<size_t>(_next) >= _loops.size())
+  {
+    _next = 0;
+  }
+  return loop;
+}
+
+EventLoop* EventLoopThreadPool::leastLoaded(int64_t (*load_)(EventLoop*))
+{
+  // Scan from the loop after the last pick: tied loops take turns
+  const size_t n = _loops.size();
+  size_t best = n;
+  int64_t bestLoad = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    const size_t index = (_next + i) % n;
+    int64_t load = load_(_loops[index]);
+    if (best == n || load < bestLoad)
     {
-      _next = 0;
+      best = index;
+      bestLoad = load;
     }
   }
+  _next = static_cast<int>((best + 1) % n);
+  return _loops[best];
+}
 
-  return loop;
+EventLoop* EventLoopThreadPool::powerOfTwoChoices()
+{
+  _random ^= _random << 13;
+  _random ^= _random >> 17;
+  _random ^= _random << 5;
+
+  // Two distinct loops
+  const size_t n = _loops.size();
+  const size_t i = _random % n;
+  const size_t j = n > 1 ? (i + 1 + (_random / n) % (n - 1)) % n : i;
+  EventLoop* first = _loops[i];
+  EventLoop* second = _loops[j];
+
+  const EventLoop::Load& a = first->load();
+  const EventLoop::Load& b = second->load();
+  int connA = a.connections.load(std::memory_order_relaxed);
+  int connB = b.connections.load(std::memory_order_relaxed);
+  if (connA != connB)
+  {
+    return connA < connB ? first : second;
+  }
+  return a.busyPermille.load(std::memory_order_relaxed) <=
+         b.busyPermille.load(std::memory_order_relaxed) ? first : second;
+}
+
+std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
+{
+  assert(_started);
+  if (_loops.empty())
+  {
+    return std::vector<EventLoop*>(1, _masterLoop);
+  }
+  return _loops;
 }
@@ -4,32 +4,110 @@
 #include "EventLoop.h"
 #include "EventLoopThread.h"
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include <util/Common.h>
+#include <log/Logging.h>
 
 namespace oplib
 {
   class EventLoopThreadPool : Noncopyable
   {
    public:
+    // Custom placement: picks one of the loops, from their load()
+    typedef std::function<EventLoop* (const std::vector<EventLoop*>&)> LoopSelector;
+
     EventLoopThreadPool(EventLoop* masterLoop_);
     ~EventLoopThreadPool();
 
     void setNumThreads(size_t nThreads_) 
     {
-      if (_started) return; // TODO log
+      if (_started)
+      {
+        LOG_WARN("EventLoopThreadPool::setNumThreads() after start(), ignored");
+        return;
+      }
       _nThreads = nThreads_; 
     }
 
+    // Thread i runs on the CPUs cpus_[i % cpus_.size()], e.g. one
+    // core each, or the cpusOfNumaNode() of each socket in turn.
+    // start() warns of the CPUs which can't be used
+    void setThreadCpus(const std::vector<std::vector<int>>& cpus_)
+    {
+      if (_started)
+      {
+        LOG_WARN("EventLoopThreadPool::setThreadCpus() after start(), ignored");
+        return;
+      }
+      _threadCpus = cpus_;
+    }
+
+    // Poller backend of the loops created by this pool
+    void setPollerType(PollerType type_)
+    {
+      if (_started)
+      {
+        LOG_WARN("EventLoopThreadPool::setPollerType() after start(), ignored");
+        return;
+      }
+      _pollerType = type_;
+    }
+
+    // Timer storage of the loops created by this pool
+    void setTimerQueueType(TimerQueueType type_)
+    {
+      if (_started)
+      {
+        LOG_WARN("EventLoopThreadPool::setTimerQueueType() after start(), ignored");
+        return;
+      }
+      _timerQueueType = type_;
+    }
+
+    // Busy polling of the loops created by this pool, or of the
+    // master loop if there are none, see EventLoop::setBusyPoll().
+    // Can be changed while running
+    void setBusyPoll(int64_t spinMicroSeconds_);
+
+    // Policy of getNextLoop(), round-robin by default
+    void setPlacementPolicy(PlacementPolicy policy_)
+    {
+      _placementPolicy = policy_;
+      _loopSelector = nullptr;
+    }
+
+    // Overrides the placement policy
+    void setLoopSelector(const LoopSelector& selector_)
+    { _loopSelector = selector_; }
+
     void start();
+    // The loop of the next connection, following the placement policy
     EventLoop* getNextLoop();
 
+    // The IO loops, or the master loop if there are none
+    std::vector<EventLoop*> getAllLoops();
+
    private:
+    EventLoop* leastLoaded(int64_t (*load_)(EventLoop*));
+    EventLoop* powerOfTwoChoices();
+    // Reports the CPUs of IO thread thread_ which Thread skipped
+    void warnAffinity(size_t thread_, const std::vector<int>& cpus_, bool pinned_);
+
     EventLoop* _masterLoop;
     bool _started;
     size_t _nThreads;
+    PollerType _pollerType;
+    TimerQueueType _timerQueueType;
+    std::vector<std::vector<int>> _threadCpus;
+    int64_t _busyPollMicroSeconds;
     int _next;
+    PlacementPolicy _placementPolicy;
+    LoopSelector _loopSelector;
+    // xorshift state of powerOfTwoChoices()
+    uint32_t _random;
     std::vector<std::shared_ptr<EventLoopThread>> _threads;
     std::vector<EventLoop*> _loops;
   };
@@ -0,0 +1,355 @@
+#include "IOUringPoller.h"
+#include "EventDispatcher.h"
+#include "EventLoop.h"
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cassert>
+
+#include <log/Logging.h>
+
+namespace oplib
+{
+  const unsigned IOUringPoller::kRingEntries = 256;
+  const int IOUringPoller::kMaxSubmitAttempts = 1000;
+
+  namespace
+  {
+    // Completions of POLL_REMOVE, nothing to do with them
+    const uint64_t kNoToken = 0;
+
+    // What a one-shot poll can watch, EPOLLET is not one of them
+    const int kPollMask = POLLIN | POLLPRI | POLLOUT | POLLRDHUP;
+
+    int ioUringSetup(unsigned entries_, struct io_uring_params* params_)
+    {
+      return static_cast<int>(::syscall(__NR_io_uring_setup, entries_, params_));
+    }
+
+    int ioUringEnter(int ringfd_, unsigned toSubmit_, unsigned minComplete_,
+                     unsigned flags_, const void* arg_, size_t argSize_)
+    {
+      return static_cast<int>(::syscall(__NR_io_uring_enter, ringfd_, toSubmit_,
+                                        minComplete_, flags_, arg_, argSize_));
+    }
+
+    void* mapRing(int ringfd_, size_t size_, off_t offset_)
+    {
+      void* ring = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ringfd_, offset_);
+      if (ring == MAP_FAILED)
+      {
+        LOG_FATAL("io_uring mmap error: %s", ::strerror(errno));
+      }
+      return ring;
+    }
+  }
+
+  bool IOUringPoller::supported()
+  {
+    static const bool ok = [] {
+      struct io_uring_params params;
+      ::memset(&params, 0, sizeof(params));
+      int ringfd = ioUringSetup(4, &params);
+      if (ringfd < 0)
+      {
+        // ENOSYS, or disabled by kernel.io_uring_disabled / seccomp
+        return false;
+      }
+      ::close(ringfd);
+      return (params.features & IORING_FEAT_EXT_ARG) != 0;
+    }();
+    return ok;
+  }
+
+  IOUringPoller::IOUringPoller(EventLoop* loop_)
+  : Poller(loop_),
+    _ringfd(-1),
+    _toSubmit(0),
+    _nextToken(kNoToken + 1)
+  {
+    setupRing();
+  }
+
+  IOUringPoller::~IOUringPoller()
+  {
+    ::munmap(_sqes, _sqesSize);
+    if (_cqRing != _sqRing)
+    {
+      ::munmap(_cqRing, _cqRingSize);
+    }
+    ::munmap(_sqRing, _sqRingSize);
+    ::close(_ringfd);
+  }
+
+  void IOUringPoller::setupRing()
+  {
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    // Only the loop thread submits, and it enters the ring every
+    // iteration: completions don't need to interrupt it (5.19+)
+    params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    _ringfd = ioUringSetup(kRingEntries, &params);
+    if (_ringfd < 0 && errno == EINVAL)
+    {
+      ::memset(&params, 0, sizeof(params));
+      _ringfd = ioUringSetup(kRingEntries, &params);
+    }
+    if (_ringfd < 0)
+    {
+      LOG_FATAL("io_uring_setup error: %s", ::strerror(errno));
+    }
+    _sqEntries = params.sq_entries;
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      // Both rings in one mapping
+      _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+    _sqRing = mapRing(_ringfd, _sqRingSize, IORING_OFF_SQ_RING);
+    _cqRing = (params.features & IORING_FEAT_SINGLE_MMAP)
+              ? _sqRing
+              : mapRing(_ringfd, _cqRingSize, IORING_OFF_CQ_RING);
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = static_cast<struct io_uring_sqe*>(mapRing(_ringfd, _sqesSize, IORING_OFF_SQES));
+
+    char* sq = static_cast<char*>(_sqRing);
+    _sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    _cqes = cq + params.cq_off.cqes;
+  }
+
+  Timestamp IOUringPoller::poll(int timeout_, EventDispatcherList *activeDispatchers_)
+  {
+    // can only be called from loop thread
+    inLoopThreadOrDie();
+
+    // Re-arm the polls which completed last time, unless the
+    // dispatcher was removed, ignored, or re-armed by an update
+    for (EventDispatcher* dispatcher : _completed)
+    {
+      Registration* reg = _registrations.find(dispatcher);
+      if (reg != nullptr && reg->token == kNoToken && reg->events != 0)
+      {
+        arm(dispatcher, reg);
+      }
+    }
+    _completed.clear();
+
+    // A fd already ready when armed may have completed meanwhile,
+    // or been reaped by nextSqe()
+    bool ready = !_reaped.empty() || *_cqHead != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    if (_toSubmit > 0u || (!ready && timeout_ != 0))
+    {
+      enter(_toSubmit, !ready, timeout_);
+    }
+    Timestamp pollReturnTime { Timestamp::now() };
+    activeDispatchers_->insert(activeDispatchers_->end(), _reaped.begin(), _reaped.end());
+    _reaped.clear();
+    reapCompletions(activeDispatchers_);
+    _completed.assign(activeDispatchers_->begin(), activeDispatchers_->end());
+    return pollReturnTime;
+  }
+
+  int IOUringPoller::enter(unsigned toSubmit_, bool wait_, int timeout_)
+  {
+    int ret = 0;
+    if (wait_)
+    {
+      struct __kernel_timespec ts;
+      struct io_uring_getevents_arg arg;
+      ::memset(&arg, 0, sizeof(arg));
+      if (timeout_ >= 0)
+      {
+        ts.tv_sec = timeout_ / 1000;
+        ts.tv_nsec = (timeout_ % 1000) * 1000 * 1000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+      }
+      ret = ioUringEnter(_ringfd, toSubmit_, 1,
+                         IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                         &arg, sizeof(arg));
+    }
+    else
+    {
+      ret = ioUringEnter(_ringfd, toSubmit_, 0, 0, nullptr, 0);
+    }
+    ++_syscalls;
+
+    if (ret >= 0)
+    {
+      // The number of entries submitted
+      _toSubmit -= std::min(static_cast<unsigned>(ret), _toSubmit);
+    }
+    else if (errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+      LOG_FATAL("io_uring_enter error: %s", ::strerror(errno));
+    }
+    return ret;
+  }
+
+  int IOUringPoller::reapCompletions(EventDispatcherList* activeDispatchers_)
+  {
+    const struct io_uring_cqe* cqes = static_cast<const struct io_uring_cqe*>(_cqes);
+    unsigned head = *_cqHead;
+    const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    int numEvents = 0;
+    for (; head != tail; ++head)
+    {
+      const struct io_uring_cqe& cqe = cqes[head & _cqMask];
+      EventDispatcher** armed = _armed.find(cqe.user_data);
+      if (cqe.user_data == kNoToken || armed == nullptr)
+      {
+        // A POLL_REMOVE, or the poll it cancelled
+        continue;
+      }
+      EventDispatcher* dispatcher = *armed;
+      _armed.erase(cqe.user_data);
+      Registration* reg = _registrations.find(dispatcher);
+      assert(reg != nullptr);
+      reg->token = kNoToken;
+
+      // The result of a poll is its revents
+      int revents = cqe.res >= 0 ? cqe.res
+                                 : (cqe.res == -EBADF ? POLLNVAL : POLLERR);
+      dispatcher->setRevents(revents);
+      activeDispatchers_->push_back(dispatcher);
+      ++numEvents;
+    }
+    __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    return numEvents;
+  }
+
+  void IOUringPoller::updateEventDispatcher(EventDispatcher* dispatcher_)
+  {
+    inLoopThreadOrDie();
+    const int events = dispatcher_->events() & kPollMask;
+    Registration* reg = _registrations.find(dispatcher_);
+    if (reg == nullptr)
+    {
+      if (events == 0)
+      {
+        // Nothing to watch, don't bother the kernel
+        return;
+      }
+      _registrations.insert(dispatcher_, Registration { dispatcher_->fd(), events, kNoToken });
+      reg = _registrations.find(dispatcher_);
+    }
+    else if (reg->events == events)
+    {
+      // Still armed, or re-armed by the next poll()
+      return;
+    }
+    else if (reg->token != kNoToken)
+    {
+      cancel(reg);
+    }
+
+    reg->events = events;
+    // Reaped by nextSqe(), it is re-armed once handed out and handled:
+    // a second completion would hand it out twice
+    if (events != 0 &&
+        std::find(_reaped.begin(), _reaped.end(), dispatcher_) == _reaped.end())
+    {
+      arm(dispatcher_, reg);
+    }
+  }
+
+  void IOUringPoller::removeEventDispatcher(EventDispatcher* dispatcher_)
+  {
+    inLoopThreadOrDie();
+    Registration* reg = _registrations.find(dispatcher_);
+    if (reg == nullptr)
+    {
+      return;
+    }
+    if (reg->token != kNoToken)
+    {
+      cancel(reg);
+    }
+    // Also skipped by the re-arm of _completed from now on
+    _registrations.erase(dispatcher_);
+    // Its completion may wait in _reaped, the dispatcher may be gone
+    // before the next poll()
+    _reaped.erase(std::remove(_reaped.begin(), _reaped.end(), dispatcher_), _reaped.end());
+  }
+
+  void IOUringPoller::arm(EventDispatcher* dispatcher_, Registration* reg_)
+  {
+    const int fd = reg_->fd;
+    const int events = reg_->events;
+    const uint64_t token = _nextToken++;
+    reg_->token = token;
+    _armed.insert(token, dispatcher_);
+
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = static_cast<uint32_t>(events);
+    sqe->user_data = token;
+  }
+
+  void IOUringPoller::cancel(Registration* reg_)
+  {
+    _armed.erase(reg_->token);
+
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = reg_->token;
+    sqe->user_data = kNoToken;
+    reg_->token = kNoToken;
+  }
+
+  struct io_uring_sqe* IOUringPoller::nextSqe()
+  {
+    const unsigned tail = *_sqTail;
+    int attempts = 0;
+    while (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) == _sqEntries)
+    {
+      // Ring full, hand the queued entries to the kernel. Taking the
+      // entry at tail before it has them would overwrite a queued one
+      if (++attempts > kMaxSubmitAttempts)
+      {
+        LOG_FATAL("io_uring submission ring still full after %d attempts", kMaxSubmitAttempts);
+      }
+      if (enter(_toSubmit, false, 0) >= 0 || (errno != EBUSY && errno != EAGAIN))
+      {
+        continue;
+      }
+      // EBUSY: the completions have no room, EAGAIN: the kernel is
+      // short of memory. Take the completions out for the next poll(),
+      // or have the overflowed ones moved into the ring
+      if (reapCompletions(&_reaped) == 0)
+      {
+        enter(0, true, 0);
+      }
+    }
+
+    unsigned index = tail & _sqMask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+    _sqArray[index] = index;
+    // Without SQPOLL the kernel only reads the entries in
+    // io_uring_enter(), the caller can fill this one afterwards
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++_toSubmit;
+    return sqe;
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef OPLIB_IOURINGPOLLER_H
+#define OPLIB_IOURINGPOLLER_H
+
+#include "Poller.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <ds/FlatHashMap.h>
+
+// Defined in <linux/io_uring.h> at global namespace
+struct io_uring_sqe;
+
+namespace oplib
+{
+  // io_uring(7) backend, on the raw syscalls: no liburing needed.
+  // Every watched fd has a one-shot IORING_OP_POLL_ADD in flight, its
+  // completion carries the ready events like poll(2) revents. The polls
+  // of the dispatchers handled in an iteration are re-armed, and the
+  // changes of interest submitted, by the io_uring_enter() which waits
+  // for the next completions: one syscall per iteration, where epoll
+  // needs epoll_wait() plus an epoll_ctl() per change. One-shot polls
+  // are level-triggered, a fd still ready when re-armed completes at
+  // once, so edge-triggered connections are not supported.
+  class IOUringPoller : public Poller
+  {
+   public:
+    IOUringPoller(EventLoop* loop_);
+    ~IOUringPoller() override;
+
+    void updateEventDispatcher(EventDispatcher* dispatcher_) override;
+    void removeEventDispatcher(EventDispatcher* dispatcher_) override;
+
+    Timestamp poll(int timeout_, EventDispatcherList *activeDispatchers_) override;
+
+    // Whether the kernel has what this backend needs (io_uring
+    // enabled, IORING_FEAT_EXT_ARG for the timeout), checked once
+    static bool supported();
+
+   private:
+    // The poll in flight for a dispatcher, if any
+    struct Registration
+    {
+      int fd;
+      int events;
+      // 0: not armed
+      uint64_t token;
+    };
+
+    void setupRing();
+    // Queue a POLL_ADD for dispatcher_, or a POLL_REMOVE of its poll
+    void arm(EventDispatcher* dispatcher_, Registration* reg_);
+    void cancel(Registration* reg_);
+    // A free submission entry. If the ring is full, submits the queued
+    // ones, emptying the completion ring into _reaped if they don't fit
+    struct io_uring_sqe* nextSqe();
+    // Submit the queued entries, wait for completions if wait_
+    int enter(unsigned toSubmit_, bool wait_, int timeout_);
+    // Completions into activeDispatchers_, returns how many
+    int reapCompletions(EventDispatcherList* activeDispatchers_);
+
+    static const unsigned kRingEntries;
+    // io_uring_enter() calls nextSqe() may make for one free entry
+    static const int kMaxSubmitAttempts;
+
+    int _ringfd;
+    unsigned _sqEntries;
+
+    // The mmapped rings, see io_uring_setup(2)
+    void* _sqRing;
+    size_t _sqRingSize;
+    void* _cqRing;
+    size_t _cqRingSize;
+    struct io_uring_sqe* _sqes;
+    size_t _sqesSize;
+
+    unsigned* _sqHead;
+    unsigned* _sqTail;
+    unsigned _sqMask;
+    unsigned* _sqArray;
+    unsigned* _cqHead;
+    unsigned* _cqTail;
+    unsigned _cqMask;
+    void* _cqes;
+
+    // Queued, not submitted yet
+    unsigned _toSubmit;
+    uint64_t _nextToken;
+    ds::FlatHashMap<EventDispatcher*, Registration> _registrations;
+    // Polls in flight: a completion whose token is not here belongs
+    // to a cancelled poll, its dispatcher may be gone
+    ds::FlatHashMap<uint64_t, EventDispatcher*> _armed;
+    // Handled by the last iteration, to be re-armed
+    std::vector<EventDispatcher*> _completed;
+    // Completions reaped by nextSqe(), handed out by the next poll()
+    std::vector<EventDispatcher*> _reaped;
+  };
+}
+
+#endif
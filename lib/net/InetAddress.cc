@@ -1,11 +1,13 @@
 #include "InetAddress.h"
 #include "SocketUtils.h"
+#include <string.h>
 #include <strings.h>
 #include <assert.h>
 #include <netdb.h>
 #include <sys/socket.h>
 
 #include <util/Common.h>
+#include <log/Logging.h>
 
 using namespace oplib;
 
@@ -77,7 +79,7 @@ bool InetAddress::resolve(const std::string& host_, InetAddress* result_)
   {
     if (ret)
     {
-      // TODO error log
+      LOG_ERROR("gethostbyname_r %s error: %s", host_.c_str(), ::strerror(ret));
       assert(false);
     }
     return false;
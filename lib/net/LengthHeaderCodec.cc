@@ -0,0 +1,186 @@
+#include "LengthHeaderCodec.h"
+
+#include <log/Logging.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+using namespace oplib;
+
+const size_t LengthHeaderCodec::defaultMaxFrameSize = 64 * 1024 * 1024;
+
+LengthHeaderCodec::LengthHeaderCodec(LengthHeader header_,
+                                     const FrameCallback& cb_,
+                                     size_t maxFrameSize_)
+: _header(header_),
+  // A 16 or 32 bits header can't announce more
+  _maxFrameSize(header_ == LengthHeader::UINT16 ? std::min<size_t>(maxFrameSize_, 0xFFFF) :
+                header_ == LengthHeader::UINT32 ? std::min<size_t>(maxFrameSize_, 0xFFFFFFFF) :
+                                                  maxFrameSize_),
+  _frameCallback(cb_)
+{
+}
+
+int LengthHeaderCodec::encodeHeader(uint64_t len_, char* header_) const
+{
+  unsigned char* out = reinterpret_cast<unsigned char*>(header_);
+  switch (_header)
+  {
+    case LengthHeader::UINT16:
+      assert(len_ <= 0xFFFF);
+      out[0] = static_cast<unsigned char>(len_ >> 8);
+      out[1] = static_cast<unsigned char>(len_);
+      return 2;
+    case LengthHeader::UINT32:
+      assert(len_ <= 0xFFFFFFFF);
+      out[0] = static_cast<unsigned char>(len_ >> 24);
+      out[1] = static_cast<unsigned char>(len_ >> 16);
+      out[2] = static_cast<unsigned char>(len_ >> 8);
+      out[3] = static_cast<unsigned char>(len_);
+      return 4;
+    case LengthHeader::VARINT:
+      break;
+  }
+
+  int n = 0;
+  while (len_ >= 0x80)
+  {
+    out[n++] = static_cast<unsigned char>(len_ | 0x80);
+    len_ >>= 7;
+  }
+  out[n++] = static_cast<unsigned char>(len_);
+  return n;
+}
+
+int LengthHeaderCodec::decodeHeader(const char* data_, size_t available_, uint64_t* len_) const
+{
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(data_);
+  switch (_header)
+  {
+    case LengthHeader::UINT16:
+      if (available_ < 2)
+      {
+        return 0;
+      }
+      *len_ = (uint64_t(in[0]) << 8) | in[1];
+      return 2;
+    case LengthHeader::UINT32:
+      if (available_ < 4)
+      {
+        return 0;
+      }
+      *len_ = (uint64_t(in[0]) << 24) | (uint64_t(in[1]) << 16) |
+              (uint64_t(in[2]) << 8) | in[3];
+      return 4;
+    case LengthHeader::VARINT:
+      break;
+  }
+
+  uint64_t len = 0;
+  for (int i = 0; i < kMaxHeaderBytes; ++i)
+  {
+    if (static_cast<size_t>(i) == available_)
+    {
+      return 0;
+    }
+    len |= uint64_t(in[i] & 0x7F) << (7 * i);
+    if ((in[i] & 0x80) == 0)
+    {
+      *len_ = len;
+      return i + 1;
+    }
+  }
+  // Too many continuation bytes
+  return -1;
+}
+
+void LengthHeaderCodec::onMessage(const TCPConnectionPtr& conn_,
+                                  ds::Buffer* buf_,
+                                  Timestamp receiveTime_)
+{
+  const char* data = buf_->peek();
+  const size_t readable = buf_->readableBytes();
+  size_t consumed = 0;
+
+  while (consumed < readable)
+  {
+    uint64_t len = 0;
+    int headerBytes = decodeHeader(data + consumed, readable - consumed, &len);
+    if (headerBytes < 0 || len > _maxFrameSize)
+    {
+      if (_errorCallback)
+      {
+        _errorCallback(conn_, len);
+      }
+      else
+      {
+        LOG_WARN("LengthHeaderCodec: invalid frame length %lu from %s",
+                 static_cast<unsigned long>(len), conn_->name().c_str());
+      }
+      buf_->retrieveAll();
+      conn_->shutdown();
+      return;
+    }
+    if (headerBytes == 0 || readable - consumed - headerBytes < len)
+    {
+      // Partial frame, wait for the rest
+      break;
+    }
+
+    Slice frame(data + consumed + headerBytes, static_cast<size_t>(len));
+    consumed += headerBytes + static_cast<size_t>(len);
+    _frameCallback(conn_, frame, receiveTime_);
+  }
+
+  buf_->retrieve(consumed);
+}
+
+bool LengthHeaderCodec::send(const TCPConnectionPtr& conn_, ds::Buffer* message_) const
+{
+  if (!fits(conn_, message_->readableBytes()))
+  {
+    return false;
+  }
+  char header[kMaxHeaderBytes];
+  int headerBytes = encodeHeader(message_->readableBytes(), header);
+  if (message_->prependableBytes() < static_cast<size_t>(headerBytes))
+  {
+    // Buffer built without room for this header
+    send(conn_, message_->peek(), message_->readableBytes());
+    message_->retrieveAll();
+    return true;
+  }
+  message_->prepend(header, headerBytes);
+  conn_->send(message_);
+  return true;
+}
+
+bool LengthHeaderCodec::send(const TCPConnectionPtr& conn_, const char* data_, size_t len_) const
+{
+  if (!fits(conn_, len_))
+  {
+    return false;
+  }
+  char header[kMaxHeaderBytes];
+  int headerBytes = encodeHeader(len_, header);
+  SliceList slices;
+  slices.reserve(2);
+  slices.emplace_back(header, headerBytes);
+  slices.emplace_back(data_, len_);
+  conn_->send(std::move(slices));
+  return true;
+}
+
+bool LengthHeaderCodec::fits(const TCPConnectionPtr& conn_, size_t len_) const
+{
+  if (len_ > _maxFrameSize)
+  {
+    // The peer would reject it, or the header would be truncated
+    LOG_ERROR("LengthHeaderCodec: frame of %zu bytes to %s over the maximum of %zu, not sent",
+              len_, conn_->name().c_str(), _maxFrameSize);
+    return false;
+  }
+  return true;
+}
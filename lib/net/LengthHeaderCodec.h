@@ -0,0 +1,89 @@
+#ifndef OPLIB_LENGTHHEADERCODEC_H
+#define OPLIB_LENGTHHEADERCODEC_H
+
+#include "Types.h"
+#include "Slice.h"
+#include "TCPConnection.h"
+
+#include <stdint.h>
+
+#include <functional>
+
+#include <ds/Buffer.h>
+#include <util/Common.h>
+#include <util/Timestamp.h>
+
+namespace oplib
+{
+  // Length of a frame, in front of its payload: a big-endian
+  // integer of 2 or 4 bytes, or a varint (LEB128: 7 bits per
+  // byte, least significant group first, up to 10 bytes)
+  enum class LengthHeader { UINT16, UINT32, VARINT };
+
+  // Framing stage between a connection and the application: set
+  // onMessage() as the MessageCallback, the FrameCallback gets the
+  // payloads. Frames are parsed in place, every complete frame of a
+  // read is delivered before the buffer is touched, then they are all
+  // retrieved at once. No state per connection: one codec can serve
+  // all the connections of a server.
+  class LengthHeaderCodec : Noncopyable
+  {
+   public:
+    // frame_ views the payload inside the input buffer: only valid
+    // until the callback returns, copy it to keep it
+    typedef std::function<void (const TCPConnectionPtr&, const Slice& frame_, Timestamp)> FrameCallback;
+    // Invalid header or a frame over the maximum size,
+    // the connection is shut down afterwards
+    typedef std::function<void (const TCPConnectionPtr&, uint64_t length_)> ErrorCallback;
+
+    static const size_t defaultMaxFrameSize;
+    static const int kMaxHeaderBytes = 10;
+
+    LengthHeaderCodec(LengthHeader header_,
+                      const FrameCallback& cb_,
+                      size_t maxFrameSize_ = defaultMaxFrameSize);
+
+    void setErrorCallback(const ErrorCallback& cb_)
+    { _errorCallback = cb_; }
+
+    // MessageCallback of the connections
+    void onMessage(const TCPConnectionPtr& conn_, ds::Buffer* buf_, Timestamp receiveTime_);
+
+    // Send the readable bytes of message_ as one frame: the header
+    // goes into message_'s prependable space (Buffer::prependSize is
+    // enough below 2^56 bytes of varint), the frame is sent from the
+    // buffer as is. message_ is drained. A payload over maxFrameSize()
+    // is not sent, and left in message_: returns false
+    bool send(const TCPConnectionPtr& conn_, ds::Buffer* message_) const;
+
+    // Header and payload in one writev, the payload is not copied
+    // unless it can't be written right away. False, nothing sent,
+    // for a payload over maxFrameSize()
+    bool send(const TCPConnectionPtr& conn_, const char* data_, size_t len_) const;
+
+    // Write the header of a len_ bytes payload, returns its size.
+    // len_ must fit the header: at most maxFrameSize()
+    int encodeHeader(uint64_t len_, char* header_) const;
+
+    // Parse the header at the front of data_: returns its size and the
+    // payload length in *len_, 0 if more bytes are needed, -1 if invalid
+    int decodeHeader(const char* data_, size_t available_, uint64_t* len_) const;
+
+    LengthHeader header() const { return _header; }
+
+    // Largest payload sent or accepted: the one given to the
+    // constructor, at most what the fixed-size headers can announce
+    size_t maxFrameSize() const { return _maxFrameSize; }
+
+   private:
+    // len_ is at most _maxFrameSize, logs an error otherwise
+    bool fits(const TCPConnectionPtr& conn_, size_t len_) const;
+
+    const LengthHeader _header;
+    const size_t _maxFrameSize;
+    FrameCallback _frameCallback;
+    ErrorCallback _errorCallback;
+  };
+}
+
+#endif
@@ -3,22 +3,40 @@
 #include "SocketUtils.h"
 #include "EventLoop.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace oplib
 {
-  Listener::Listener(EventLoop* loop_, const InetAddress& listenAddr_)
+  Listener::Listener(EventLoop* loop_, const InetAddress& listenAddr_, bool reusePort_)
   : _loop(loop_), _listening(false), _listenSock(socketutils::createOrDie()),
-    _dispatcher(_loop, _listenSock.fd())
+    _dispatcher(_loop, _listenSock.fd()),
+    _idleFd(::open("/dev/null", O_RDONLY | O_CLOEXEC))
   {
     // Reuse the address when closed
     _listenSock.setReuseAddr(true);
+    if (reusePort_)
+    {
+      _listenSock.setReusePort(true);
+    }
 
     // Bind the socket to listenAddr_
     _listenSock.bindAddress(listenAddr_);
 
     // ListenSocket fd is readable, call handleRead
+    _dispatcher.setType(DispatcherType::LISTENER);
     _dispatcher.setReadCallback(std::bind(&Listener::handleRead, this));
   }
 
+  Listener::~Listener()
+  {
+    if (_idleFd >= 0)
+    {
+      ::close(_idleFd);
+    }
+  }
+
   void Listener::listen()
   {
     // Manipulate EventLoop data structure(loop->poller->pollfds)
@@ -31,18 +49,73 @@ namespace oplib
   void Listener::handleRead()
   {
     _loop->inLoopThreadOrDie();
-    InetAddress peer(0);
 
-    // Make use of Socket's destructor to guarantee resource release (RAII)
-    auto peerSock = std::make_unique<Socket>(_listenSock.accept(&peer));
-    if (peerSock->fd() >= 0)
+    int batch = 0;
+    for (int i = 0; i < kMaxAcceptsPerWakeup; ++i)
     {
+      InetAddress peer(0);
+      int connfd = _listenSock.accept(&peer);
+      if (connfd < 0)
+      {
+        if ((errno == EMFILE || errno == ENFILE) && rejectConnection())
+        {
+          continue;
+        }
+        // EAGAIN: the backlog is drained
+        break;
+      }
+
+      ++batch;
+      // Make use of Socket's destructor to guarantee resource release (RAII)
+      auto peerSock = std::make_unique<Socket>(connfd);
       if (_newConnectionCb)
       {
         _newConnectionCb(std::move(peerSock), peer);
       }
+      // As the connfd is managed by unique_ptr, we don't need 
+      // to release it manually
+    }
+
+    _wakeups.add(1);
+    _accepted.add(batch);
+    int bucket = 0;
+    while (batch > 0 && bucket < AcceptStats::kBatchBuckets - 1)
+    {
+      batch >>= 1;
+      ++bucket;
+    }
+    _batches[bucket].add(1);
+  }
+
+  AcceptStats Listener::acceptStats() const
+  {
+    AcceptStats stats;
+    stats.wakeups = _wakeups.value();
+    stats.accepted = _accepted.value();
+    stats.rejected = _rejected.value();
+    for (int i = 0; i < AcceptStats::kBatchBuckets; ++i)
+    {
+      stats.batches[i] = _batches[i].value();
+    }
+    return stats;
+  }
+
+  bool Listener::rejectConnection()
+  {
+    if (_idleFd < 0)
+    {
+      // The reserve was lost to another thread last time
+      _idleFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+      return false;
+    }
+    ::close(_idleFd);
+    int connfd = ::accept(_listenSock.fd(), nullptr, nullptr);
+    if (connfd >= 0)
+    {
+      ::close(connfd);
+      _rejected.add(1);
     }
-    // As the connfd is managed by unique_ptr, we don't need 
-    // to release it manually
+    _idleFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return connfd >= 0;
   }
 }
@@ -5,6 +5,7 @@
 #include "Socket.h"
 #include "EventDispatcher.h"
 #include "Types.h"
+#include "LoopMetrics.h"
 
 #include <memory>
 
@@ -16,7 +17,14 @@ namespace oplib
   {
    public:
 
-    Listener(EventLoop* loop_, const InetAddress& listenAddr_);
+    // With reusePort_ several listeners (one per loop) can bind
+    // listenAddr_, the kernel spreads the connections among them
+    Listener(EventLoop* loop_, const InetAddress& listenAddr_, bool reusePort_ = false);
+    ~Listener();
+
+    // Connections accepted by one wakeup at most, the rest
+    // waits for the next poll so the loop serves its other fds
+    static const int kMaxAcceptsPerWakeup = 64;
 
     void setNewConnectionCallback(const NewConnectionCallback& cb_)
     { _newConnectionCb = cb_; }
@@ -26,15 +34,30 @@ namespace oplib
 
     void listen();
 
+    // Any thread: counted by the loop thread alone, read relaxed,
+    // the fields may be a few accepts apart while it runs
+    AcceptStats acceptStats() const;
+
    private:
 
     void handleRead();
 
+    // Out of fds: the pending connection stays in the backlog and
+    // the listening fd keeps polling readable. Give the reserved fd
+    // up to accept it and close it, then reserve a new one.
+    // Returns false if nothing could be rejected
+    bool rejectConnection();
+
     EventLoop* _loop;
     bool _listening;
     NewConnectionCallback _newConnectionCb;
     Socket _listenSock;
     EventDispatcher _dispatcher;
+    int _idleFd;
+    Counter _wakeups;
+    Counter _accepted;
+    Counter _rejected;
+    Counter _batches[AcceptStats::kBatchBuckets];
   };
 }
 
@@ -0,0 +1,81 @@
+#include "LoopMetrics.h"
+
+namespace oplib
+{
+  int Histogram::bucketOf(uint64_t value_)
+  {
+    if (value_ == 0)
+    {
+      return 0;
+    }
+    // 1 + index of the highest bit set
+    int bucket = 64 - __builtin_clzll(value_);
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+  }
+
+  void Histogram::record(uint64_t value_)
+  {
+    _buckets[bucketOf(value_)].add(1);
+    _sum.add(value_);
+    if (value_ > _max.load(std::memory_order_relaxed))
+    {
+      _max.store(value_, std::memory_order_relaxed);
+    }
+  }
+
+  Histogram::Snapshot Histogram::snapshot() const
+  {
+    Snapshot snap;
+    snap.count = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      snap.buckets[i] = _buckets[i].value();
+      // The count of the buckets read, consistent with them
+      snap.count += snap.buckets[i];
+    }
+    snap.sum = _sum.value();
+    snap.max = _max.load(std::memory_order_relaxed);
+    return snap;
+  }
+
+  uint64_t Histogram::Snapshot::percentile(double p_) const
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p_ * count);
+    if (rank >= count)
+    {
+      rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      seen += buckets[i];
+      if (seen > rank)
+      {
+        // Highest value of bucket i, the max if it is lower
+        uint64_t upper = i + 1 < kBuckets ? bucketFloor(i + 1) - 1 : max;
+        return upper < max ? upper : max;
+      }
+    }
+    return max;
+  }
+
+  LoopMetrics::Snapshot LoopMetrics::snapshot() const
+  {
+    Snapshot snap;
+    snap.iteration = iteration.snapshot();
+    snap.pollWait = pollWait.snapshot();
+    for (int i = 0; i < kDispatcherTypes; ++i)
+    {
+      snap.callback[i] = callback[i].snapshot();
+    }
+    snap.pendingFunctors = pendingFunctors.snapshot();
+    snap.timerLateness = timerLateness.snapshot();
+    snap.timerfdArms = timerfdArms.value();
+    snap.io = io.snapshot();
+    return snap;
+  }
+}
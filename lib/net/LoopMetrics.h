@@ -0,0 +1,125 @@
+#ifndef OPLIB_LOOPMETRICS_H
+#define OPLIB_LOOPMETRICS_H
+
+#include "Types.h"
+
+#include <stdint.h>
+#include <atomic>
+
+namespace oplib
+{
+  // Written by one thread only (the loop thread), read by any: the
+  // writer updates with plain relaxed load/store, no locked
+  // instruction on the hot path, and readers never block it
+  class Counter
+  {
+   public:
+    void add(uint64_t n_)
+    { _value.store(_value.load(std::memory_order_relaxed) + n_, std::memory_order_relaxed); }
+
+    uint64_t value() const
+    { return _value.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<uint64_t> _value { 0 };
+  };
+
+  // Distribution of a value with power-of-two buckets: 0, 1, 2-3,
+  // 4-7, ... , the last bucket takes everything above. Single writer
+  // like Counter
+  class Histogram
+  {
+   public:
+    static const int kBuckets = 32;
+
+    struct Snapshot
+    {
+      uint64_t count;
+      uint64_t sum;
+      uint64_t max;
+      uint64_t buckets[kBuckets];
+
+      double mean() const
+      { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+      // Upper bound of the bucket holding the p_ quantile (0 to 1),
+      // within a factor of two of the actual value
+      uint64_t percentile(double p_) const;
+    };
+
+    void record(uint64_t value_);
+    // Not atomic as a whole: a snapshot taken while the loop runs can
+    // be off by the records in flight, the fields are never torn
+    Snapshot snapshot() const;
+
+    // Lowest value of bucket_
+    static uint64_t bucketFloor(int bucket_)
+    { return bucket_ == 0 ? 0 : uint64_t(1) << (bucket_ - 1); }
+
+   private:
+    static int bucketOf(uint64_t value_);
+
+    Counter _sum;
+    std::atomic<uint64_t> _max { 0 };
+    Counter _buckets[kBuckets];
+  };
+
+  // Socket IO of a connection, or of all the connections of a loop
+  struct IOCounters
+  {
+    struct Snapshot
+    {
+      uint64_t bytesRead;
+      uint64_t bytesWritten;
+      // Syscalls, the ones returning EAGAIN included
+      uint64_t readCalls;
+      uint64_t writeCalls;
+    };
+
+    Snapshot snapshot() const
+    {
+      return Snapshot { bytesRead.value(), bytesWritten.value(),
+                        readCalls.value(), writeCalls.value() };
+    }
+
+    Counter bytesRead;
+    Counter bytesWritten;
+    Counter readCalls;
+    Counter writeCalls;
+  };
+
+  // What an EventLoop did since it started, kept by the loop thread,
+  // see EventLoop::metrics(). Times in microseconds
+  struct LoopMetrics
+  {
+    static const int kDispatcherTypes = static_cast<int>(DispatcherType::OTHER) + 1;
+
+    struct Snapshot
+    {
+      // From entering the poller to the end of the iteration
+      Histogram::Snapshot iteration;
+      // In the poller, blocked or not
+      Histogram::Snapshot pollWait;
+      // handleEvent() of the active dispatchers, by DispatcherType
+      Histogram::Snapshot callback[kDispatcherTypes];
+      // Functors queued by other threads, per iteration which ran some
+      Histogram::Snapshot pendingFunctors;
+      // How long after their expiration the timers ran
+      Histogram::Snapshot timerLateness;
+      // timerfd_settime() calls
+      uint64_t timerfdArms;
+      IOCounters::Snapshot io;
+    };
+
+    Snapshot snapshot() const;
+
+    Histogram iteration;
+    Histogram pollWait;
+    Histogram callback[kDispatcherTypes];
+    Histogram pendingFunctors;
+    Histogram timerLateness;
+    Counter timerfdArms;
+    IOCounters io;
+  };
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "PollPoller.h"
+#include "EventDispatcher.h"
+#include "EventLoop.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <cassert>
+
+#include <log/Logging.h>
+
+namespace oplib
+{
+  PollPoller::PollPoller(EventLoop* loop_)
+  : Poller(loop_)
+  {}
+
+  PollPoller::~PollPoller()
+  {}
+
+  Timestamp PollPoller::poll(int timeout_, EventDispatcherList *activeDispatchers_)
+  {
+    // can only be called from loop thread
+    inLoopThreadOrDie();
+    
+    struct pollfd* begin = _pollfds.data();
+    int numEvents = ::poll(begin, _pollfds.size(), timeout_);
+    ++_syscalls;
+    Timestamp pollReturnTime { Timestamp::now() };
+    if (numEvents > 0)
+    {
+      fillDispatchers(numEvents, activeDispatchers_);
+    }
+    else if (numEvents < 0)
+    {
+      LOG_FATAL("poll error: %s", ::strerror(errno));
+    }
+    return pollReturnTime;
+  }
+
+  void PollPoller::fillDispatchers(int activeEventCnt_, EventDispatcherList* list_) const
+  {
+    // We cannot handleEvent here, because that
+    // may insert into the _pollfds while we iterate
+    for (auto iter = _pollfds.begin();
+         iter != _pollfds.end() && activeEventCnt_ > 0;
+         ++iter)
+    {
+      if (iter->revents != 0)
+      {
+        auto dpiter = _dispatchers.find(iter->fd); 
+        dpiter->second->setRevents(iter->revents);
+        list_->push_back(dpiter->second);
+        --activeEventCnt_;
+      }
+    }
+  }
+
+  void PollPoller::updateEventDispatcher(EventDispatcher* dispatcher_)
+  {
+    // Update the eventDispatcher in _dispatchers
+    // especially the events they are interested in
+    if (dispatcher_->index() < 0)
+    {
+      // A new dispatcher
+      struct pollfd pfd;
+      pfd.fd = dispatcher_->fd();
+      pfd.events = static_cast<short>(dispatcher_->events());
+      pfd.revents = 0;
+      _pollfds.push_back(pfd);
+      dispatcher_->setIndex(static_cast<int>(_pollfds.size()) - 1);
+      _dispatchers[pfd.fd] = dispatcher_;
+    }
+    else
+    {
+      int index = dispatcher_->index();
+      assert(0 <= index && index < static_cast<int>(_pollfds.size()));
+      struct pollfd& pfd = _pollfds[index];
+      assert(pfd.fd == dispatcher_->fd() || pfd.fd == -dispatcher_->fd() - 1);
+      pfd.events = static_cast<short>(dispatcher_->events());
+      pfd.revents = 0;
+      // Ignored fds are skipped by poll(2) until watched again
+      pfd.fd = dispatcher_->isIgnored() ? -dispatcher_->fd() - 1
+                                        : dispatcher_->fd();
+    }
+  }
+
+  void PollPoller::removeEventDispatcher(EventDispatcher* dispatcher_)
+  {
+    // Update the eventDispatcher in _dispatchers
+    // especially the events they are interested in
+    if (dispatcher_->index() < 0)
+    {
+      LOG_FATAL("PollPoller: fd %d removed but never added", dispatcher_->fd());
+    }
+    else
+    {
+      assert(_dispatchers.find(dispatcher_->fd()) != _dispatchers.end());
+      assert(_dispatchers[dispatcher_->fd()] == dispatcher_);
+      int index = dispatcher_->index();
+      auto n = _dispatchers.erase(dispatcher_->fd());
+      assert(n == 1);
+      UNUSED(n);
+      if (implicit_cast<size_t>(index) == _pollfds.size() - 1)
+      {
+        _pollfds.pop_back();
+      }
+      else
+      {
+        int endDispatcherFd = _pollfds.back().fd;
+        std::iter_swap(_pollfds.begin() + index, _pollfds.end() - 1);
+        if (endDispatcherFd < 0)
+        {
+          endDispatcherFd = -endDispatcherFd - 1;
+        }
+        _dispatchers[endDispatcherFd]->setIndex(index);
+        _pollfds.pop_back();
+      }
+    }
+  }
+}
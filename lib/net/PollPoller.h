@@ -0,0 +1,41 @@
+#ifndef OPLIB_POLLPOLLER_H
+#define OPLIB_POLLPOLLER_H
+
+#include "Poller.h"
+
+#include <vector>
+#include <map>
+
+// This structure is defined in <poll.h>
+// at global namespace
+struct pollfd;
+
+namespace oplib
+{
+  // poll(2) backend: every wakeup scans all the registered fds
+  class PollPoller : public Poller
+  {
+   public:
+    PollPoller(EventLoop* loop_);
+    ~PollPoller() override;
+
+    void updateEventDispatcher(EventDispatcher* dispatcher_) override;
+    void removeEventDispatcher(EventDispatcher* dispatcher_) override;
+
+    Timestamp poll(int timeout_, EventDispatcherList *activeDispatchers_) override;
+
+   private:
+    void fillDispatchers(int activeEventCnt_, EventDispatcherList* list_) const;
+
+    // Saved pollfds for polling
+    using PollfdList = std::vector<struct pollfd>;
+
+    // fd -> EventDispatcher
+    using EventDispatcherMap = std::map<int, EventDispatcher*>;
+
+    PollfdList _pollfds;
+    EventDispatcherMap _dispatchers;
+  };
+}
+
+#endif
@@ -1,20 +1,19 @@
 #include "Poller.h"
-#include "EventDispatcher.h"
+#include "PollPoller.h"
+#include "EPollPoller.h"
+#include "IOUringPoller.h"
 #include "EventLoop.h"
 
-#include <poll.h>
-#include <stdlib.h>
-#include <algorithm>
-#include <cassert>
-#include <cstdio>
+#include <log/Logging.h>
 
 namespace oplib
 {
   Poller::Poller(EventLoop* loop_)
-  : _loop(loop_)
-  {} 
+  : _syscalls(0),
+    _loop(loop_)
+  {}
 
-  Poller::~Poller() 
+  Poller::~Poller()
   {}
 
   void Poller::inLoopThreadOrDie()
@@ -22,106 +21,27 @@ namespace oplib
     _loop->inLoopThreadOrDie();
   }
 
-  Timestamp Poller::poll(int timeout_, EventDispatcherList *activeDispatchers_)
+  PollerType Poller::available(PollerType type_)
   {
-    // can only be called from loop thread
-    inLoopThreadOrDie();
-    
-    struct pollfd* begin = _pollfds.data();
-    int numEvents = ::poll(begin, _pollfds.size(), timeout_);
-    Timestamp pollReturnTime { Timestamp::now() };
-    if (numEvents > 0)
-    {
-      fillDispatchers(numEvents, activeDispatchers_);
-    }
-    else if (numEvents < 0)
+    if (type_ == PollerType::IO_URING && !IOUringPoller::supported())
     {
-      // Error Happened, TODO: use error log instead
-      abort();
+      LOG_WARN("io_uring is not available, using epoll");
+      return PollerType::EPOLL;
     }
-    return pollReturnTime;
+    return type_;
   }
 
-  void Poller::fillDispatchers(int activeEventCnt_, EventDispatcherList* list_) const
+  std::unique_ptr<Poller> Poller::newPoller(EventLoop* loop_, PollerType type_)
   {
-    // We cannot handleEvent here, because that
-    // may insert into the _pollfds while we iterate
-    for (auto iter = _pollfds.begin();
-         iter != _pollfds.end() && activeEventCnt_ > 0;
-         ++iter)
-    {
-      if (iter->revents != 0)
-      {
-        auto dpiter = _dispatchers.find(iter->fd); 
-        dpiter->second->setRevents(iter->revents);
-        list_->push_back(dpiter->second);
-        --activeEventCnt_;
-      }
-    }
-  }
-
-  void Poller::updateEventDispatcher(EventDispatcher* dispatcher_)
-  {
-    // Update the eventDispatcher in _dispatchers
-    // especially the events they are interested in
-    if (dispatcher_->index() < 0)
-    {
-      // A new dispatcher
-      struct pollfd pfd;
-      pfd.fd = dispatcher_->fd();
-      pfd.events = static_cast<short>(dispatcher_->events());
-      pfd.revents = 0;
-      _pollfds.push_back(pfd);
-      dispatcher_->setIndex(static_cast<int>(_pollfds.size()) - 1);
-      _dispatchers[pfd.fd] = dispatcher_;
-    }
-    else
-    {
-      int index = dispatcher_->index();
-      assert(0 <= index && index < static_cast<int>(_pollfds.size()));
-      struct pollfd& pfd = _pollfds[index];
-      assert(pfd.fd == dispatcher_->fd() || pfd.fd == -dispatcher_->fd() - 1);
-      pfd.events = static_cast<short>(dispatcher_->events());
-      pfd.revents = 0;
-      if (dispatcher_->isIgnored())
-      {
-        pfd.fd = -dispatcher_->fd() - 1;
-      }
-    }
-  }
-
-  void Poller::removeEventDispatcher(EventDispatcher* dispatcher_)
-  {
-    // Update the eventDispatcher in _dispatchers
-    // especially the events they are interested in
-    if (dispatcher_->index() < 0)
-    {
-      // TODO log error
-      abort();
-    }
-    else
+    switch (available(type_))
     {
-      assert(_dispatchers.find(dispatcher_->fd()) != _dispatchers.end());
-      assert(_dispatchers[dispatcher_->fd()] == dispatcher_);
-      int index = dispatcher_->index();
-      auto n = _dispatchers.erase(dispatcher_->fd());
-      assert(n == 1);
-      UNUSED(n);
-      if (implicit_cast<size_t>(index) == _pollfds.size() - 1)
-      {
-        _pollfds.pop_back();
-      }
-      else
-      {
-        int endDispatcherFd = _pollfds.back().fd;
-        std::iter_swap(_pollfds.begin() + index, _pollfds.end() - 1);
-        if (endDispatcherFd < 0)
-        {
-          endDispatcherFd = -endDispatcherFd - 1;
-        }
-        _dispatchers[endDispatcherFd]->setIndex(index);
-        _pollfds.pop_back();
-      }
+      case PollerType::IO_URING:
+        return std::make_unique<IOUringPoller>(loop_);
+      case PollerType::EPOLL:
+        return std::make_unique<EPollPoller>(loop_);
+      case PollerType::POLL:
+      default:
+        return std::make_unique<PollPoller>(loop_);
     }
   }
 }
@@ -1,47 +1,52 @@
 #ifndef OPLIB_POLLER_H
 #define OPLIB_POLLER_H
 
+#include "Types.h"
+
 #include <util/Timestamp.h>
 #include <util/Common.h>
 
-#include <vector>
-#include <map>
+#include <stdint.h>
 
-// This structure is defined in <poll.h>
-// at global namespace
-struct pollfd;
+#include <memory>
+#include <vector>
 
 namespace oplib
 {
   class EventDispatcher;
   class EventLoop;
 
+  // IO multiplexing interface, every EventLoop owns exactly one
+  // Poller, the backend is chosen when the loop is created
   class Poller : Noncopyable
   {
-   public: 
+   public:
     using EventDispatcherList = std::vector<EventDispatcher*>;
     Poller(EventLoop* loop_);
-    ~Poller();
+    virtual ~Poller();
 
-    void updateEventDispatcher(EventDispatcher* dispatcher_);
-    void removeEventDispatcher(EventDispatcher* dispatcher_);
+    virtual void updateEventDispatcher(EventDispatcher* dispatcher_) = 0;
+    virtual void removeEventDispatcher(EventDispatcher* dispatcher_) = 0;
+
+    // Wait at most timeout_ milliseconds, fill activeDispatchers_
+    // with the dispatchers that have events to handle
+    virtual Timestamp poll(int timeout_, EventDispatcherList *activeDispatchers_) = 0;
 
     void inLoopThreadOrDie();
 
-    Timestamp poll(int timeout_, EventDispatcherList *activeDispatchers_);
+    // Syscalls made by poll() and the updates, e.g. to compare the
+    // backends' cost per request. Loop thread only
+    uint64_t syscalls() const { return _syscalls; }
 
-   private:
-    void fillDispatchers(int activeEventCnt_, EventDispatcherList* list_) const;
-    
-    // Saved pollfds for polling 
-    using PollfdList = std::vector<struct pollfd>;
+    // The backend a loop asking for type_ gets
+    static PollerType available(PollerType type_);
+    static std::unique_ptr<Poller> newPoller(EventLoop* loop_, PollerType type_);
 
-    // fd -> EventDispatcher
-    using EventDispatcherMap = std::map<int, EventDispatcher*>;
+   protected:
+    uint64_t _syscalls;
 
+   private:
     EventLoop* _loop;
-    PollfdList _pollfds;
-    EventDispatcherMap _dispatchers;
   };
 }
 
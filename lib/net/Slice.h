@@ -0,0 +1,65 @@
+#ifndef OPLIB_SLICE_H
+#define OPLIB_SLICE_H
+
+#include <stddef.h>
+#include <assert.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace oplib
+{
+  // A piece of an outgoing message for TCPConnection::send(SliceList&&).
+  // Either a plain view of memory the caller keeps alive until send()
+  // returns, or a refcounted block which is kept alive until written,
+  // so a cached body can be sent to many connections without a copy.
+  class Slice
+  {
+   public:
+    Slice(const char* data_, size_t len_)
+    : _data(data_), _len(len_)
+    {}
+
+    Slice(const std::string& str_)
+    : _data(str_.data()), _len(str_.size())
+    {}
+
+    Slice(std::shared_ptr<const std::string> str_)
+    : _data(str_->data()), _len(str_->size()), _owner(std::move(str_))
+    {}
+
+    // data_ lives as long as owner_
+    Slice(std::shared_ptr<const void> owner_, const char* data_, size_t len_)
+    : _data(data_), _len(len_), _owner(std::move(owner_))
+    {}
+
+    const char* data() const { return _data; }
+    size_t size() const { return _len; }
+
+    // Whether the slice keeps its memory alive
+    bool owned() const { return _owner != nullptr; }
+
+    void removePrefix(size_t len_)
+    {
+      assert(len_ <= _len);
+      _data += len_;
+      _len -= len_;
+    }
+
+    // Copy of the viewed memory, owned by the new slice
+    Slice toOwned() const
+    {
+      return Slice(std::make_shared<const std::string>(_data, _len));
+    }
+
+   private:
+    const char* _data;
+    size_t _len;
+    std::shared_ptr<const void> _owner;
+  };
+
+  typedef std::vector<Slice> SliceList;
+}
+
+#endif
@@ -4,11 +4,14 @@
 
 #include <strings.h>
 #include <unistd.h>
-#include <cstdio>
+#include <errno.h>
+#include <string.h>
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <log/Logging.h>
+
 using namespace oplib;
 
 Socket::~Socket()
@@ -31,6 +34,11 @@ void Socket::setReuseAddr(bool on_)
   socketutils::setReuseAddrOrDie(_sockfd, on_);
 }
 
+void Socket::setReusePort(bool on_)
+{
+  socketutils::setReusePortOrDie(_sockfd, on_);
+}
+
 void Socket::shutdownWrite()
 { socketutils::shutdownWrite(_sockfd); }
 
@@ -39,11 +47,17 @@ void Socket::setTcpNoDelay(bool on_)
   int nodelay = on_ ? 1 : 0;
   int result = ::setsockopt(_sockfd, IPPROTO_TCP,
                             TCP_NODELAY, &nodelay, sizeof(nodelay));
-  // TODO: log
   if (result < 0)
   {
-    printf("Set tcp nodelay error\n");
-    abort();
+    LOG_FATAL("Set tcp nodelay error: %s", ::strerror(errno));
+  }
+}
+
+void Socket::setSendBufferSize(int bytes_)
+{
+  if (::setsockopt(_sockfd, SOL_SOCKET, SO_SNDBUF, &bytes_, sizeof(bytes_)) < 0)
+  {
+    LOG_ERROR("Set send buffer size %d error: %s", bytes_, ::strerror(errno));
   }
 }
 
@@ -53,7 +67,7 @@ int Socket::accept(InetAddress* peer_)
   ::bzero(&addr, sizeof(addr));
   int connfd = socketutils::accept(_sockfd, &addr);
 
-  if (connfd > 0)
+  if (connfd >= 0)
   {
     peer_->setSocketAddrInet6(addr);
   }
@@ -22,12 +22,17 @@ namespace oplib
 
     void setReuseAddr(bool on_);
 
+    void setReusePort(bool on_);
+
     int accept(InetAddress* peer_);
 
     void shutdownWrite();
 
     void setTcpNoDelay(bool on_);
 
+    // SO_SNDBUF, turns off the kernel's autotuning of the send buffer
+    void setSendBufferSize(int bytes_);
+
    private:
     const int _sockfd;
   };
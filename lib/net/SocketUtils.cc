@@ -1,6 +1,9 @@
 #include "SocketUtils.h"
 #include <util/Common.h>
+#include <log/Logging.h>
 
+#include <errno.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdlib.h>
@@ -17,9 +20,7 @@ void close(int sockfd_)
   int ret = ::close(sockfd_);
   if (ret < 0)
   {
-    // TODO: error log
-    printf("Close socket error\n");
-    abort();
+    LOG_FATAL("Close socket error: %s", ::strerror(errno));
   }
 }
 
@@ -29,9 +30,7 @@ int createOrDie()
                     IPPROTO_TCP);
   if (fd < 0)
   {
-    // TODO error log
-    printf("Create socket error\n");
-    abort();
+    LOG_FATAL("Create socket error: %s", ::strerror(errno));
   }
   return fd;
 }
@@ -41,9 +40,7 @@ void bindOrDie(int sockfd_, const struct sockaddr* addr_)
   int ret = ::bind(sockfd_, addr_, static_cast<socklen_t>(sizeof(struct sockaddr_in6))); 
   if (ret < 0)
   {
-    // TODO error log
-    printf("Bind socket error\n");
-    abort();
+    LOG_FATAL("Bind socket error: %s", ::strerror(errno));
   }
 }
 
@@ -53,9 +50,7 @@ void listenOrDie(int sockfd_)
   int ret = ::listen(sockfd_, SOMAXCONN);
   if (ret < 0)
   {
-    // TODO: error log
-    printf("Listen socket error\n");
-    abort();
+    LOG_FATAL("Listen socket error: %s", ::strerror(errno));
   }
 }
 
@@ -65,9 +60,17 @@ void setReuseAddrOrDie(int sockfd_, bool on_)
   int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
   if (ret < 0)
   {
-    // TODO error log
-    printf("Set reuse socket error\n");
-    abort();
+    LOG_FATAL("Set reuse socket error: %s", ::strerror(errno));
+  }
+}
+
+void setReusePortOrDie(int sockfd_, bool on_)
+{
+  int optval = on_ ? 1 : 0;
+  int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+  if (ret < 0)
+  {
+    LOG_FATAL("Set reuse port error: %s", ::strerror(errno));
   }
 }
 
@@ -105,14 +108,17 @@ int accept(int sockfd_, struct sockaddr_in6* addr_)
       case ECONNABORTED:
       case EINTR:
       case EPERM:
+      case EPROTO:
+      // Out of fds or memory, Listener rejects or retries later
       case EMFILE:
+      case ENFILE:
+      case ENOBUFS:
+      case ENOMEM:
         errno = savederrno;
         break;
       default:
-        // TODO error log
         // TODO check other error codes
-        printf("Accept socket error\n");
-        abort();
+        LOG_FATAL("Accept socket error: %s", ::strerror(savederrno));
     }
   }
 
@@ -137,9 +143,7 @@ struct sockaddr_in getLocalAddr(int sockfd_)
   socklen_t addrlen = sizeof(localaddr);
   if (::getsockname(sockfd_, sockaddr_cast(&localaddr), &addrlen) < 0)
   {
-    // TODO error log
-    printf("get local addr error\n");
-    abort();
+    LOG_FATAL("get local addr error: %s", ::strerror(errno));
   }
 
   return localaddr;
@@ -149,9 +153,7 @@ void shutdownWrite(int sockfd_)
 {
   if (::shutdown(sockfd_, SHUT_WR) < 0)
   {
-    // TODO : log error
-    printf("shutdown write error\n");
-    abort();
+    LOG_FATAL("shutdown write error: %s", ::strerror(errno));
   }
 }
 
@@ -177,7 +179,7 @@ struct sockaddr_in getPeerAddr(int sockfd_)
   socklen_t addrlen = sizeof(peeraddr);
   if (::getpeername(sockfd_, sockaddr_cast(&peeraddr), &addrlen) < 0)
   {
-    printf("Error in getpeername\n");
+    LOG_ERROR("getpeername error: %s", ::strerror(errno));
   }
   return peeraddr;
 }
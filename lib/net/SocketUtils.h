@@ -4,11 +4,15 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
 
 #include <string>
 #include <cstdlib>
 #include <cstdio>
 
+#include <log/Logging.h>
+
 namespace oplib
 {
 namespace socketutils
@@ -42,14 +46,11 @@ namespace socketutils
     int result = ::inet_pton(AF_INET, ip_.data(), &addr_->sin_addr);
     if (result == 0)
     {
-      printf("Invalid address representation: %s, cannot convert to ip address\n", ip_.c_str());
-      abort();
+      LOG_FATAL("Invalid address representation: %s, cannot convert to ip address", ip_.c_str());
     }
     else if (result < 0)
     {
-      // TODO error log
-      printf("ipPortToSockAddr error\n");
-      abort();
+      LOG_FATAL("ipPortToSockAddr error: %s", ::strerror(errno));
     }
   }
 
@@ -60,14 +61,11 @@ namespace socketutils
     int result = ::inet_pton(AF_INET6, ip_.data(), &addr6_->sin6_addr);
     if (result == 0)
     {
-      printf("Invalid address representation: %s, cannot convert to valid ipv6 address\n", ip_.c_str());
-      abort();
+      LOG_FATAL("Invalid address representation: %s, cannot convert to valid ipv6 address", ip_.c_str());
     }
     else if (result < 0)
     {
-      // TODO error log
-      printf("ipPortToSockAddr error\n");
-      abort();
+      LOG_FATAL("ipPortToSockAddr error: %s", ::strerror(errno));
     }
   }
 
@@ -86,6 +84,8 @@ namespace socketutils
 
   void setReuseAddrOrDie(int sockfd_, bool on_);
 
+  void setReusePortOrDie(int sockfd_, bool on_);
+
   int accept(int sockfd_, struct sockaddr_in6* addr_);
 
   const struct sockaddr* sockaddr_cast(const struct sockaddr_in* addr_);
@@ -0,0 +1,136 @@
+#include "TCPClient.h"
+#include "SocketUtils.h"
+
+#include <cassert>
+
+#include <log/Logging.h>
+
+using namespace oplib;
+
+namespace
+{
+  void defaultConnectionCallback(const TCPConnectionPtr&)
+  {}
+
+  void defaultMessageCallback(const TCPConnectionPtr&, ds::Buffer* buf_, Timestamp)
+  {
+    buf_->retrieveAll();
+  }
+
+  // Close callback of a connection whose client is gone
+  void removeOrphanConnection(const TCPConnectionPtr& conn_)
+  {
+    conn_->getLoop()->enqueue(std::bind(&TCPConnection::connectionClosed, conn_));
+  }
+
+  // Bound to a functor, keeps the Connector alive until the functors
+  // it queued itself (resetDispatcher) have run
+  void releaseConnector(const net::ConnectorPtr&)
+  {}
+}
+
+TCPClient::TCPClient(EventLoop* loop_, const InetAddress& serverAddr_, const std::string& name_)
+: _loop(loop_),
+  _name(std::make_shared<const std::string>(name_ + "_" + serverAddr_.toHostPort())),
+  _connector(std::make_shared<net::Connector>(loop_, serverAddr_)),
+  _connectionCallback(defaultConnectionCallback),
+  _messageCallback(defaultMessageCallback),
+  _retry(false),
+  _connect(false),
+  _edgeTriggered(false),
+  _sendBufferSize(0),
+  _nextConnId(1)
+{
+  _connector->setNewConnectionCallback(
+    std::bind(&TCPClient::newConnection, this, std::placeholders::_1));
+}
+
+TCPClient::~TCPClient()
+{
+  _loop->inLoopThreadOrDie();
+
+  TCPConnectionPtr conn = connection();
+  if (conn)
+  {
+    // The connection may outlive the client: it must not
+    // call back into it anymore
+    conn->setConnectionCallback(defaultConnectionCallback);
+    conn->setMessageCallback(defaultMessageCallback);
+    conn->setWriteCompleteCallback(ConnectionEventCallback());
+    conn->setCloseCallback(removeOrphanConnection);
+    conn->shutdown();
+  }
+
+  _connector->stop();
+  _loop->enqueue(std::bind(releaseConnector, _connector));
+}
+
+void TCPClient::connect()
+{
+  _connect = true;
+  _connector->start();
+}
+
+void TCPClient::disconnect()
+{
+  _connect = false;
+  TCPConnectionPtr conn = connection();
+  if (conn)
+  {
+    conn->shutdown();
+  }
+}
+
+void TCPClient::stop()
+{
+  _connect = false;
+  _connector->stop();
+}
+
+void TCPClient::newConnection(int sockfd_)
+{
+  _loop->inLoopThreadOrDie();
+  InetAddress localAddr(socketutils::getLocalAddr(sockfd_));
+  InetAddress peerAddr(socketutils::getPeerAddr(sockfd_));
+
+  std::unique_ptr<Socket> sock(std::make_unique<Socket>(sockfd_));
+  if (_sendBufferSize > 0)
+  {
+    sock->setSendBufferSize(_sendBufferSize);
+  }
+  TCPConnectionPtr conn(std::make_shared<TCPConnection>(_loop, _nextConnId++, _name,
+                                                        std::move(sock),
+                                                        localAddr, peerAddr));
+  conn->setConnectionCallback(_connectionCallback);
+  conn->setMessageCallback(_messageCallback);
+  conn->setWriteCompleteCallback(_writeCompleteCallback);
+  conn->setCloseCallback(std::bind(&TCPClient::removeConnection, this, std::placeholders::_1));
+  conn->setEdgeTriggered(_edgeTriggered);
+  {
+    MutexLockGuard guard(_mutex);
+    _connection = conn;
+  }
+
+  // This will call the _connectionCallback
+  conn->connectionEstablished();
+}
+
+void TCPClient::removeConnection(const TCPConnectionPtr& conn_)
+{
+  _loop->inLoopThreadOrDie();
+  {
+    MutexLockGuard guard(_mutex);
+    assert(_connection == conn_);
+    _connection.reset();
+  }
+
+  // Still in the middle of the connection's handleEvent
+  _loop->enqueue(std::bind(&TCPConnection::connectionClosed, conn_));
+
+  if (_retry && _connect)
+  {
+    LOG_INFO("TCPClient::removeConnection() %s reconnecting to %s",
+             conn_->name().c_str(), conn_->peerAddr().toHostPort().c_str());
+    _connector->restart();
+  }
+}
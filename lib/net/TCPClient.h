@@ -0,0 +1,98 @@
+#ifndef OPLIB_TCPCLIENT_H
+#define OPLIB_TCPCLIENT_H
+
+#include "InetAddress.h"
+#include "Types.h"
+#include "TCPConnection.h"
+#include "Connector.h"
+
+#include <atomic>
+#include <string>
+#include <memory>
+
+#include <thread/Mutex.h>
+#include <util/Common.h>
+
+namespace oplib
+{
+  // One connection to serverAddr_, established by a Connector
+  // (retried with backoff) and served by loop_
+  class TCPClient : Noncopyable
+  {
+   public:
+    TCPClient(EventLoop* loop_,
+              const InetAddress& serverAddr_,
+              const std::string& name_);
+    // Must be called in the loop thread
+    ~TCPClient();
+
+    // Thread-safe
+    void connect();
+    // Shutdown the connection, thread-safe
+    void disconnect();
+    // Stop connecting, thread-safe
+    void stop();
+
+    // Connect again when the connection is closed
+    void enableRetry()
+    { _retry = true; }
+
+    // nullptr when not connected, thread-safe
+    TCPConnectionPtr connection() const
+    {
+      MutexLockGuard guard(_mutex);
+      return _connection;
+    }
+
+    EventLoop* getLoop() const
+    { return _loop; }
+
+    const std::string& name() const
+    { return *_name; }
+
+    void setConnectionCallback(const ConnectionCallback& cb_)
+    { _connectionCallback = cb_; }
+
+    void setMessageCallback(const MessageCallback& cb_)
+    { _messageCallback = cb_; }
+
+    void setWriteCompleteCallback(const ConnectionEventCallback& cb_)
+    { _writeCompleteCallback = cb_; }
+
+    // Edge-triggered IO for the connection, needs PollerType::EPOLL
+    void setEdgeTriggered(bool on_)
+    { _edgeTriggered = on_; }
+
+    // SO_SNDBUF of the connection, 0 (the default) leaves the kernel's.
+    // A small one makes the output pile up in the connection, where
+    // the water marks see it
+    void setSendBufferSize(int bytes_)
+    { _sendBufferSize = bytes_; }
+
+   private:
+    // Connector callback, in the loop thread
+    void newConnection(int sockfd_);
+    // Close callback of the connection, in the loop thread
+    void removeConnection(const TCPConnectionPtr& conn_);
+
+    EventLoop* _loop;
+    // Shared by the connections to format their names lazily
+    const std::shared_ptr<const std::string> _name;
+    net::ConnectorPtr _connector;
+
+    ConnectionCallback _connectionCallback;
+    MessageCallback _messageCallback;
+    ConnectionEventCallback _writeCompleteCallback;
+
+    bool _retry;
+    std::atomic_bool _connect;
+    bool _edgeTriggered;
+    int _sendBufferSize;
+    // Only used in the loop thread
+    uint64_t _nextConnId;
+    mutable Mutex _mutex;
+    TCPConnectionPtr _connection;
+  };
+}
+
+#endif
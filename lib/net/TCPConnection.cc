@@ -2,9 +2,14 @@
 #include "EventDispatcher.h"
 #include "SocketUtils.h"
 #include <util/Common.h>
+#include <log/Logging.h>
 
 #include <unistd.h>
 #include <signal.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <string.h>
@@ -27,30 +32,58 @@ namespace detail
 }
 
 TCPConnection::TCPConnection(EventLoop *loop_,
-                             const std::string& name_,
+                             uint64_t id_,
+                             std::shared_ptr<const std::string> namePrefix_,
                              std::unique_ptr<Socket> sock_,
                              const InetAddress& localAddr_,
                              const InetAddress& peerAddr_)
 : _state(State::CONNECTING),
   _loop(loop_),
-  _name(name_),
+  _id(id_),
+  _namePrefix(std::move(namePrefix_)),
   _sock(std::move(sock_)),
   _localAddr(localAddr_),
   _peerAddr(peerAddr_),
-  _dispatcher(std::make_unique<EventDispatcher>(_loop, _sock->fd()))
+  _highWaterMark(kDefaultHighWaterMark),
+  _lowWaterMark(0),
+  _aboveHighWaterMark(false),
+  _reading(true),
+  _closing(false),
+  _edgeTriggered(false),
+  _dispatcher(std::make_unique<EventDispatcher>(_loop, _sock->fd())),
+  _readSizeAverage(ds::Buffer::initialSize),
+  _overflowReads(0),
+  _inputBuffer(_loop->bufferPool()),
+  _outputBuffer(_loop->bufferPool()),
+  _outputSliceBytes(0),
+  _outputFileBytes(0)
 {
-  // TODO log
+  LOG_DEBUG("TCPConnection::TCPConnection() id %llu fd %d",
+            static_cast<unsigned long long>(_id), _sock->fd());
   using namespace std::placeholders;
+  _dispatcher->setType(DispatcherType::CONNECTION);
   _dispatcher->setReadCallback(std::bind(&TCPConnection::handleRead, this, _1));
   _dispatcher->setWriteCallback(std::bind(&TCPConnection::handleWrite, this));
   _dispatcher->setCloseCallback(std::bind(&TCPConnection::handleClose, this));
   _dispatcher->setErrorCallback(std::bind(&TCPConnection::handleError, this));
+
+  // Counted from creation, not establishment: placement decisions
+  // taken before the loop runs connectionEstablished see it
+  _loop->load().connections.fetch_add(1, std::memory_order_relaxed);
 }
 
 TCPConnection::~TCPConnection()
 {
-  // TODO log here
-  printf("TCPConnection::~TCPConnection() called\n");
+  LOG_DEBUG("TCPConnection::~TCPConnection() id %llu fd %d",
+            static_cast<unsigned long long>(_id), _sock->fd());
+}
+
+const std::string& TCPConnection::name() const
+{
+  std::call_once(_nameOnce, [this] {
+    _name = *_namePrefix + "_" + std::to_string(_id);
+  });
+  return _name;
 }
 
 void TCPConnection::connectionEstablished()
@@ -61,7 +94,18 @@ void TCPConnection::connectionEstablished()
   setState(State::CONNECTED);
 
   // Start polling for io events
-  _dispatcher->enableReading();
+  if (_edgeTriggered)
+  {
+    _dispatcher->enableEdgeTriggered();
+    if (!_reading)
+    {
+      _dispatcher->disableReading();
+    }
+  }
+  else if (_reading)
+  {
+    _dispatcher->enableReading();
+  }
 
   // Call ConnectionCallback
   if (_connectionCallback)
@@ -82,84 +126,205 @@ void TCPConnection::connectionClosed()
   // Sometimes we need to call connectionClosed
   // directly without handleClose
   _dispatcher->disable();
-  _connectionCallback(shared_from_this());
+  if (_connectionCallback)
+  {
+    _connectionCallback(shared_from_this());
+  }
+
+  // The buffers' storage belongs to the loop's pool, give it
+  // back here: the connection may be destroyed in another thread
+  _inputBuffer.retrieveAll();
+  _inputBuffer.release();
+  addLoadOutputBytes(-static_cast<int64_t>(pendingOutputBytes()));
+  _loop->load().connections.fetch_sub(1, std::memory_order_relaxed);
+  _outputBuffer.retrieveAll();
+  _outputSlices.clear();
+  _outputSliceBytes = 0;
+  _outputFileBytes = 0;
+  if (_aboveHighWaterMark)
+  {
+    // Don't leave the reader stalled on a closed connection
+    _aboveHighWaterMark = false;
+    if (TCPConnectionPtr reader = _throttledReader.lock())
+    {
+      reader->startRead();
+    }
+  }
 
   // Changes internal data of loop
   // Must be called from loop thread, else
   // not thread-safe
   _loop->removeEventDispatcher(_dispatcher.get());
-
-  // TODO log here
 }
 
 void TCPConnection::handleRead(oplib::Timestamp receiveTime_)
 {
-  // Simple version, TODO: use buffer
   // We need to check for read 0 situation in handleRead
+  // In edge-triggered mode there will be no more read event
+  // until the socket is drained, so keep reading until EAGAIN,
+  // and again after EINTR: no other event would come for the rest
   int savedErrno = 0;
-  ssize_t n = _inputBuffer.readFd(_dispatcher->fd(), &savedErrno);
-  if (n > 0)
+  size_t nread = 0;
+  ssize_t n = 0;
+  do
+  {
+    n = readInput(&savedErrno);
+    if (n > 0)
+    {
+      nread += n;
+      if (_edgeTriggered && nread >= kMaxReadBatchBytes)
+      {
+        // A fast peer can keep the socket readable: hand over what
+        // was read, the callback may stop reading (backpressure).
+        // startRead() re-arms the dispatcher for the rest
+        _messageCallback(shared_from_this(), &_inputBuffer, receiveTime_);
+        nread = 0;
+        if (!_reading)
+        {
+          break;
+        }
+      }
+    }
+  } while ((_edgeTriggered && n > 0) || (n < 0 && savedErrno == EINTR));
+
+  if (nread > 0)
   {
     _messageCallback(shared_from_this(), &_inputBuffer, receiveTime_);
   }
-  else if (n == 0)
+
+  // Everything consumed: idle connections hold no input storage,
+  // it is taken again from the loop's pool by the next read
+  _inputBuffer.release();
+
+  if (n == 0)
   {
     handleClose();
   }
-  else
+  else if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
   {
+    // ECONNRESET and the like: nothing more will come, close
     errno = savedErrno;
-    // TODO : log here
+    LOG_ERROR("TCPConnection::handleRead() %s: %s", name().c_str(), ::strerror(savedErrno));
     handleError();
+    handleClose();
   }
 }
 
+ssize_t TCPConnection::readInput(int* savedErrno_)
+{
+  _inputBuffer.ensureWritableBytes(readSizeHint());
+
+  size_t spilled = 0;
+  ssize_t n = _inputBuffer.readFd(_dispatcher->fd(), savedErrno_,
+                                  _loop->overflowBuffer(),
+                                  EventLoop::kOverflowBufferSize, &spilled);
+  countRead(n);
+  if (n > 0)
+  {
+    // Exponential moving average, weight 1/8
+    _readSizeAverage = _readSizeAverage - _readSizeAverage / 8 + n / 8;
+
+    ReadStats& stats = _loop->readStats();
+    ++stats.reads;
+    if (spilled > 0)
+    {
+      ++_overflowReads;
+      ++stats.overflowReads;
+      stats.overflowBytes += spilled;
+    }
+  }
+  return n;
+}
+
+void TCPConnection::countRead(ssize_t n_)
+{
+  IOCounters& loopCounters = _loop->metrics().io;
+  _ioCounters.readCalls.add(1);
+  loopCounters.readCalls.add(1);
+  if (n_ > 0)
+  {
+    _ioCounters.bytesRead.add(n_);
+    loopCounters.bytesRead.add(n_);
+  }
+}
+
+void TCPConnection::countWrite(ssize_t n_)
+{
+  IOCounters& loopCounters = _loop->metrics().io;
+  _ioCounters.writeCalls.add(1);
+  loopCounters.writeCalls.add(1);
+  if (n_ > 0)
+  {
+    _ioCounters.bytesWritten.add(n_);
+    loopCounters.bytesWritten.add(n_);
+  }
+}
+
+size_t TCPConnection::readSizeHint() const
+{
+  // Twice the average leaves room for bursts, rounded so the
+  // buffer storage fills a whole size class of the pool
+  const size_t prepend = ds::Buffer::prependSize;
+  size_t want = std::max(2 * _readSizeAverage, ds::Buffer::initialSize) + prepend;
+  int cls = ds::BufferPool::classOf(want);
+  if (cls < 0)
+  {
+    cls = ds::BufferPool::kNumClasses - 1;
+  }
+  return ds::BufferPool::classSize(cls) - prepend;
+}
+
 void TCPConnection::handleWrite()
 {
   _loop->inLoopThreadOrDie();
-  if (_dispatcher->isWriting())
+  if (_edgeTriggered && pendingOutputBytes() == 0u)
   {
-    ssize_t nwrite = ::write(_dispatcher->fd(),
-                             _outputBuffer.peek(),
-                             _outputBuffer.readableBytes());
-    if (nwrite > 0)
+    // Writable edge while nothing is pending
+    return;
+  }
+
+  if (hasPendingOutput())
+  {
+    ssize_t nwrite = flushOutput();
+    checkLowWaterMark();
+
+    if (pendingOutputBytes() == 0u)
     {
-      _outputBuffer.retrieve(nwrite);
-      if (_outputBuffer.readableBytes() == 0u)
+      if (!_edgeTriggered)
       {
         _dispatcher->disableWriting();
-        if (_writeCompleteCallback)
-        {
-          _loop->enqueue(std::bind(_writeCompleteCallback, shared_from_this()));
-        }
-        if (_state == State::DISCONNECTING)
-        {
-          shutdownInLoop();
-        }
       }
-      else
+      if (_writeCompleteCallback)
+      {
+        _loop->enqueue(std::bind(_writeCompleteCallback, shared_from_this()));
+      }
+      if (_state == State::DISCONNECTING)
       {
-        // TODO log: ready to write more data
+        shutdownInLoop();
       }
     }
-    else
+    else if (nwrite < 0 && errno != EWOULDBLOCK)
     {
-      // TODO log write error
-      printf("Error writing data to peer\n");
+      handleWriteError("handleWrite", errno);
     }
   }
   else
   {
-    // TODO: log connection is down, no more writing
-    printf("Connection is down, no more writing\n");
+    LOG_TRACE("TCPConnection::handleWrite() %s is down, no more writing", name().c_str());
   }
 }
 
 void TCPConnection::handleClose()
 {
   _loop->inLoopThreadOrDie();
+  if (_closing)
+  {
+    // A failed write, then the read of the same reset
+    return;
+  }
   assert(_state == State::CONNECTED ||
          _state == State::DISCONNECTING);
+  _closing = true;
   _dispatcher->disable();
 
   // This CloseCallback binds to TCPServer/TCPClient's removeConnection
@@ -168,9 +333,18 @@ void TCPConnection::handleClose()
 
 void TCPConnection::handleError()
 {
-  // TODO: log error info
   int err = socketutils::getSocketError(_dispatcher->fd());
-  printf("TCPConnection::handleError() error is %s\n", ::strerror(err));
+  LOG_ERROR("TCPConnection::handleError() %s SO_ERROR %s", name().c_str(), ::strerror(err));
+}
+
+void TCPConnection::handleWriteError(const char* where_, int errno_)
+{
+  if (errno_ != EPIPE && errno_ != ECONNRESET)
+  {
+    LOG_ERROR("TCPConnection::%s() %s: %s", where_, name().c_str(), ::strerror(errno_));
+  }
+  // Peer is down
+  handleClose();
 }
 
 void TCPConnection::send(const std::string& message_)
@@ -184,59 +358,445 @@ void TCPConnection::send(const std::string& message_)
     else
     {
       // Make a copy of message_ and send in loop thread
-      _loop->runInLoop(std::bind(&TCPConnection::sendInLoop, this, message_));
+      void (TCPConnection::*fp)(const std::string&) = &TCPConnection::sendInLoop;
+      _loop->runInLoop(std::bind(fp, this, message_));
     }
   } 
 }
 
-void TCPConnection::sendInLoop(const std::string& message_)
+void TCPConnection::send(std::string&& message_)
+{
+  if (_state == State::CONNECTED)
+  {
+    if (_loop->inLoopThread())
+    {
+      sendInLoop(message_);
+    }
+    else
+    {
+      // The closure fits in the Functor's inline buffer:
+      // the payload is moved twice, never copied nor allocated
+      _loop->runInLoop([this, message = std::move(message_)] {
+        sendInLoop(message);
+      });
+    }
+  }
+}
+
+void TCPConnection::send(ds::Buffer* buf_)
+{
+  if (_state == State::CONNECTED)
+  {
+    if (_loop->inLoopThread())
+    {
+      sendInLoop(buf_->peek(), buf_->readableBytes());
+      buf_->retrieveAll();
+    }
+    else
+    {
+      send(buf_->retrieveAsString());
+    }
+  }
+}
+
+void TCPConnection::sendInLoop(const char* data_, size_t len_)
 {
   _loop->inLoopThreadOrDie();
-  ssize_t nwrite = 0;
-  if (!_dispatcher->isWriting() && _outputBuffer.readableBytes() == 0u)
+  size_t nwrote = 0;
+  if (pendingOutputBytes() == 0u)
   {
-    // Try to write directly if writing and no pending data
-    nwrite = ::write(_dispatcher->fd(), message_.data(), message_.size());
-    if (nwrite >= 0)
+    // Try to write directly if not writing and no pending data,
+    // in edge-triggered mode keep writing until EAGAIN. Again
+    // after EINTR
+    ssize_t nwrite = 0;
+    do
     {
-      if (implicit_cast<size_t>(nwrite) < message_.size())
+      nwrite = ::write(_dispatcher->fd(), data_ + nwrote, len_ - nwrote);
+      countWrite(nwrite);
+      if (nwrite > 0)
       {
-        // TODO log
+        nwrote += nwrite;
       }
-      else if (_writeCompleteCallback)
+    } while (nwrote < len_ && ((_edgeTriggered && nwrite > 0) || (nwrite < 0 && errno == EINTR)));
+
+    if (nwrote == len_)
+    {
+      if (_writeCompleteCallback)
       {
         // Write is complete, trigger _writeCompleteCallback
         _loop->runInLoop(std::bind(_writeCompleteCallback, shared_from_this()));
       }
     }
+    else if (nwrite < 0 && errno != EWOULDBLOCK)
+    {
+      handleWriteError("sendInLoop", errno);
+      return;
+    }
+  }
+
+  if (nwrote < len_)
+  {
+    queueOutput(Slice(data_ + nwrote, len_ - nwrote));
+    checkHighWaterMark();
+    if (!_edgeTriggered && !_dispatcher->isWriting())
+    {
+      // Remaining data to write, inform the dispatcher
+      // to watch writing event
+      _dispatcher->enableWriting();
+    }
+  }
+}
+
+void TCPConnection::send(SliceList&& slices_)
+{
+  if (_state == State::CONNECTED)
+  {
+    if (_loop->inLoopThread())
+    {
+      sendInLoop(slices_);
+    }
     else
     {
-      // TODO: log
-      nwrite = 0;
-      if (errno == EPIPE)
+      // The caller's views may be gone by the time the loop runs
+      for (auto& slice : slices_)
       {
-        // Peer is down
-        handleClose(); 
-      }
-      else if (errno != EWOULDBLOCK)
-      {
-        // TODO log
-        printf("Error sending data, not receiving EWOULDBLOCK\n");
-        abort();
+        if (!slice.owned())
+        {
+          slice = slice.toOwned();
+        }
       }
+      _loop->runInLoop([this, slices = std::move(slices_)] () mutable {
+        sendInLoop(slices);
+      });
+    }
+  }
+}
+
+void TCPConnection::sendInLoop(SliceList& slices_)
+{
+  _loop->inLoopThreadOrDie();
+  if (pendingOutputBytes() > 0u)
+  {
+    // Already waiting for the socket to be writable
+    for (auto& slice : slices_)
+    {
+      queueOutput(std::move(slice));
+    }
+    checkHighWaterMark();
+    return;
+  }
+
+  // Nothing pending, write the slices straight from their memory
+  for (auto& slice : slices_)
+  {
+    if (slice.size() > 0u)
+    {
+      addLoadOutputBytes(slice.size());
+      _outputSliceBytes += slice.size();
+      _outputSlices.emplace_back(std::move(slice));
+    }
+  }
+  if (!_outputSlices.empty())
+  {
+    flushQueuedOutput();
+  }
+}
+
+void TCPConnection::sendFile(int fd_, off_t offset_, size_t len_)
+{
+  if (_state != State::CONNECTED || len_ == 0u)
+  {
+    return;
+  }
+
+  int dupFd = ::dup(fd_);
+  if (dupFd < 0)
+  {
+    LOG_ERROR("TCPConnection::sendFile() dup error: %s", ::strerror(errno));
+    return;
+  }
+  FilePtr file(new int(dupFd), [] (const int* file_) {
+    ::close(*file_);
+    delete file_;
+  });
+
+  if (_loop->inLoopThread())
+  {
+    sendFileInLoop(file, offset_, len_);
+  }
+  else
+  {
+    _loop->runInLoop(std::bind(&TCPConnection::sendFileInLoop, this, file, offset_, len_));
+  }
+}
+
+void TCPConnection::sendFileInLoop(const FilePtr& file_, off_t offset_, size_t len_)
+{
+  _loop->inLoopThreadOrDie();
+  const bool idle = pendingOutputBytes() == 0u;
+  addLoadOutputBytes(len_);
+  _outputSliceBytes += len_;
+  _outputFileBytes += len_;
+  _outputSlices.emplace_back(file_, offset_, len_);
+  if (idle)
+  {
+    flushQueuedOutput();
+  }
+  // Otherwise sent by handleWrite() after the pending output
+}
+
+void TCPConnection::flushQueuedOutput()
+{
+  ssize_t nwrite = flushOutput();
+  if (pendingOutputBytes() == 0u)
+  {
+    if (_writeCompleteCallback)
+    {
+      // Write is complete, trigger _writeCompleteCallback
+      _loop->runInLoop(std::bind(_writeCompleteCallback, shared_from_this()));
     }
+    return;
+  }
+
+  ownOutputSlices();
+  checkHighWaterMark();
+  if (nwrite < 0 && errno != EWOULDBLOCK)
+  {
+    handleWriteError("flushQueuedOutput", errno);
+    return;
+  }
+
+  if (!_edgeTriggered && !_dispatcher->isWriting())
+  {
+    // Remaining data to write, inform the dispatcher
+    // to watch writing event
+    _dispatcher->enableWriting();
+  }
+}
+
+void TCPConnection::queueOutput(Slice&& slice_)
+{
+  if (slice_.size() == 0u)
+  {
+    return;
+  }
+  addLoadOutputBytes(slice_.size());
 
-    assert(nwrite >= 0);
-    if (implicit_cast<size_t>(nwrite) < message_.size())
+  if (slice_.owned())
+  {
+    _outputSliceBytes += slice_.size();
+    _outputSlices.emplace_back(std::move(slice_));
+  }
+  else if (_outputSlices.empty())
+  {
+    // _outputBuffer is still the tail of the pending output
+    _outputBuffer.append(slice_.data(), slice_.size());
+  }
+  else
+  {
+    _outputSliceBytes += slice_.size();
+    _outputSlices.emplace_back(slice_.toOwned());
+  }
+}
+
+void TCPConnection::ownOutputSlices()
+{
+  for (auto& out : _outputSlices)
+  {
+    if (!out.isFile() && !out.slice.owned())
     {
-      _outputBuffer.append(message_.data() + nwrite, message_.size() - nwrite);
-      if (!_dispatcher->isWriting())
+      out.slice = out.slice.toOwned();
+    }
+  }
+}
+
+ssize_t TCPConnection::flushOutput()
+{
+  ssize_t nwrite = 0;
+  do
+  {
+    struct iovec vec[kMaxIovecs];
+    int iovcnt = _outputBuffer.fillIovec(vec, kMaxIovecs);
+    // Memory up to the first file range
+    for (auto it = _outputSlices.begin();
+         it != _outputSlices.end() && !it->isFile() && iovcnt < kMaxIovecs; ++it)
+    {
+      vec[iovcnt].iov_base = const_cast<char*>(it->slice.data());
+      vec[iovcnt].iov_len = it->slice.size();
+      ++iovcnt;
+    }
+
+    if (iovcnt > 0)
+    {
+      do
+      {
+        nwrite = ::writev(_dispatcher->fd(), vec, iovcnt);
+        countWrite(nwrite);
+      } while (nwrite < 0 && errno == EINTR);
+      if (nwrite > 0)
       {
-        // Remaining data to write, inform the dispatcher
-        // to watch writing event
-        _dispatcher->enableWriting();
+        retrieveOutput(nwrite);
       }
     }
+    else
+    {
+      nwrite = sendFileOutput();
+    }
+    // 0 only after dropping a file range, go on with the rest
+  } while (_edgeTriggered && nwrite >= 0 && pendingOutputBytes() > 0u);
+
+  return nwrite;
+}
+
+ssize_t TCPConnection::sendFileOutput()
+{
+  OutputSlice& front = _outputSlices.front();
+  assert(front.isFile());
+  off_t offset = front.fileOffset;
+  ssize_t nwrite = 0;
+  do
+  {
+    nwrite = ::sendfile(_dispatcher->fd(), *front.file, &offset, front.fileBytes);
+    countWrite(nwrite);
+  } while (nwrite < 0 && errno == EINTR);
+  if (nwrite > 0)
+  {
+    retrieveOutput(nwrite);
+  }
+  else if (nwrite == 0 || (errno != EAGAIN && errno != EPIPE && errno != ECONNRESET))
+  {
+    // The file ended before the range, or can't be sent from
+    // (e.g. not mmap-able): drop the range
+    LOG_WARN("TCPConnection::sendFileOutput() %s: %zu bytes not sent: %s",
+             name().c_str(), front.fileBytes, nwrite == 0 ? "end of file" : ::strerror(errno));
+    retrieveOutput(front.fileBytes);
+    nwrite = 0;
+  }
+  return nwrite;
+}
+
+void TCPConnection::retrieveOutput(size_t len_)
+{
+  addLoadOutputBytes(-static_cast<int64_t>(len_));
+  size_t fromBuffer = std::min(len_, _outputBuffer.readableBytes());
+  _outputBuffer.retrieve(fromBuffer);
+  len_ -= fromBuffer;
+
+  while (len_ > 0u)
+  {
+    OutputSlice& front = _outputSlices.front();
+    size_t n = std::min(len_, front.size());
+    if (front.isFile())
+    {
+      front.fileOffset += n;
+      front.fileBytes -= n;
+      _outputFileBytes -= n;
+    }
+    else
+    {
+      front.slice.removePrefix(n);
+    }
+    _outputSliceBytes -= n;
+    len_ -= n;
+    if (front.size() == 0u)
+    {
+      _outputSlices.pop_front();
+    }
+  }
+}
+
+void TCPConnection::setHighWaterMarkCallback(const HighWaterMarkCallback& cb_,
+                                             size_t highWaterMark_)
+{
+  assert(highWaterMark_ > _lowWaterMark);
+  _highWaterMarkCallback = cb_;
+  _highWaterMark = highWaterMark_;
+}
+
+void TCPConnection::setLowWaterMarkCallback(const ConnectionEventCallback& cb_,
+                                            size_t lowWaterMark_)
+{
+  assert(lowWaterMark_ < _highWaterMark);
+  _lowWaterMarkCallback = cb_;
+  _lowWaterMark = lowWaterMark_;
+}
+
+void TCPConnection::throttle(const TCPConnectionPtr& reader_)
+{
+  _throttledReader = reader_;
+}
+
+void TCPConnection::checkHighWaterMark()
+{
+  if (_aboveHighWaterMark || pendingOutputBytes() - _outputFileBytes < _highWaterMark)
+  {
+    return;
+  }
+  _aboveHighWaterMark = true;
+  if (_highWaterMarkCallback)
+  {
+    _loop->enqueue(std::bind(_highWaterMarkCallback, shared_from_this(),
+                             pendingOutputBytes() - _outputFileBytes));
+  }
+  if (TCPConnectionPtr reader = _throttledReader.lock())
+  {
+    reader->stopRead();
+  }
+}
+
+void TCPConnection::checkLowWaterMark()
+{
+  if (!_aboveHighWaterMark || pendingOutputBytes() - _outputFileBytes > _lowWaterMark)
+  {
+    return;
+  }
+  _aboveHighWaterMark = false;
+  if (_lowWaterMarkCallback)
+  {
+    _loop->enqueue(std::bind(_lowWaterMarkCallback, shared_from_this()));
+  }
+  if (TCPConnectionPtr reader = _throttledReader.lock())
+  {
+    reader->startRead();
+  }
+}
+
+void TCPConnection::stopRead()
+{
+  _loop->runInLoop(std::bind(&TCPConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TCPConnection::startRead()
+{
+  _loop->runInLoop(std::bind(&TCPConnection::startReadInLoop, shared_from_this()));
+}
+
+void TCPConnection::stopReadInLoop()
+{
+  _loop->inLoopThreadOrDie();
+  if (!_reading)
+  {
+    return;
+  }
+  _reading = false;
+  // Before connectionEstablished() it is not watched yet
+  if (_state != State::CONNECTING && !_closing && _state != State::DISCONNECTED)
+  {
+    _dispatcher->disableReading();
+  }
+}
+
+void TCPConnection::startReadInLoop()
+{
+  _loop->inLoopThreadOrDie();
+  if (_reading)
+  {
+    return;
+  }
+  _reading = true;
+  if (_state != State::CONNECTING && !_closing && _state != State::DISCONNECTED)
+  {
+    _dispatcher->enableReading();
   }
 }
 
@@ -252,12 +812,32 @@ void TCPConnection::shutdown()
 void TCPConnection::shutdownInLoop()
 {
   _loop->inLoopThreadOrDie();
-  if (!_dispatcher->isWriting())
+  if (!hasPendingOutput())
   {
     _sock->shutdownWrite();
   }
 }
 
+void TCPConnection::setEdgeTriggered(bool on_)
+{
+  assert(_state == State::CONNECTING);
+  if (on_ && _loop->pollerType() != PollerType::EPOLL)
+  {
+    // poll(2) has no edge-triggered mode
+    LOG_WARN("Edge-triggered mode needs an epoll loop, ignored");
+    return;
+  }
+  _edgeTriggered = on_;
+}
+
+bool TCPConnection::hasPendingOutput()
+{
+  // Level-triggered: the dispatcher only watches writing
+  // while there are pending data in _outputBuffer
+  return _edgeTriggered ? pendingOutputBytes() > 0u
+                        : _dispatcher->isWriting();
+}
+
 void TCPConnection::enableTcpNoDelay()
 {
   _sock->setTcpNoDelay(true);
@@ -2,11 +2,21 @@
 #define OPLIB_TCPCONNECTION_H
 
 #include <ds/Buffer.h>
+#include <ds/SegmentedBuffer.h>
 #include <util/Common.h>
 #include <util/Timestamp.h>
 
 #include "EventLoop.h"
 #include "InetAddress.h"
+#include "Slice.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
 
 namespace oplib
 {
@@ -16,8 +26,11 @@ namespace oplib
                         public std::enable_shared_from_this<TCPConnection>
   {
    public:
+    // The name, namePrefix_ + "_" + id_, is only formatted
+    // the first time someone asks for it
     TCPConnection(EventLoop* loop_,
-                  const std::string& name_,
+                  uint64_t id_,
+                  std::shared_ptr<const std::string> namePrefix_,
                   std::unique_ptr<Socket> sock_,
                   const InetAddress& localAddr_,
                   const InetAddress& peerAddr_);
@@ -29,8 +42,12 @@ namespace oplib
     bool connected() const
     { return _state == State::CONNECTED; }
 
-    std::string name() const
-    { return _name; }
+    // Unique among the connections of the owner
+    uint64_t id() const
+    { return _id; }
+
+    // Thread-safe
+    const std::string& name() const;
 
     InetAddress localAddr() const
     { return _localAddr; }
@@ -50,31 +67,143 @@ namespace oplib
     void setWriteCompleteCallback(const ConnectionEventCallback& cb_)
     { _writeCompleteCallback = cb_; }
 
+    // Backpressure on the pending output, which grows without limit
+    // when the peer reads slower than we send. cb_ is called once the
+    // pending output reaches highWaterMark_ bytes, not again before it
+    // went down to the low-water mark
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb_, size_t highWaterMark_);
+    // cb_ is called once the pending output is down to lowWaterMark_
+    // bytes or less after reaching the high-water mark
+    void setLowWaterMarkCallback(const ConnectionEventCallback& cb_, size_t lowWaterMark_);
+
+    // For proxies: reader_, the connection whose input is sent here,
+    // stops reading while this connection is above its high-water
+    // mark, and reads again at the low-water mark. Memory per pair
+    // stays bounded by the high-water mark plus one read. reader_
+    // may belong to another loop, it is not kept alive
+    void throttle(const TCPConnectionPtr& reader_);
+
+    // Stop/resume reading from the peer, data are left in the
+    // socket buffer and TCP flow control slows the peer down.
+    // Thread-safe, can be called before connectionEstablished()
+    void stopRead();
+    void startRead();
+    bool isReading() const
+    { return _reading; }
+
     // Called by the TCPServer in loop thread
     void connectionEstablished();
     void connectionClosed(); 
 
     // send() is thread-safe, can be called from another thread TODO
     void send(const std::string& message_);
+    // message_ is moved into the loop thread's functor, not copied
+    void send(std::string&& message_);
+    // Scatter/gather send: the slices are written with writev straight
+    // from their memory, e.g. a header and a cached body in one syscall.
+    // Views are copied only if they cannot be written right away
+    // (or when called from another thread), refcounted slices are
+    // kept until written
+    void send(SliceList&& slices_);
+    // The readable bytes of buf_, which is drained. Not copied
+    // in the loop thread, unless they can't be written right away
+    void send(ds::Buffer* buf_);
+    // len_ bytes of the file fd_ from offset_, streamed with sendfile(2)
+    // as the socket becomes writable: no copy to user space. Ordered
+    // with the other sends, the write complete callback fires once it
+    // is all written. fd_ is duplicated, the caller may close it
+    // right away. A file shorter than len_ ends the range early
+    void sendFile(int fd_, off_t offset_, size_t len_);
 
     // shutdown() is thread-safe TODO
     void shutdown();
 
+    // Edge-triggered IO, reads and writes until EAGAIN on every event.
+    // Only takes effect on an epoll loop, must be called before
+    // connectionEstablished()
+    void setEdgeTriggered(bool on_);
+    bool edgeTriggered() const
+    { return _edgeTriggered; }
+
     void enableTcpNoDelay();
     void disableTcpNoDelay();
 
     EventLoop* getLoop() { return _loop; }
+
+    // Moving average of the bytes per read, the input buffer
+    // is sized after it before every read
+    size_t readSizeAverage() const { return _readSizeAverage; }
+    // Room made in the input buffer before the next read: twice the
+    // average, at least Buffer::initialSize, so that the storage is a
+    // whole BufferPool size class
+    size_t readSizeHint() const;
+    // Reads which overflowed the input buffer (double copy)
+    uint64_t overflowReads() const { return _overflowReads; }
+    // Bytes and syscalls of the socket IO so far, thread-safe.
+    // The loop's LoopMetrics::io sums those of its connections
+    IOCounters::Snapshot ioStats() const { return _ioCounters.snapshot(); }
    private:
 
     // Register to EventDispatcher
     // for handling reading event
     void handleRead(oplib::Timestamp receiveTime_);
     void handleWrite();
+    // Once, later calls return right away
     void handleClose();
     void handleError();
+    // A write to the socket failed with errno_, not EWOULDBLOCK: the
+    // peer is gone (EPIPE, ECONNRESET) or the socket is broken, close
+    void handleWriteError(const char* where_, int errno_);
 
-    void sendInLoop(const std::string& message_);
+    void sendInLoop(const std::string& message_)
+    { sendInLoop(message_.data(), message_.size()); }
+    void sendInLoop(const char* data_, size_t len_);
+    void sendInLoop(SliceList& slices_);
+    // Closes the duplicated fd once the last range of it is written
+    typedef std::shared_ptr<const int> FilePtr;
+    void sendFileInLoop(const FilePtr& file_, off_t offset_, size_t len_);
     void shutdownInLoop();
+    void stopReadInLoop();
+    void startReadInLoop();
+
+    // Account a read/write syscall which returned n_
+    void countRead(ssize_t n_);
+    void countWrite(ssize_t n_);
+
+    // Read once into _inputBuffer, sized after _readSizeAverage
+    ssize_t readInput(int* savedErrno_);
+
+    bool hasPendingOutput();
+    size_t pendingOutputBytes() const
+    { return _outputBuffer.readableBytes() + _outputSliceBytes; }
+
+    // Queue data behind the pending output
+    void queueOutput(Slice&& slice_);
+    // Views in _outputSlices can't outlive send(), copy them
+    void ownOutputSlices();
+    // Write what send() just queued, on an idle connection: watch
+    // writing if the socket doesn't take it all
+    void flushQueuedOutput();
+    // writev the pending output, sendfile(2) when a file range is
+    // first, in edge-triggered mode until EAGAIN. Returns the result
+    // of the last syscall
+    ssize_t flushOutput();
+    ssize_t sendFileOutput();
+    void retrieveOutput(size_t len_);
+
+    // Water-mark crossings of the pending output in memory,
+    // file ranges don't count, after it grew and after it was written
+    void checkHighWaterMark();
+    void checkLowWaterMark();
+
+    // Keep the loop's Load::pendingOutputBytes in step with the output
+    void addLoadOutputBytes(int64_t delta_)
+    { _loop->load().pendingOutputBytes.fetch_add(delta_, std::memory_order_relaxed); }
+
+    static const int kMaxIovecs = 64;
+    static const size_t kDefaultHighWaterMark = 64 * 1024 * 1024;
+    // Edge-triggered reads handed to the MessageCallback at a time
+    static const size_t kMaxReadBatchBytes = 1024 * 1024;
 
     enum class State 
     { 
@@ -89,7 +218,10 @@ namespace oplib
     State _state;
 
     EventLoop* _loop;
-    const std::string _name;
+    const uint64_t _id;
+    const std::shared_ptr<const std::string> _namePrefix;
+    mutable std::once_flag _nameOnce;
+    mutable std::string _name;
 
     // TCPConnection owns _sock!
     // Need to close the socket when connection is closed
@@ -101,11 +233,57 @@ namespace oplib
     CloseCallback _closeCallback;
     MessageCallback _messageCallback;
     ConnectionEventCallback _writeCompleteCallback;
+    HighWaterMarkCallback _highWaterMarkCallback;
+    ConnectionEventCallback _lowWaterMarkCallback;
 
+    size_t _highWaterMark;
+    size_t _lowWaterMark;
+    // Reached the high-water mark, not yet back to the low one
+    bool _aboveHighWaterMark;
+    std::weak_ptr<TCPConnection> _throttledReader;
+
+    // Reading wanted, the dispatcher watches it while connected
+    std::atomic_bool _reading;
+    // handleClose() ran, the dispatcher must stay disabled
+    bool _closing;
+
+    bool _edgeTriggered;
     std::unique_ptr<EventDispatcher> _dispatcher;
 
+    size_t _readSizeAverage;
+    uint64_t _overflowReads;
+    IOCounters _ioCounters;
+
+    // Both buffers take their storage from the loop's BufferPool
     oplib::ds::Buffer _inputBuffer;
-    oplib::ds::Buffer _outputBuffer;
+    // Pending output: the bytes of _outputBuffer go first,
+    // then the refcounted slices. The output buffer is segmented,
+    // large pending responses are never moved nor reallocated
+    oplib::ds::SegmentedBuffer _outputBuffer;
+
+    // A slice of pending output, or a range of a file from sendFile()
+    struct OutputSlice
+    {
+      explicit OutputSlice(Slice&& slice_)
+      : slice(std::move(slice_)), fileOffset(0), fileBytes(0)
+      {}
+
+      OutputSlice(const FilePtr& file_, off_t offset_, size_t len_)
+      : slice(nullptr, 0), file(file_), fileOffset(offset_), fileBytes(len_)
+      {}
+
+      bool isFile() const { return file != nullptr; }
+      size_t size() const { return isFile() ? fileBytes : slice.size(); }
+
+      Slice slice;
+      FilePtr file;
+      off_t fileOffset;
+      size_t fileBytes;
+    };
+    std::deque<OutputSlice> _outputSlices;
+    // All the bytes of _outputSlices, and of their file ranges
+    size_t _outputSliceBytes;
+    size_t _outputFileBytes;
   };
 
   typedef std::shared_ptr<TCPConnection> TCPConnectionPtr;
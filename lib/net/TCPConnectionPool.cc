@@ -0,0 +1,202 @@
+#include "TCPConnectionPool.h"
+
+#include <log/Logging.h>
+
+#include <algorithm>
+#include <cassert>
+#include <stdio.h>
+
+using namespace oplib;
+
+namespace
+{
+  // Bound to a functor: the client is destroyed once the
+  // connection's own pending functors have run
+  void releaseClient(const std::shared_ptr<TCPClient>&)
+  {}
+}
+
+TCPConnectionPool::TCPConnectionPool(EventLoop* loop_,
+                                     const InetAddress& serverAddr_,
+                                     const std::string& name_,
+                                     size_t maxInFlight_,
+                                     size_t maxIdle_)
+: _loop(loop_),
+  _serverAddr(serverAddr_),
+  _name(name_),
+  _maxInFlight(std::max<size_t>(maxInFlight_, 1)),
+  _maxIdle(maxIdle_),
+  _connectTimeout(3.0),
+  _nextClientId(1),
+  _connecting(0)
+{
+}
+
+TCPConnectionPool::~TCPConnectionPool()
+{
+  _loop->inLoopThreadOrDie();
+  _connectTimers.forEach([this] (TCPClient*, TimerId& timerId_) {
+    _loop->cancel(timerId_);
+  });
+  _waiting.clear();
+  _idle.clear();
+  // The clients shut their connections down
+  _clients.clear();
+}
+
+void TCPConnectionPool::acquire(AcquireCallback&& cb_)
+{
+  _loop->inLoopThreadOrDie();
+  while (!_idle.empty())
+  {
+    TCPConnectionPtr conn = std::move(_idle.back());
+    _idle.pop_back();
+    if (conn->connected())
+    {
+      cb_(conn);
+      return;
+    }
+  }
+
+  _waiting.push_back(std::move(cb_));
+  connectIfNeeded();
+}
+
+void TCPConnectionPool::release(const TCPConnectionPtr& conn_)
+{
+  _loop->inLoopThreadOrDie();
+  if (conn_->connected())
+  {
+    dispatch(conn_);
+  }
+  else
+  {
+    // Closed while in use, the waiting requests may need a new one
+    connectIfNeeded();
+  }
+}
+
+void TCPConnectionPool::dispatch(const TCPConnectionPtr& conn_)
+{
+  if (!_waiting.empty())
+  {
+    AcquireCallback cb = std::move(_waiting.front());
+    _waiting.pop_front();
+    cb(conn_);
+  }
+  else if (_idle.size() < _maxIdle)
+  {
+    _idle.push_back(conn_);
+  }
+  else
+  {
+    // onConnection drops its client once it is closed
+    conn_->shutdown();
+  }
+}
+
+void TCPConnectionPool::connectIfNeeded()
+{
+  using namespace std::placeholders;
+  while (_waiting.size() > _connecting && _clients.size() < _maxInFlight)
+  {
+    char clientId[32];
+    snprintf(clientId, sizeof(clientId), "#%lu", static_cast<unsigned long>(_nextClientId++));
+    auto client = std::make_shared<TCPClient>(_loop, _serverAddr, _name + clientId);
+    client->setConnectionCallback(
+      std::bind(&TCPConnectionPool::onConnection, this, client.get(), _1));
+    client->setMessageCallback(
+      std::bind(&TCPConnectionPool::onMessage, this, _1, _2, _3));
+
+    _clients.insert(client.get(), client);
+    ++_connecting;
+    _connectTimers.insert(client.get(), _loop->runAfter(_connectTimeout,
+      std::bind(&TCPConnectionPool::connectTimedOut, this, client.get())));
+    client->connect();
+  }
+}
+
+void TCPConnectionPool::cancelConnectTimer(TCPClient* client_)
+{
+  TimerId* timerId = _connectTimers.find(client_);
+  if (timerId != nullptr)
+  {
+    _loop->cancel(*timerId);
+    _connectTimers.erase(client_);
+  }
+}
+
+void TCPConnectionPool::connectTimedOut(TCPClient* client_)
+{
+  // The timer is cancelled when the client connects or goes
+  _connectTimers.erase(client_);
+  assert(_clients.find(client_) != nullptr);
+  LOG_WARN("TCPConnectionPool %s: %s not connected after %.3fs, dropped",
+           _name.c_str(), client_->name().c_str(), _connectTimeout);
+  // Not called by the client: it can go right now, stopping its connector
+  _clients.erase(client_);
+  assert(_connecting > 0);
+  --_connecting;
+
+  if (_clients.size() > _connecting)
+  {
+    // The server takes connections: the waiting requests
+    // get released ones, or a new attempt
+    connectIfNeeded();
+    return;
+  }
+
+  // Unreachable: fail the requests no other attempt is for. Taken out
+  // first, their callbacks may acquire again
+  std::deque<AcquireCallback> failed;
+  while (_waiting.size() > _connecting)
+  {
+    failed.push_back(std::move(_waiting.front()));
+    _waiting.pop_front();
+  }
+  for (auto& cb : failed)
+  {
+    cb(TCPConnectionPtr());
+  }
+}
+
+void TCPConnectionPool::onConnection(TCPClient* client_, const TCPConnectionPtr& conn_)
+{
+  _loop->inLoopThreadOrDie();
+  if (conn_->connected())
+  {
+    assert(_connecting > 0);
+    --_connecting;
+    cancelConnectTimer(client_);
+    dispatch(conn_);
+    return;
+  }
+
+  auto idle = std::find(_idle.begin(), _idle.end(), conn_);
+  if (idle != _idle.end())
+  {
+    _idle.erase(idle);
+  }
+
+  TCPClientPtr* client = _clients.find(client_);
+  if (client != nullptr)
+  {
+    // Called by the connection itself, the client can't go right now
+    _loop->enqueue(std::bind(releaseClient, *client));
+    _clients.erase(client_);
+  }
+  connectIfNeeded();
+}
+
+void TCPConnectionPool::onMessage(const TCPConnectionPtr& conn_, ds::Buffer* buf_,
+                                  Timestamp receiveTime_)
+{
+  if (_messageCallback)
+  {
+    _messageCallback(conn_, buf_, receiveTime_);
+  }
+  else
+  {
+    buf_->retrieveAll();
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef OPLIB_TCPCONNECTIONPOOL_H
+#define OPLIB_TCPCONNECTIONPOOL_H
+
+#include "InetAddress.h"
+#include "Types.h"
+#include "TCPClient.h"
+#include "TimerManager.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ds/FlatHashMap.h>
+#include <util/Common.h>
+
+namespace oplib
+{
+  // Connections of one loop to one server. A request acquires a
+  // connection, idle ones first so it reuses an established connection
+  // instead of a new handshake, and releases it when its response is in.
+  // At most maxInFlight_ connections are open, further requests wait for
+  // a release. A connection not established within the connect timeout
+  // is given up, and if the server can't be reached the waiting requests
+  // fail. Not thread-safe: everything runs in the loop thread, a
+  // request never hops to another thread. Use one pool per loop.
+  class TCPConnectionPool : Noncopyable
+  {
+   public:
+    // Called in the loop thread with an established connection,
+    // the request owns it until release(). With nullptr if no
+    // connection could be made within the connect timeout
+    typedef std::function<void (const TCPConnectionPtr&)> AcquireCallback;
+
+    TCPConnectionPool(EventLoop* loop_,
+                      const InetAddress& serverAddr_,
+                      const std::string& name_,
+                      size_t maxInFlight_,
+                      size_t maxIdle_);
+    ~TCPConnectionPool();
+
+    // Messages of all the connections of the pool
+    void setMessageCallback(const MessageCallback& cb_)
+    { _messageCallback = cb_; }
+
+    // Time a new connection has to be established, 3s by default.
+    // Its client is then dropped; if no other connection is open the
+    // requests waiting for one get nullptr
+    void setConnectTimeout(double seconds_)
+    { _connectTimeout = seconds_; }
+
+    // Runs cb_ right away with an idle connection, after the handshake
+    // with a new one, or after a release when maxInFlight_ is reached
+    void acquire(AcquireCallback&& cb_);
+
+    // Back to the idle connections, or straight to a waiting request.
+    // Beyond maxIdle_ idle connections it is shut down
+    void release(const TCPConnectionPtr& conn_);
+
+    size_t numConnections() const { return _clients.size(); }
+    size_t numIdle() const { return _idle.size(); }
+    size_t numWaiting() const { return _waiting.size(); }
+
+   private:
+    typedef std::shared_ptr<TCPClient> TCPClientPtr;
+
+    // Open a connection if requests wait and the limit allows it
+    void connectIfNeeded();
+    void onConnection(TCPClient* client_, const TCPConnectionPtr& conn_);
+    void connectTimedOut(TCPClient* client_);
+    void cancelConnectTimer(TCPClient* client_);
+    void onMessage(const TCPConnectionPtr& conn_, ds::Buffer* buf_, Timestamp receiveTime_);
+    // Hand conn_ to the next request, or keep it idle
+    void dispatch(const TCPConnectionPtr& conn_);
+
+    EventLoop* _loop;
+    const InetAddress _serverAddr;
+    const std::string _name;
+    const size_t _maxInFlight;
+    const size_t _maxIdle;
+    double _connectTimeout;
+    MessageCallback _messageCallback;
+
+    uint64_t _nextClientId;
+    // One client per connection, established or connecting
+    ds::FlatHashMap<TCPClient*, TCPClientPtr> _clients;
+    size_t _connecting;
+    // Timeout of each connecting client
+    ds::FlatHashMap<TCPClient*, TimerId> _connectTimers;
+    // Most recently released last: the warmest connection is reused first
+    std::vector<TCPConnectionPtr> _idle;
+    std::deque<AcquireCallback> _waiting;
+  };
+}
+
+#endif
@@ -1,21 +1,17 @@
 #include "TCPServer.h"
 #include "SocketUtils.h"
 
-#include <sstream>
-#include <cstdio>
+#include <cstring>
 
 using namespace oplib;
 
 TCPServer::TCPServer(EventLoop* loop_, const InetAddress& address_, const std::string name_, int nThreads_)
 : _loop(loop_), _name(name_ + "_" + address_.toHostPort()),
-  _listener(std::make_unique<Listener>(_loop, address_)),
-  _started(false), _nextConnId(1),
+  _connNamePrefix(std::make_shared<const std::string>(_name)),
+  _listenAddr(address_),
+  _started(false), _edgeTriggered(false), _reusePort(false), _nextConnId(1),
   _threadPool(std::make_unique<EventLoopThreadPool>(_loop))
 {
-  // Listener will call TCPServer::newConnection to establish 
-  // the TCPConnection
-  _listener->setNewConnectionCallback(std::bind(&TCPServer::newConnection, this,
-    std::placeholders::_1, std::placeholders::_2));
   _threadPool->setNumThreads(nThreads_);
 }
 
@@ -24,16 +20,81 @@ TCPServer::~TCPServer()
 
 void TCPServer::start()
 {
+  using namespace std::placeholders;
   if (!_started)
   {
     _started = true;
     _threadPool->start();
+
+    for (EventLoop* ioLoop : _threadPool->getAllLoops())
+    {
+      auto shard = std::make_unique<ConnectionShard>();
+      shard->_loop = ioLoop;
+      _shardOfLoop.insert(ioLoop, shard.get());
+      _shards.push_back(std::move(shard));
+    }
+
+    if (_reusePort)
+    {
+      // The kernel balances the connections among the loops
+      for (auto& shard : _shards)
+      {
+        EventLoop* ioLoop = shard->_loop;
+        auto listener = std::make_unique<Listener>(ioLoop, _listenAddr, true);
+        listener->setNewConnectionCallback(
+          std::bind(&TCPServer::newConnectionInLoop, this, shard.get(), _1, _2));
+        ioLoop->runInLoop(std::bind(&Listener::listen, listener.get()));
+        _listeners.push_back(std::move(listener));
+      }
+    }
+    else
+    {
+      // Listener will call TCPServer::newConnection to establish
+      // the TCPConnection
+      auto listener = std::make_unique<Listener>(_loop, _listenAddr);
+      listener->setNewConnectionCallback(
+        std::bind(&TCPServer::newConnection, this, _1, _2));
+      // Run in loop, so start() can be called from another thread
+      _loop->runInLoop(std::bind(&Listener::listen, listener.get()));
+      _listeners.push_back(std::move(listener));
+    }
   }
-  if (!_listener->listening())
+}
+
+TCPConnectionPtr TCPServer::createConnection(ConnectionShard* shard_, std::unique_ptr<Socket> sock_,
+                                             const InetAddress& peerAddress_)
+{
+  // localaddr is the newly created address at local host for the incoming connection
+  InetAddress localAddr(socketutils::getLocalAddr(sock_->fd()));
+
+  // std::make_shared is used to save one memory allocation
+  // Connection name is TCPServer name(ip + port) + conn ID, formatted on demand
+  TCPConnectionPtr conn(std::make_shared<TCPConnection>(shard_->_loop, _nextConnId++, _connNamePrefix,
+                                                        std::move(sock_), localAddr, peerAddress_));
+  conn->setConnectionCallback(_connectionCallback);
+  conn->setMessageCallback(_messageCallback);
+  conn->setCloseCallback(std::bind(&TCPServer::removeConnection, this, shard_, std::placeholders::_1));
+  conn->setWriteCompleteCallback(_writeCompleteCallback);
+  conn->setEdgeTriggered(_edgeTriggered);
+  return conn;
+}
+
+AcceptStats TCPServer::acceptStats() const
+{
+  AcceptStats result;
+  ::memset(&result, 0, sizeof(result));
+  for (auto& listener : _listeners)
   {
-    // Run in loop, so start() can be called from another thread
-    _loop->runInLoop(std::bind(&Listener::listen, _listener.get()));
+    const AcceptStats stats = listener->acceptStats();
+    result.wakeups += stats.wakeups;
+    result.accepted += stats.accepted;
+    result.rejected += stats.rejected;
+    for (int i = 0; i < AcceptStats::kBatchBuckets; ++i)
+    {
+      result.batches[i] += stats.batches[i];
+    }
   }
+  return result;
 }
 
 void TCPServer::newConnection(std::unique_ptr<Socket> sock_, const InetAddress& peerAddress_)
@@ -42,51 +103,55 @@ void TCPServer::newConnection(std::unique_ptr<Socket> sock_, const InetAddress&
   // This should be called in the loop thread
   _loop->inLoopThreadOrDie();
 
-  std::ostringstream oss;
-  oss << _name << "_" << _nextConnId;
-  ++_nextConnId; // increment the connId so connNames are identical
-
-  // Connection name is TCPServer name(ip + port) + conn ID
-  const std::string connName = oss.str();
-  
-  // localaddr is the newly created address at local host for the incoming connection
-  InetAddress localAddr(socketutils::getLocalAddr(sock_->fd()));
-
   EventLoop* dispatchedLoop = _threadPool->getNextLoop();
+  ConnectionShard** found = _shardOfLoop.find(dispatchedLoop);
+  assert(found != nullptr);
+  ConnectionShard* shard = *found;
+
+  // Counted now, so the placement decisions taken before the loop
+  // creates the connection see it. The connection counts itself
+  // once created, and this count is dropped
+  std::atomic_int& connections = dispatchedLoop->load().connections;
+  connections.fetch_add(1, std::memory_order_relaxed);
+
+  // The only hop to another thread: the connection is created by
+  // dispatchedLoop, so its memory is first touched on its NUMA node
+  dispatchedLoop->runInLoop(
+    [this, shard, &connections, sock = std::move(sock_), peerAddress_] () mutable {
+      newConnectionInLoop(shard, std::move(sock), peerAddress_);
+      connections.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
 
-  // std::make_shared is used to save one memory allocation
-  TCPConnectionPtr conn(std::make_shared<TCPConnection>(dispatchedLoop, connName, std::move(sock_),
-                                                        localAddr, peerAddress_));
-  // Log here
-  printf("Connection name is %s\n", connName.c_str());
-  assert(_connections.count(connName) == 0);
-  _connections[connName] = conn;
-  auto cnt = _connections.count(connName);
-  assert(cnt == 1);
-  conn->setConnectionCallback(_connectionCallback);
-  conn->setMessageCallback(_messageCallback);
-  conn->setCloseCallback(std::bind(&TCPServer::removeConnection, this, std::placeholders::_1));
-  conn->setWriteCompleteCallback(_writeCompleteCallback);
-
-  // This will call the _connectionCallback
-  dispatchedLoop->runInLoop(std::bind(&TCPConnection::connectionEstablished, conn));
-} 
+void TCPServer::newConnectionInLoop(ConnectionShard* shard_, std::unique_ptr<Socket> sock_,
+                                    const InetAddress& peerAddress_)
+{
+  shard_->_loop->inLoopThreadOrDie();
+  TCPConnectionPtr conn = createConnection(shard_, std::move(sock_), peerAddress_);
+  establishConnection(shard_, conn);
+}
 
-void TCPServer::removeConnection(const TCPConnectionPtr& conn_)
+void TCPServer::establishConnection(ConnectionShard* shard_, const TCPConnectionPtr& conn_)
 {
-  _loop->runInLoop(std::bind(&TCPServer::removeConnectionInLoop, this, conn_));
+  shard_->_loop->inLoopThreadOrDie();
+  bool inserted = shard_->_connections.insert(conn_->id(), conn_);
+  assert(inserted);
+  UNUSED(inserted);
+
+  // This will call the _connectionCallback
+  conn_->connectionEstablished();
 }
 
-void TCPServer::removeConnectionInLoop(const TCPConnectionPtr& conn_)
+void TCPServer::removeConnection(ConnectionShard* shard_, const TCPConnectionPtr& conn_)
 {
-  _loop->inLoopThreadOrDie();
-  auto n = _connections.erase(conn_->name());
+  shard_->_loop->inLoopThreadOrDie();
+  auto n = shard_->_connections.erase(conn_->id());
   assert(n == 1);
   UNUSED(n);
 
-  EventLoop* dispatchedLoop = conn_->getLoop();
-
+  // Still in the middle of the connection's handleEvent: close it once
+  // the event is handled. Same thread, the loop is not woken up.
   // Extend the lifetime of conn_ to connectionClosed is called
-  dispatchedLoop->enqueue(std::bind(&TCPConnection::connectionClosed, conn_));
+  shard_->_loop->enqueue(std::bind(&TCPConnection::connectionClosed, conn_));
 }
 
@@ -7,10 +7,12 @@
 #include "Listener.h"
 #include "EventLoopThreadPool.h"
 
+#include <atomic>
 #include <string>
-#include <map>
 #include <memory>
+#include <vector>
 
+#include <ds/FlatHashMap.h>
 #include <util/Common.h>
 
 namespace oplib
@@ -42,21 +44,88 @@ namespace oplib
     void setNumThreads(int nThreads_)
     { _threadPool->setNumThreads(nThreads_); }
 
+    // CPUs of the IO threads, see EventLoopThreadPool::setThreadCpus
+    void setThreadCpus(const std::vector<std::vector<int>>& cpus_)
+    { _threadPool->setThreadCpus(cpus_); }
+
+    // Poller backend of the IO loops, must be called before start()
+    void setPollerType(PollerType type_)
+    { _threadPool->setPollerType(type_); }
+
+    // Timer storage of the IO loops, must be called before start()
+    void setTimerQueueType(TimerQueueType type_)
+    { _threadPool->setTimerQueueType(type_); }
+
+    // Busy polling of the IO loops, or of the loop of the server
+    // without IO threads, see EventLoop::setBusyPoll()
+    void setBusyPoll(int64_t spinMicroSeconds_)
+    { _threadPool->setBusyPoll(spinMicroSeconds_); }
+
+    // Which IO loop gets a new connection, see PlacementPolicy.
+    // Not used with SO_REUSEPORT: the kernel picks the listener
+    void setPlacementPolicy(PlacementPolicy policy_)
+    { _threadPool->setPlacementPolicy(policy_); }
+
+    void setLoopSelector(const EventLoopThreadPool::LoopSelector& selector_)
+    { _threadPool->setLoopSelector(selector_); }
+
+    // Edge-triggered IO for new connections, needs PollerType::EPOLL
+    void setEdgeTriggered(bool on_)
+    { _edgeTriggered = on_; }
+
+    // Every IO loop gets its own SO_REUSEPORT listening socket and
+    // accepts its connections itself, instead of a single listener in
+    // the master loop handing them out. Must be called before start()
+    void setReusePort(bool on_)
+    { _reusePort = on_; }
+
+    // Summed over the listeners, from any thread. With SO_REUSEPORT
+    // the IO loops count while this reads: approximate
+    AcceptStats acceptStats() const;
+
+    // The IO loops once started, e.g. to scrape their metrics()
+    std::vector<EventLoop*> ioLoops()
+    { return _threadPool->getAllLoops(); }
+
    private:
     
     // Register to Listener, called when new connection is accepted
     // sock_ is the created socket, address_ is the peer address
     void newConnection(std::unique_ptr<Socket> sock_, const InetAddress& address_);
 
-    void removeConnection(const TCPConnectionPtr& conn_);
-    void removeConnectionInLoop(const TCPConnectionPtr& conn_);
-
     // Store connections
-    using ConnectionMap = std::map<std::string, TCPConnectionPtr>;
+    using ConnectionMap = ds::FlatHashMap<uint64_t, TCPConnectionPtr>;
+
+    // The connections of one IO loop, only touched in that loop's
+    // thread: registration and teardown never leave the loop
+    struct ConnectionShard
+    {
+      EventLoop* _loop;
+      ConnectionMap _connections;
+    };
+
+    // Create the connection of sock_ and establish it in shard_, in
+    // its loop's thread: for the SO_REUSEPORT listener of shard_, and
+    // for newConnection() after the hop to the chosen loop
+    void newConnectionInLoop(ConnectionShard* shard_, std::unique_ptr<Socket> sock_,
+                             const InetAddress& address_);
+    // Register conn_ in shard_ and call the _connectionCallback
+    void establishConnection(ConnectionShard* shard_, const TCPConnectionPtr& conn_);
+
+    TCPConnectionPtr createConnection(ConnectionShard* shard_, std::unique_ptr<Socket> sock_,
+                                      const InetAddress& address_);
+
+    // Close callback of the connections, in their loop's thread
+    void removeConnection(ConnectionShard* shard_, const TCPConnectionPtr& conn_);
 
     EventLoop* _loop;
     const std::string _name;
-    std::unique_ptr<Listener> _listener;
+    // Shared by the connections to format their names lazily
+    const std::shared_ptr<const std::string> _connNamePrefix;
+    const InetAddress _listenAddr;
+    // One listener in the master loop, or one per IO loop
+    // with SO_REUSEPORT. Created by start()
+    std::vector<std::unique_ptr<Listener>> _listeners;
 
     // To be passed to TCPConnections
     ConnectionCallback _connectionCallback;
@@ -64,8 +133,12 @@ namespace oplib
     ConnectionEventCallback _writeCompleteCallback;
 
     bool _started;
-    int _nextConnId;
-    ConnectionMap _connections;
+    bool _edgeTriggered;
+    bool _reusePort;
+    std::atomic<uint64_t> _nextConnId;
+    // One per IO loop, or one for the master loop. Created by start()
+    std::vector<std::unique_ptr<ConnectionShard>> _shards;
+    ds::FlatHashMap<EventLoop*, ConnectionShard*> _shardOfLoop;
     std::unique_ptr<EventLoopThreadPool> _threadPool;
   };
 }
@@ -0,0 +1,138 @@
+#include "TimerHeap.h"
+#include "TimerManager.h"
+
+#include <cassert>
+#include <algorithm>
+
+namespace oplib
+{
+  TimerHeap::TimerHeap()
+  {}
+
+  TimerHeap::~TimerHeap()
+  {}
+
+  bool TimerHeap::less(size_t i, size_t j) const
+  {
+    return _heap[i]->expireTime() < _heap[j]->expireTime();
+  }
+
+  void TimerHeap::place(Timer* timer_, size_t index_)
+  {
+    _heap[index_] = timer_;
+    timer_->_index = static_cast<int>(index_);
+  }
+
+  void TimerHeap::siftUp(size_t index_)
+  {
+    Timer* timer = _heap[index_];
+    while (index_ > 0)
+    {
+      size_t p = parent(index_);
+      if (!(timer->expireTime() < _heap[p]->expireTime()))
+      {
+        break;
+      }
+      place(_heap[p], index_);
+      index_ = p;
+    }
+    place(timer, index_);
+  }
+
+  void TimerHeap::siftDown(size_t index_)
+  {
+    Timer* timer = _heap[index_];
+    const size_t n = _heap.size();
+    while (true)
+    {
+      size_t child = firstChild(index_);
+      if (child >= n)
+      {
+        break;
+      }
+
+      // Smallest of the (up to) kArity children
+      size_t smallest = child;
+      const size_t last = std::min(child + kArity, n);
+      for (++child; child < last; ++child)
+      {
+        if (less(child, smallest))
+        {
+          smallest = child;
+        }
+      }
+
+      if (!(_heap[smallest]->expireTime() < timer->expireTime()))
+      {
+        break;
+      }
+      place(_heap[smallest], index_);
+      index_ = smallest;
+    }
+    place(timer, index_);
+  }
+
+  void TimerHeap::insert(Timer* timer_)
+  {
+    assert(timer_->_index < 0);
+    _heap.push_back(timer_);
+    siftUp(_heap.size() - 1);
+  }
+
+  void TimerHeap::remove(Timer* timer_)
+  {
+    assert(timer_->_index >= 0);
+    assert(_heap[timer_->_index] == timer_);
+    removeAt(static_cast<size_t>(timer_->_index));
+  }
+
+  void TimerHeap::removeAt(size_t index_)
+  {
+    Timer* timer = _heap[index_];
+    Timer* last = _heap.back();
+    _heap.pop_back();
+    if (last != timer)
+    {
+      // Fill the hole with the last element and restore the heap
+      place(last, index_);
+      if (index_ > 0 && last->expireTime() < _heap[parent(index_)]->expireTime())
+      {
+        siftUp(index_);
+      }
+      else
+      {
+        siftDown(index_);
+      }
+    }
+    timer->_index = -1;
+  }
+
+  void TimerHeap::advance(Timestamp now_, std::vector<Timer*>* expired_)
+  {
+    while (!_heap.empty() && !(now_ < _heap.front()->expireTime()))
+    {
+      Timer* timer = _heap.front();
+      removeAt(0);
+      expired_->push_back(timer);
+    }
+  }
+
+  void TimerHeap::removeAll(std::vector<Timer*>* timers_)
+  {
+    for (Timer* timer : _heap)
+    {
+      timer->_index = -1;
+      timers_->push_back(timer);
+    }
+    _heap.clear();
+  }
+
+  Timestamp TimerHeap::nextExpiration() const
+  {
+    if (_heap.empty())
+    {
+      return Timestamp::epochTime();
+    }
+    return _heap.front()->expireTime();
+  }
+}
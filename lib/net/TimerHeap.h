@@ -0,0 +1,49 @@
+#ifndef OPLIB_TIMERHEAP_H
+#define OPLIB_TIMERHEAP_H
+
+#include "TimerQueue.h"
+
+#include <vector>
+
+namespace oplib
+{
+  // 4-ary min heap ordered by expire time. Like MinHeap keeps
+  // _keyIndex, every timer keeps its own position in Timer::_index,
+  // so remove() is O(log n) without any lookup. A 4-ary heap is
+  // shallower than a binary one and its children share a cache line
+  class TimerHeap : public TimerQueue
+  {
+   public:
+    TimerHeap();
+    ~TimerHeap() override;
+
+    void insert(Timer* timer_) override;
+    void remove(Timer* timer_) override;
+
+    void advance(Timestamp now_, std::vector<Timer*>* expired_) override;
+    void removeAll(std::vector<Timer*>* timers_) override;
+
+    Timestamp nextExpiration() const override;
+
+    size_t size() const override { return _heap.size(); }
+
+   private:
+    static const size_t kArity = 4;
+
+    static size_t parent(size_t i)
+    { return (i - 1) / kArity; }
+
+    static size_t firstChild(size_t i)
+    { return i * kArity + 1; }
+
+    bool less(size_t i, size_t j) const;
+    void place(Timer* timer_, size_t index_);
+    void siftUp(size_t index_);
+    void siftDown(size_t index_);
+    void removeAt(size_t index_);
+
+    std::vector<Timer*> _heap;
+  };
+}
+
+#endif
@@ -9,12 +9,15 @@
 #include <cstdio>
 #include <iostream>
 #include <algorithm>
-#include <iterator>
 #include <functional>
+#include <errno.h>
+#include <string.h>
+
+#include <log/Logging.h>
 
 namespace oplib
 {
-  std::atomic<int> Timer::_sequence { 0 };
+  const size_t TimerManager::kChunkSize = 64;
 
   namespace timerfd
   {
@@ -23,43 +26,60 @@ namespace oplib
       int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
       if (timerfd < 0)
       {
-        // TODO if timerfd < 0 log error and abort
-        printf("create timerfd error\n");
-        abort();
+        LOG_FATAL("timerfd_create error: %s", ::strerror(errno));
       }
       return timerfd;
     }
   }
 
-  TimerManager::TimerManager(EventLoop* loop_)
-  : _loop(loop_), _timerfd(timerfd::createTimerfd()), _dispatcher(loop_, _timerfd)
+  TimerManager::TimerManager(EventLoop* loop_, TimerQueueType type_)
+  : _loop(loop_), _timerfd(timerfd::createTimerfd()), _dispatcher(loop_, _timerfd),
+    _timers(TimerQueue::newTimerQueue(type_, Timestamp::now()))
   {
     // Callback called by loop is the handleRead() method defined in TimerManager
+    _dispatcher.setType(DispatcherType::TIMER);
     _dispatcher.setReadCallback(std::bind(&TimerManager::handleRead, this));
     _dispatcher.enableReading();
   }
 
   TimerManager::~TimerManager()
   {
+    // The timers themselves are owned by the pool
+    TimerList pending;
+    _timers->removeAll(&pending);
     ::close(_timerfd);
   }
 
-  TimerManager::TimerList TimerManager::expiredTimers(Timestamp current_)
+  Timer* TimerManager::allocate()
   {
-    assert(_timers.size() == _activeTimers.size());
-    std::vector<std::shared_ptr<Timer>> expireds;
-    auto iter = _timers.lower_bound(current_);
-    assert(iter == _timers.end() || current_ < iter->first);
-    std::for_each(_timers.begin(), iter, [ &expireds ](auto& kv) {
-              expireds.push_back(kv.second);
-            });
-    _timers.erase(_timers.begin(), iter);
-    std::for_each(expireds.begin(), expireds.end(), [ this ](auto& ptr) {
-              _activeTimers.erase(TimerId(ptr, ptr->id()));
-            });
-
-    assert(_timers.size() == _activeTimers.size());
-    return expireds;
+    if (_freeTimers.empty())
+    {
+      _chunks.emplace_back(new Timer[kChunkSize]);
+      Timer* chunk = _chunks.back().get();
+      for (size_t i = kChunkSize; i > 0; --i)
+      {
+        _freeTimers.push_back(&chunk[i - 1]);
+      }
+    }
+    Timer* timer = _freeTimers.back();
+    _freeTimers.pop_back();
+    return timer;
+  }
+
+  Timer* TimerManager::adopt(std::unique_ptr<Timer> timer_)
+  {
+    // Created by another thread, the pool owns it from now on
+    _adopted.push_back(std::move(timer_));
+    return _adopted.back().get();
+  }
+
+  void TimerManager::release(Timer* timer_)
+  {
+    assert(!timer_->active());
+    ++timer_->_generation;
+    // Drop whatever the callback holds
+    timer_->_timerCallback = nullptr;
+    _freeTimers.push_back(timer_);
   }
 
   void TimerManager::handleRead()
@@ -70,69 +90,93 @@ namespace oplib
     // Level trigger, we need to read _timerfd
     uint64_t timeoutCount;
     ssize_t numRead = ::read(_timerfd, &timeoutCount, sizeof(timeoutCount));
+    _armedExpiration = Timestamp::epochTime();
 
-    auto expireds = expiredTimers(Timestamp::now());
+    TimerList expireds;
+    Timestamp now(Timestamp::now());
+    _timers->advance(now, &expireds);
 
     // When executing timers, cancelInLoop could be called to cancel
-    // some timers which is being executed(in expireds)
-    // we need to mark these and not resetting them
-    _executingExpiredTimers = true;
-    _cancelledTimers.clear();
-
+    // some timers which are being executed(in expireds), they are
+    // marked as cancelled and neither run nor restarted
+    Histogram& lateness = _loop->metrics().timerLateness;
     std::for_each(expireds.begin(), expireds.end(),
-                  [](auto& timerp) {
-                    timerp->run();
+                  [now, &lateness](Timer* timer) {
+                    if (!timer->cancelled())
+                    {
+                      lateness.record(std::max<int64_t>(now - timer->expireTime(), 0));
+                      timer->run();
+                    }
                   });
-    _executingExpiredTimers = false;
 
     reset(expireds);
   }
 
   void TimerManager::reset(const TimerList& timerlist_)
   {
-    for (auto& timerptr : timerlist_)
+    for (Timer* timer : timerlist_)
     {
-      auto iter = _cancelledTimers.find(TimerId(timerptr, timerptr->id()));
-      if (timerptr->repeating() && iter == _cancelledTimers.end())
+      if (timer->repeating() && !timer->cancelled())
+      {
+        timer->restart(Timestamp::now());
+        insert(timer);
+      }
+      else
       {
-        timerptr->restart(Timestamp::now());
-        insert(timerptr);
+        release(timer);
       }
     }
 
-    if (!_timers.empty())
+    if (!_timers->empty())
     {
       resetTimerfd();
     }
   }
 
-  bool TimerManager::insert(const std::shared_ptr<Timer>& timerptr_)
+  bool TimerManager::insert(Timer* timer_)
+  {
+    coalesce(timer_);
+
+    // The timerfd only needs to be reprogrammed if the new
+    // timer expires before the time it is currently armed for
+    bool firstExpireChanged = !_armedExpiration.valid() ||
+                              timer_->expireTime() < _armedExpiration;
+    _timers->insert(timer_);
+    return firstExpireChanged;
+  }
+
+  void TimerManager::coalesce(Timer* timer_)
   {
-    assert(_timers.size() == _activeTimers.size());
-    bool firstExpireChanged = false;
-    auto first = _timers.begin();
-    if (first == _timers.end() || timerptr_->expireTime() < first->second->expireTime())
+    if (timer_->_slack <= 0) return;
+
+    const int64_t when = timer_->_when.microseconds();
+    const int64_t limit = when + timer_->_slack;
+    Timestamp armed(_armedExpiration);
+    if (_armedExpiration.valid() &&
+        when <= armed.microseconds() && armed.microseconds() <= limit)
     {
-      firstExpireChanged = true;
+      // The timerfd is already armed inside the window, join that expiration
+      timer_->_when = _armedExpiration;
+      return;
     }
 
-    // Insert into a multimap always succeeds
-    _timers.insert(std::pair<Timestamp, std::shared_ptr<Timer>>
-            (timerptr_->expireTime(), timerptr_));
-    _activeTimers.insert(TimerId(timerptr_, timerptr_->id()));
-
-    assert(_timers.size() == _activeTimers.size());
-    return firstExpireChanged;
+    // Round up to the coarsest time boundary inside the window, timers
+    // with similar windows end up on the same expiration (the way the
+    // classic Linux timer wheel applies slack)
+    const int64_t mask = when ^ limit;
+    const int bit = 63 - __builtin_clzll(static_cast<uint64_t>(mask));
+    timer_->_when = Timestamp(limit & ~((int64_t(1) << bit) - 1));
   }
 
   void TimerManager::resetTimerfd()
   {
-    assert(!_timers.empty());
-    Timestamp expire = _timers.begin()->first;
+    assert(!_timers->empty());
+    Timestamp expire = _timers->nextExpiration();
 
     // Must be a valid time in the future
     if (!expire.valid()) return;
-    
+    _armedExpiration = expire;
+
     struct itimerspec oldValue;
     struct itimerspec newValue;
     bzero(&oldValue, sizeof(oldValue));
@@ -146,26 +190,55 @@ namespace oplib
         static_cast<long>((gap % Timestamp::numMicroSecondsInSeconds) * 1000);
     auto ret = ::timerfd_settime(_timerfd, 0, &newValue, &oldValue);
     assert(ret == 0);
+    _loop->metrics().timerfdArms.add(1);
   }
 
-  void TimerManager::addTimerInLoop(const std::shared_ptr<Timer>& timer_)
+  void TimerManager::addTimerInLoop(std::unique_ptr<Timer> timer_)
   {
     // Only executed in loop thread
     _loop->inLoopThreadOrDie();
-    bool needReset = insert(timer_);
+    Timer* timer = adopt(std::move(timer_));
+    if (timer->cancelled())
+    {
+      // Cancelled before it got the chance to be added
+      release(timer);
+      return;
+    }
+    bool needReset = insert(timer);
     if (needReset)
     {
       resetTimerfd();
     }
   }
 
-  TimerId TimerManager::addTimer(const TimerCallback& cb_, Timestamp when_, double interval_)
+  TimerId TimerManager::addTimer(TimerCallback&& cb_, Timestamp when_,
+                                 double interval_, double slack_)
   {
-    // This method can only be called from EventLoop
-    // TODO: make it more thread-safe_loop->inLoopThreadOrDie();
-    auto timerptr = std::make_shared<Timer>(cb_, when_, interval_);
-    _loop->runInLoop(std::bind(&TimerManager::addTimerInLoop, this, timerptr)); 
-    return TimerId(timerptr, timerptr->id());
+    if (_loop->inLoopThread())
+    {
+      // Common case: take a timer from the pool, no allocation
+      Timer* timer = allocate();
+      timer->init(std::move(cb_), when_, interval_, slack_);
+      if (insert(timer))
+      {
+        resetTimerfd();
+      }
+      return TimerId(timer, timer->_generation);
+    }
+
+    // The pool belongs to the loop thread, allocate the timer here
+    // and let the loop adopt it. Owned by the functor until then: freed
+    // with it if the loop is destroyed before running it
+    std::unique_ptr<Timer> owned(new Timer);
+    Timer* timer = owned.get();
+    timer->init(std::move(cb_), when_, interval_, slack_);
+    // Once handed over, the loop may fire and recycle the timer
+    // before runInLoop() returns: don't touch it anymore
+    const uint32_t generation = timer->_generation;
+    _loop->runInLoop([this, owned = std::move(owned)] () mutable {
+      addTimerInLoop(std::move(owned));
+    });
+    return TimerId(timer, generation);
   }
 
   void TimerManager::cancel(const TimerId& timerId_)
@@ -176,29 +249,22 @@ namespace oplib
   void TimerManager::cancelInLoop(const TimerId& timerId_)
   {
     _loop->inLoopThreadOrDie();
-    assert(_timers.size() == _activeTimers.size());
-    auto iter = _activeTimers.find(timerId_);
-    if (iter != _activeTimers.end())
+    Timer* timer = timerId_._timer;
+    if (timer == nullptr || timer->_generation != timerId_._generation ||
+        timer->cancelled())
     {
-      Timestamp ts = timerId_.first->expireTime();
-      auto range = _timers.equal_range(ts);
-      auto it = range.first;
-      for (auto it = range.first; it != range.second; ++it)
-      {
-        if (it->second->id() == timerId_.second)
-          break;
-      }
-      assert(it != range.second);
-      _timers.erase(it);
-      _activeTimers.erase(iter);
-      assert(_timers.size() == _activeTimers.size());
-
-      printf("Timer cancelled\n");
+      // Already expired and recycled, or cancelled
+      return;
     }
-    else if (_executingExpiredTimers)
+
+    // An expired timer asking to cancel itself (or another expired one)
+    // is not queued anymore, it will be released after running
+    timer->cancel();
+    if (timer->active())
     {
-      // Calling expired timer which asks to cancel itself
-      _cancelledTimers.insert(timerId_);
+      _timers->remove(timer);
+      release(timer);
+      LOG_TRACE("TimerManager::cancelInLoop() timer cancelled");
     }
   }
 }
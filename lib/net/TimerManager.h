@@ -4,33 +4,52 @@
 #include <util/Common.h>
 #include <util/Timestamp.h>
 #include "EventDispatcher.h"
+#include "TimerQueue.h"
 
+#include <stdint.h>
 #include <vector>
-#include <map>
-#include <set>
 #include <memory>
-#include <atomic>
 
 namespace oplib
 {
+  // Timers are recycled by the TimerManager's pool, users
+  // only refer to them through a TimerId
   class Timer : Noncopyable
   {
    public:
-    Timer(TimerCallback cb_, Timestamp when_, double interval_)
-    : _timerCallback(cb_),
-      _when(when_),
-      _interval(interval_), 
-      _repeating(interval_ > 0.0),
-      _id(++_sequence)
+    Timer()
+    : _interval(0.0),
+      _slack(0),
+      _repeating(false),
+      _cancelled(false),
+      _generation(0),
+      _prev(nullptr),
+      _next(nullptr),
+      _index(-1)
     {}
 
-    void run() { _timerCallback(); }
+    void init(TimerCallback&& cb_, Timestamp when_, double interval_, double slack_ = 0.0)
+    {
+      _timerCallback = std::move(cb_);
+      _when = when_;
+      _interval = interval_;
+      _slack = static_cast<int64_t>(slack_ * Timestamp::numMicroSecondsInSeconds);
+      _repeating = interval_ > 0.0;
+      _cancelled = false;
+    }
 
-    int id() { return _id; }
+    void run() { _timerCallback(); }
 
     Timestamp expireTime() const { return _when; }
     bool repeating() const { return _repeating; }
 
+    // A cancelled timer is neither run nor restarted anymore
+    bool cancelled() const { return _cancelled; }
+    void cancel() { _cancelled = true; }
+
+    // Linked into a TimerQueue
+    bool active() const { return _index >= 0; }
+
     void restart(Timestamp from_)
     {
       if (_repeating)
@@ -45,58 +64,101 @@ namespace oplib
     }
 
    private:
+    friend class TimingWheel;
+    friend class TimerHeap;
+    friend class TimerManager;
+
     TimerCallback _timerCallback;
     Timestamp _when;
     double _interval;
+    // The timer may fire up to _slack microseconds late
+    int64_t _slack;
     bool _repeating;
-    int _id;
+    bool _cancelled;
+
+    // Bumped every time the timer goes back to the pool,
+    // so stale TimerIds are detected
+    uint32_t _generation;
 
-    // Atomic incrementing sequence number for timers created
-    // to identify different timers because their address could be the same
-    static std::atomic<int> _sequence;
+    // Intrusive links: slot list of the TimingWheel
+    Timer* _prev;
+    Timer* _next;
+    // Wheel slot or heap position, -1 if not queued
+    int _index;
   };
 
-  typedef std::pair<std::shared_ptr<Timer>, int> TimerId;
+  // Handle of a timer, the generation tells whether
+  // the pooled timer has been reused since
+  class TimerId
+  {
+   public:
+    TimerId()
+    : _timer(nullptr), _generation(0)
+    {}
+
+    TimerId(Timer* timer_, uint32_t generation_)
+    : _timer(timer_), _generation(generation_)
+    {}
+
+    bool valid() const { return _timer != nullptr; }
+
+   private:
+    friend class TimerManager;
+
+    Timer* _timer;
+    uint32_t _generation;
+  };
 
   class TimerManager : Noncopyable
   {
    public:
 
-    using TimerList = std::vector<std::shared_ptr<Timer>>;
+    using TimerList = std::vector<Timer*>;
 
-    TimerManager(EventLoop* loop_);
+    TimerManager(EventLoop* loop_, TimerQueueType type_);
     ~TimerManager();
 
     void handleRead();
-    
-    TimerList expiredTimers(Timestamp current_);
 
-    TimerId addTimer(const TimerCallback& cb_, Timestamp when_, double interval_);
+    // The timer may fire up to slack_ seconds after when_, so that
+    // it can share its expiration with other timers
+    TimerId addTimer(TimerCallback&& cb_, Timestamp when_,
+                     double interval_, double slack_ = 0.0);
 
     void cancel(const TimerId& timerId_);
 
-   private:
-    using TimerMap = std::multimap<Timestamp, std::shared_ptr<Timer>>;
-    using ActiveTimerSet = std::set<TimerId>;
+    size_t size() const { return _timers->size(); }
 
-    void addTimerInLoop(const std::shared_ptr<Timer>& timer_);
+   private:
+    void addTimerInLoop(std::unique_ptr<Timer> timer_);
     void cancelInLoop(const TimerId& timerId_);
 
     void reset(const TimerList& timerlist_);
-    bool insert(const std::shared_ptr<Timer>& timerptr_);
+    bool insert(Timer* timer_);
+    void coalesce(Timer* timer_);
+
+    // Timer pool, only touched in the loop thread
+    Timer* allocate();
+    Timer* adopt(std::unique_ptr<Timer> timer_);
+    void release(Timer* timer_);
 
     // Reset timerfd to watch the most recently triggered timer in the future
     void resetTimerfd();
 
-    // TODO: implement binary head/4-heap to store non-expired timers
+    static const size_t kChunkSize;
 
     EventLoop* _loop;
     const int _timerfd;
     EventDispatcher _dispatcher;
-    TimerMap _timers;
-    ActiveTimerSet _activeTimers;
-    ActiveTimerSet _cancelledTimers;
-    bool _executingExpiredTimers;
+    std::unique_ptr<TimerQueue> _timers;
+    // Time the timerfd is armed for, invalid if disarmed
+    Timestamp _armedExpiration;
+
+    // Timers are allocated kChunkSize at a time, plus the ones
+    // created by other threads (adopted once added in loop)
+    std::vector<std::unique_ptr<Timer[]>> _chunks;
+    std::vector<std::unique_ptr<Timer>> _adopted;
+    std::vector<Timer*> _freeTimers;
   };
 
 }
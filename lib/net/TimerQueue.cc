@@ -0,0 +1,18 @@
+#include "TimerQueue.h"
+#include "TimingWheel.h"
+#include "TimerHeap.h"
+
+namespace oplib
+{
+  std::unique_ptr<TimerQueue> TimerQueue::newTimerQueue(TimerQueueType type_, Timestamp now_)
+  {
+    switch (type_)
+    {
+      case TimerQueueType::HEAP:
+        return std::make_unique<TimerHeap>();
+      case TimerQueueType::WHEEL:
+      default:
+        return std::make_unique<TimingWheel>(now_);
+    }
+  }
+}
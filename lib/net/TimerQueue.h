@@ -0,0 +1,45 @@
+#ifndef OPLIB_TIMERQUEUE_H
+#define OPLIB_TIMERQUEUE_H
+
+#include "Types.h"
+
+#include <util/Common.h>
+#include <util/Timestamp.h>
+
+#include <memory>
+#include <vector>
+
+namespace oplib
+{
+  class Timer;
+
+  // Storage of the pending timers of a TimerManager. Timers are
+  // linked intrusively (Timer::_index and friends), so the queue never
+  // allocates per timer and never owns them
+  class TimerQueue : Noncopyable
+  {
+   public:
+    virtual ~TimerQueue() {}
+
+    virtual void insert(Timer* timer_) = 0;
+    virtual void remove(Timer* timer_) = 0;
+
+    // Timers expiring at or before now_ are removed
+    // from the queue and appended to expired_
+    virtual void advance(Timestamp now_, std::vector<Timer*>* expired_) = 0;
+
+    // Remove every timer from the queue
+    virtual void removeAll(std::vector<Timer*>* timers_) = 0;
+
+    // The earliest time at which advance() has something to do,
+    // invalid timestamp if the queue is empty
+    virtual Timestamp nextExpiration() const = 0;
+
+    virtual size_t size() const = 0;
+    bool empty() const { return size() == 0; }
+
+    static std::unique_ptr<TimerQueue> newTimerQueue(TimerQueueType type_, Timestamp now_);
+  };
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include "TimingWheel.h"
+#include "TimerManager.h"
+
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+namespace oplib
+{
+  const int64_t TimingWheel::kTickMicroSeconds = 1000;
+
+  namespace
+  {
+    // Round up, so a timer never fires before its expire time
+    int64_t toTick(Timestamp when_)
+    {
+      return (when_.microseconds() + TimingWheel::kTickMicroSeconds - 1)
+             / TimingWheel::kTickMicroSeconds;
+    }
+  }
+
+  TimingWheel::TimingWheel(Timestamp now_)
+  : _currentTick(now_.microseconds() / kTickMicroSeconds),
+    _size(0),
+    _slots(kNumSlots, nullptr),
+    _bitmap(kNumSlots / 64, 0)
+  {}
+
+  TimingWheel::~TimingWheel()
+  {}
+
+  void TimingWheel::insert(Timer* timer_)
+  {
+    assert(timer_->_index < 0);
+    link(timer_);
+    ++_size;
+  }
+
+  void TimingWheel::remove(Timer* timer_)
+  {
+    assert(timer_->_index >= 0);
+    unlink(timer_);
+    --_size;
+  }
+
+  void TimingWheel::link(Timer* timer_)
+  {
+    int64_t expires = toTick(timer_->expireTime());
+    int64_t distance = expires - _currentTick;
+    int slot = 0;
+    if (distance < 0)
+    {
+      // Already expired, fire on the next tick processed
+      slot = static_cast<int>(_currentTick & (kRootSlots - 1));
+    }
+    else
+    {
+      int level = 0;
+      while (level < kLevels - 1 && distance >= (int64_t(1) << shift(level + 1)))
+      {
+        ++level;
+      }
+
+      const int64_t maxDistance = (int64_t(1) << (shift(kLevels - 1) + kLevelBits)) - 1;
+      if (distance > maxDistance)
+      {
+        // Out of range: park it in the last slot, it is
+        // placed again with its real expire time when cascaded
+        expires = _currentTick + maxDistance;
+      }
+      slot = offsetOf(level) +
+             static_cast<int>((expires >> shift(level)) & (slotsOf(level) - 1));
+    }
+
+    timer_->_index = slot;
+    timer_->_prev = nullptr;
+    timer_->_next = _slots[slot];
+    if (_slots[slot] != nullptr)
+    {
+      _slots[slot]->_prev = timer_;
+    }
+    _slots[slot] = timer_;
+    _bitmap[slot >> 6] |= uint64_t(1) << (slot & 63);
+  }
+
+  void TimingWheel::unlink(Timer* timer_)
+  {
+    const int slot = timer_->_index;
+    if (timer_->_prev != nullptr)
+    {
+      timer_->_prev->_next = timer_->_next;
+    }
+    else
+    {
+      _slots[slot] = timer_->_next;
+    }
+    if (timer_->_next != nullptr)
+    {
+      timer_->_next->_prev = timer_->_prev;
+    }
+    if (_slots[slot] == nullptr)
+    {
+      _bitmap[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+    }
+    timer_->_prev = nullptr;
+    timer_->_next = nullptr;
+    timer_->_index = -1;
+  }
+
+  void TimingWheel::cascade(int level_)
+  {
+    const int slot = offsetOf(level_) +
+        static_cast<int>((_currentTick >> shift(level_)) & (slotsOf(level_) - 1));
+
+    // Detach the whole list first: the timers are linked
+    // again into the lower levels (or back in this level if
+    // they were parked because of being out of range)
+    Timer* timer = _slots[slot];
+    _slots[slot] = nullptr;
+    _bitmap[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+    while (timer != nullptr)
+    {
+      Timer* next = timer->_next;
+      link(timer);
+      timer = next;
+    }
+  }
+
+  void TimingWheel::advance(Timestamp now_, std::vector<Timer*>* expired_)
+  {
+    const int64_t nowTick = now_.microseconds() / kTickMicroSeconds;
+    while (_currentTick <= nowTick)
+    {
+      if (_size == 0)
+      {
+        _currentTick = nowTick + 1;
+        break;
+      }
+
+      const int index = static_cast<int>(_currentTick & (kRootSlots - 1));
+      if (index == 0)
+      {
+        // The root level wraps around, refill it from the level above
+        for (int level = 1; level < kLevels; ++level)
+        {
+          cascade(level);
+          if (((_currentTick >> shift(level)) & (slotsOf(level) - 1)) != 0)
+          {
+            break;
+          }
+        }
+      }
+
+      Timer* timer = _slots[index];
+      while (timer != nullptr)
+      {
+        Timer* next = timer->_next;
+        remove(timer);
+        expired_->push_back(timer);
+        timer = next;
+      }
+
+      if (findNext(0, index) < 0)
+      {
+        // Nothing left in the root level, jump to the next cascade
+        const int64_t nextCascade = (_currentTick | (kRootSlots - 1)) + 1;
+        _currentTick = std::min(nextCascade, nowTick + 1);
+      }
+      else
+      {
+        ++_currentTick;
+      }
+    }
+  }
+
+  void TimingWheel::removeAll(std::vector<Timer*>* timers_)
+  {
+    for (int slot = 0; slot < kNumSlots; ++slot)
+    {
+      while (_slots[slot] != nullptr)
+      {
+        Timer* timer = _slots[slot];
+        remove(timer);
+        timers_->push_back(timer);
+      }
+    }
+    assert(_size == 0);
+  }
+
+  int TimingWheel::findNext(int level_, int start_) const
+  {
+    // Levels start at a multiple of 64 slots, so a bitmap word
+    // never spans two levels
+    const int n = slotsOf(level_);
+    const int base = offsetOf(level_);
+    int i = 0;
+    while (i < n)
+    {
+      const int bit = base + ((start_ + i) & (n - 1));
+      const uint64_t word = _bitmap[bit >> 6] >> (bit & 63);
+      if (word != 0)
+      {
+        return i + __builtin_ctzll(word);
+      }
+      i += 64 - (bit & 63);
+    }
+    return -1;
+  }
+
+  Timestamp TimingWheel::nextExpiration() const
+  {
+    if (_size == 0)
+    {
+      return Timestamp::epochTime();
+    }
+
+    int64_t next = std::numeric_limits<int64_t>::max();
+    int distance = findNext(0, static_cast<int>(_currentTick & (kRootSlots - 1)));
+    if (distance >= 0)
+    {
+      next = _currentTick + distance;
+    }
+
+    for (int level = 1; level < kLevels; ++level)
+    {
+      // First block of this level which is not cascaded yet
+      const int s = shift(level);
+      const int64_t block = (_currentTick + (int64_t(1) << s) - 1) >> s;
+      distance = findNext(level, static_cast<int>(block & (kLevelSlots - 1)));
+      if (distance >= 0)
+      {
+        next = std::min(next, (block + distance) << s);
+      }
+    }
+
+    assert(next != std::numeric_limits<int64_t>::max());
+    return Timestamp(next * kTickMicroSeconds);
+  }
+}
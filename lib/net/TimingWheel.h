@@ -0,0 +1,76 @@
+#ifndef OPLIB_TIMINGWHEEL_H
+#define OPLIB_TIMINGWHEEL_H
+
+#include "TimerQueue.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace oplib
+{
+  // Hierarchical timing wheel (the classic 256 + 4 * 64 slots layout)
+  // with a 1 millisecond tick, timers further than 2^32 ticks
+  // are clamped to the last slot.
+  // Timers are linked intrusively into the slots, so insert and
+  // remove are O(1) without any allocation. Timers in the higher
+  // levels are cascaded down when the lower level wraps around.
+  class TimingWheel : public TimerQueue
+  {
+   public:
+    explicit TimingWheel(Timestamp now_);
+    ~TimingWheel() override;
+
+    void insert(Timer* timer_) override;
+    void remove(Timer* timer_) override;
+
+    // Move the wheel forward to now_, timers expiring at
+    // or before now_ are unlinked and appended to expired_
+    void advance(Timestamp now_, std::vector<Timer*>* expired_) override;
+
+    // Unlink every timer from the wheel
+    void removeAll(std::vector<Timer*>* timers_) override;
+
+    // The earliest time at which advance() has something to do:
+    // either a timer expires or a higher level is cascaded.
+    // Invalid timestamp if the wheel is empty
+    Timestamp nextExpiration() const override;
+
+    size_t size() const override { return _size; }
+
+    static const int64_t kTickMicroSeconds;
+
+   private:
+    static const int kRootBits = 8;
+    static const int kLevelBits = 6;
+    static const int kLevels = 5;
+    static const int kRootSlots = 1 << kRootBits;
+    static const int kLevelSlots = 1 << kLevelBits;
+    static const int kNumSlots = kRootSlots + (kLevels - 1) * kLevelSlots;
+
+    static int shift(int level_)
+    { return level_ == 0 ? 0 : kRootBits + (level_ - 1) * kLevelBits; }
+
+    static int slotsOf(int level_)
+    { return level_ == 0 ? kRootSlots : kLevelSlots; }
+
+    // Index of the first slot of level_ in _slots
+    static int offsetOf(int level_)
+    { return level_ == 0 ? 0 : kRootSlots + (level_ - 1) * kLevelSlots; }
+
+    void link(Timer* timer_);
+    void unlink(Timer* timer_);
+    void cascade(int level_);
+
+    // First non-empty slot of level_ scanning circularly from start_,
+    // returns the distance from start_ or -1 if the level is empty
+    int findNext(int level_, int start_) const;
+
+    int64_t _currentTick;
+    size_t _size;
+    std::vector<Timer*> _slots;
+    // One bit per slot, set if the slot is not empty
+    std::vector<uint64_t> _bitmap;
+  };
+}
+
+#endif
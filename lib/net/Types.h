@@ -4,6 +4,9 @@
 #include "Socket.h"
 #include <ds/Buffer.h>
 #include <util/Timestamp.h>
+#include <util/Task.h>
+
+#include <stdint.h>
 
 #include <functional>
 #include <memory>
@@ -13,16 +16,69 @@ namespace oplib
   class TCPConnection;
   typedef std::shared_ptr<TCPConnection> TCPConnectionPtr;
 
-  typedef std::function<void()> TimerCallback;
+  // Handed over to an EventLoop: move-only, stored inline up to 64 bytes
+  typedef Task<void()> TimerCallback;
+  typedef Task<void()> Functor;
+
   typedef std::function<void()> EventCallback;
   typedef std::function<void(oplib::Timestamp)> ReadEventCallback;
-  typedef std::function<void()> Functor;
+
+  // IO multiplexing backend used by an EventLoop
+  // IO_URING falls back to EPOLL where the kernel lacks it, see
+  // EventLoop::pollerType()
+  enum class PollerType { POLL, EPOLL, IO_URING };
+
+  // What an EventDispatcher serves, the callback times of
+  // LoopMetrics are kept by type. OTHER must stay last
+  enum class DispatcherType { WAKEUP, TIMER, LISTENER, CONNECTOR, CONNECTION, OTHER };
+
+  // Socket reads of the connections of an EventLoop
+  struct ReadStats
+  {
+    uint64_t reads;
+    // Reads which did not fit the buffer and went
+    // through the loop's overflow buffer
+    uint64_t overflowReads;
+    uint64_t overflowBytes;
+  };
+
+  // Connections accepted by a Listener
+  struct AcceptStats
+  {
+    // Buckets of batches: 0, 1, 2-3, 4-7, ... , 64
+    static const int kBatchBuckets = 8;
+
+    uint64_t wakeups;
+    uint64_t accepted;
+    // Accepted and closed right away while out of file descriptors
+    uint64_t rejected;
+    // Wakeups by number of connections accepted
+    uint64_t batches[kBatchBuckets];
+  };
+
+  // How EventLoopThreadPool places new connections on its loops:
+  // in turn, on the loop with the fewest connections, on the loop
+  // with the fewest queued output bytes, or on the less loaded of
+  // two random loops (connections, then busy time)
+  enum class PlacementPolicy
+  {
+    ROUND_ROBIN,
+    LEAST_CONNECTIONS,
+    LEAST_PENDING_BYTES,
+    POWER_OF_TWO_CHOICES
+  };
+
+  // Storage of the pending timers of an EventLoop: a timing wheel
+  // with 1ms ticks, or a 4-ary heap with exact expire times
+  enum class TimerQueueType { WHEEL, HEAP };
 
   typedef std::function<void (std::unique_ptr<Socket>, const InetAddress&)> NewConnectionCallback;
   typedef std::function<void (const TCPConnectionPtr&)> ConnectionCallback;
   typedef std::function<void (const TCPConnectionPtr&, oplib::ds::Buffer*_, oplib::Timestamp)> MessageCallback;
   typedef std::function<void (const TCPConnectionPtr&)> CloseCallback;
   typedef std::function<void (const TCPConnectionPtr&)> ConnectionEventCallback;
+  // The pending output bytes when the mark was reached
+  typedef std::function<void (const TCPConnectionPtr&, size_t)> HighWaterMarkCallback;
 }
 
 #endif
@@ -7,6 +7,9 @@
 
 #include "Condition.h"
 
+#include <errno.h>
+#include <time.h>
+
 namespace oplib
 {
   Condition::Condition(Mutex& mutex_)
@@ -25,6 +28,21 @@ namespace oplib
     CHECK_RETURN(pthread_cond_wait(&_cond, _mutex.getRawMutex()));
   }
 
+  bool Condition::waitForSeconds(double seconds_)
+  {
+    // pthread_cond_timedwait() takes a CLOCK_REALTIME deadline
+    const int64_t kNanoSecondsPerSecond = 1000 * 1000 * 1000;
+    struct timespec deadline;
+    ::clock_gettime(CLOCK_REALTIME, &deadline);
+    const int64_t nanoSeconds = static_cast<int64_t>(seconds_ * kNanoSecondsPerSecond);
+    const int64_t total = deadline.tv_nsec + nanoSeconds;
+    deadline.tv_sec += static_cast<time_t>(total / kNanoSecondsPerSecond);
+    deadline.tv_nsec = static_cast<long>(total % kNanoSecondsPerSecond);
+
+    Mutex::CondGuard guard(_mutex);
+    return pthread_cond_timedwait(&_cond, _mutex.getRawMutex(), &deadline) == ETIMEDOUT;
+  }
+
   void Condition::notify()
   {
     CHECK_RETURN(pthread_cond_signal(&_cond));
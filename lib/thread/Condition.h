@@ -27,7 +27,8 @@ namespace oplib
 
     void notifyAll();
 
-    // TODO add timewait function
+    // Returns true if the seconds_ passed without a notify
+    bool waitForSeconds(double seconds_);
 
   private:
     Mutex& _mutex;
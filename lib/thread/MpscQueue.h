@@ -0,0 +1,140 @@
+/*
+ * MpscQueue.H
+ *
+ * Intrusive lock-free multi-producer single-consumer queue
+ * (Dmitry Vyukov's algorithm). Producers never block each other:
+ * a push is one atomic exchange, one store and one counter
+ * increment. The consumer owns the tail and needs no atomic
+ * read-modify-write at all.
+ */
+
+#ifndef OPLIB_NET_MPSCQUEUE_H_
+#define OPLIB_NET_MPSCQUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+
+namespace oplib
+{
+
+// Elements of a MpscQueue derive from MpscNode
+struct MpscNode
+{
+  std::atomic<MpscNode*> _next { nullptr };
+};
+
+template <typename T>
+class MpscQueue
+{
+public:
+  MpscQueue(const MpscQueue& rhs_) = delete;
+  MpscQueue& operator = (const MpscQueue& rhs_) = delete;
+
+  MpscQueue();
+
+  // Callable from any thread
+  void push(T* node_);
+
+  // Consumer only: returns nullptr if the queue is empty, or if
+  // the next node is still being linked by a producer
+  T* pop();
+
+  // Consumer only: nodes pushed, or being pushed, and not popped yet.
+  // Popping at most that many does not pick up nodes pushed meanwhile;
+  // pop() may return nullptr earlier, while a producer is linking
+  size_t size() const;
+
+private:
+  void pushNode(MpscNode* node_);
+
+  // Producers swap themselves in at the head
+  std::atomic<MpscNode*> _head;
+  // Consumer side, keep it away from the head's cache line
+  alignas(64) MpscNode* _tail;
+  MpscNode _stub;
+  // Counted by node, the stub going around is not an element
+  std::atomic<size_t> _pushed;
+  size_t _popped;
+};
+
+template <typename T>
+MpscQueue<T>::MpscQueue()
+: _head(&_stub),
+  _tail(&_stub),
+  _pushed(0),
+  _popped(0)
+{}
+
+template <typename T>
+void MpscQueue<T>::push(T* node_)
+{
+  // Counted first, so the count never falls behind the pops; a
+  // counted node may still be in the middle of its push
+  _pushed.fetch_add(1, std::memory_order_relaxed);
+  pushNode(node_);
+}
+
+template <typename T>
+void MpscQueue<T>::pushNode(MpscNode* node_)
+{
+  node_->_next.store(nullptr, std::memory_order_relaxed);
+  MpscNode* prev = _head.exchange(node_, std::memory_order_acq_rel);
+  // Between the exchange and this store the list is broken,
+  // the consumer sees the queue as empty until it is linked
+  prev->_next.store(node_, std::memory_order_release);
+}
+
+template <typename T>
+T* MpscQueue<T>::pop()
+{
+  MpscNode* tail = _tail;
+  MpscNode* next = tail->_next.load(std::memory_order_acquire);
+
+  if (tail == &_stub)
+  {
+    if (next == nullptr)
+    {
+      return nullptr;
+    }
+    // Skip over the stub
+    _tail = next;
+    tail = next;
+    next = next->_next.load(std::memory_order_acquire);
+  }
+
+  if (next != nullptr)
+  {
+    _tail = next;
+    ++_popped;
+    return static_cast<T*>(tail);
+  }
+
+  if (tail != _head.load(std::memory_order_acquire))
+  {
+    // A producer is in the middle of a push
+    return nullptr;
+  }
+
+  // tail is the last node: put the stub behind it so that
+  // tail can be handed out without emptying the list
+  pushNode(&_stub);
+  next = tail->_next.load(std::memory_order_acquire);
+  if (next != nullptr)
+  {
+    _tail = next;
+    ++_popped;
+    return static_cast<T*>(tail);
+  }
+  return nullptr;
+}
+
+template <typename T>
+size_t MpscQueue<T>::size() const
+{
+  return _pushed.load(std::memory_order_relaxed) - _popped;
+}
+
+}
+
+#endif /* NET_MPSCQUEUE_H_ */
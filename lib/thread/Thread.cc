@@ -2,8 +2,11 @@
 #include <util/Common.h>
 
 #include <sys/prctl.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <cassert>
+#include <errno.h>
 
 namespace oplib
 {
@@ -85,6 +88,58 @@ namespace CurrentThread
     }
   };
 
+  std::vector<int> cpusOfList(const char* list_)
+  {
+    // Comma separated ranges: 0-11,24-35
+    std::vector<int> cpus;
+    const char* p = list_;
+    while (*p != '\0')
+    {
+      char* end = nullptr;
+      const long first = ::strtol(p, &end, 10);
+      if (end == p || first < 0)
+      {
+        break;
+      }
+      long last = first;
+      p = end;
+      if (*p == '-')
+      {
+        last = ::strtol(p + 1, &end, 10);
+        if (end == p + 1 || last < first)
+        {
+          break;
+        }
+        p = end;
+      }
+      for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+      {
+        cpus.push_back(static_cast<int>(cpu));
+      }
+      if (*p != ',')
+      {
+        break;
+      }
+      ++p;
+    }
+    return cpus;
+  }
+
+  std::vector<int> cpusOfNumaNode(int node_)
+  {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node_);
+    FILE* file = ::fopen(path, "re");
+    if (file == nullptr)
+    {
+      return std::vector<int>();
+    }
+    char list[4096];
+    const bool read = ::fgets(list, sizeof(list), file) != nullptr;
+    ::fclose(file);
+    return read ? cpusOfList(list) : std::vector<int>();
+  }
+
   void* threadLauncher(void *arg_)
   {
     ThreadInfo* info = static_cast<ThreadInfo*>(arg_);
@@ -144,7 +199,49 @@ namespace CurrentThread
     assert(!_started);
     _started = true;
     ThreadInfo* info = new ThreadInfo(_name, _func, _tid);
-    if (pthread_create(&_pthreadId, nullptr, threadLauncher, info) != 0)
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    bool pinned = false;
+    if (!_cpus.empty())
+    {
+      cpu_set_t cpuSet;
+      CPU_ZERO(&cpuSet);
+      for (int cpu : _cpus)
+      {
+        // CPU_SET() doesn't check its argument
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+          continue;
+        }
+        CPU_SET(cpu, &cpuSet);
+        pinned = true;
+      }
+      if (pinned)
+      {
+        int err = pthread_attr_setaffinity_np(&attr, sizeof(cpuSet), &cpuSet);
+        if (err != 0)
+        {
+          pthread_attr_destroy(&attr);
+          pthread_attr_init(&attr);
+          pinned = false;
+        }
+      }
+    }
+
+    int ret = pthread_create(&_pthreadId, &attr, threadLauncher, info);
+    if (ret == EINVAL && pinned)
+    {
+      // None of the CPUs is available to this process
+      pthread_attr_destroy(&attr);
+      pthread_attr_init(&attr);
+      pinned = false;
+      ret = pthread_create(&_pthreadId, &attr, threadLauncher, info);
+    }
+    pthread_attr_destroy(&attr);
+    _pinned = ret == 0 && pinned;
+
+    if (ret != 0)
     {
       _started = false;
       delete info;
@@ -12,11 +12,13 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <cassert>
 
 #include <string>
 #include <functional>
 #include <memory>
 #include <atomic>
+#include <vector>
 
 #include <util/Common.h>
 
@@ -37,12 +39,29 @@ namespace oplib
 
     ~Thread();
 
+    // Pin the thread to the CPUs cpus_ from its first instruction, so
+    // its stack and first-touched memory live on their NUMA node.
+    // Empty for no affinity, must be called before start(). CPUs out
+    // of [0, CPU_SETSIZE) are skipped; if none is left or none can be
+    // used, the thread runs unpinned, see pinned()
+    void setCpuAffinity(const std::vector<int>& cpus_)
+    {
+      assert(!_started);
+      _cpus = cpus_;
+    }
+
+    const std::vector<int>& cpuAffinity() const { return _cpus; }
+
     void start();
 
     int join();
 
     bool started() const { return _started; }
 
+    // Once started: runs bound to the CPUs of setCpuAffinity(),
+    // those out of range aside
+    bool pinned() const { return _pinned; }
+
     pid_t tid() const { return *_tid; }
 
     const std::string& name() const { return _name; }
@@ -55,15 +74,24 @@ namespace oplib
 
     bool           _started { false };
     bool           _joined { false };
+    bool           _pinned { false };
     pthread_t      _pthreadId;
     std::shared_ptr<pid_t> _tid;
     ThreadFunc     _func;
     std::string    _name;
+    std::vector<int> _cpus;
 
     static std::atomic_long _numCreated;
   };
 
 
+  // CPUs of NUMA node node_ as listed by sysfs, empty if unknown
+  std::vector<int> cpusOfNumaNode(int node_);
+
+  // CPUs of a list in the sysfs format, "0-11,24-35". Stops at the
+  // first malformed range, CPUs from CPU_SETSIZE on are dropped
+  std::vector<int> cpusOfList(const char* list_);
+
 namespace CurrentThread
 {
   extern __thread int tl_tid;
@@ -0,0 +1,213 @@
+/*
+ * Task.h
+ *
+ * Move-only replacement of std::function for the callbacks handed to
+ * an EventLoop. Callables up to kInlineBytes (and nothrow movable) are
+ * stored in place, so a closure holding a moved-in payload, for
+ * instance a std::string, costs no allocation and no copy.
+ * Bigger callables fall back to the heap.
+ */
+
+#ifndef OPLIB_UTIL_TASK_H_
+#define OPLIB_UTIL_TASK_H_
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace oplib
+{
+
+template <typename Signature, size_t kInlineBytes = 64>
+class Task;
+
+template <typename R, typename... Args, size_t kInlineBytes>
+class Task<R(Args...), kInlineBytes>
+{
+  static_assert(kInlineBytes >= sizeof(void*), "Task needs room for a pointer");
+
+public:
+  Task(const Task& rhs_) = delete;
+  Task& operator = (const Task& rhs_) = delete;
+
+  Task() noexcept
+  : _ops(nullptr)
+  {}
+
+  Task(std::nullptr_t) noexcept
+  : _ops(nullptr)
+  {}
+
+  template <typename F,
+            typename = typename std::enable_if<
+              !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+  Task(F&& func_)
+  : _ops(nullptr)
+  {
+    using Callable = typename std::decay<F>::type;
+    if (!isNull(static_cast<const Callable&>(func_)))
+    {
+      construct<Callable>(std::forward<F>(func_));
+    }
+  }
+
+  Task(Task&& rhs_) noexcept
+  : _ops(nullptr)
+  {
+    moveFrom(rhs_);
+  }
+
+  Task& operator = (Task&& rhs_) noexcept
+  {
+    if (this != &rhs_)
+    {
+      reset();
+      moveFrom(rhs_);
+    }
+    return *this;
+  }
+
+  Task& operator = (std::nullptr_t) noexcept
+  {
+    reset();
+    return *this;
+  }
+
+  ~Task()
+  {
+    reset();
+  }
+
+  explicit operator bool() const { return _ops != nullptr; }
+
+  R operator () (Args... args_)
+  {
+    assert(_ops != nullptr);
+    return _ops->invoke(&_storage, std::forward<Args>(args_)...);
+  }
+
+  // Whether a callable of type F is stored without allocation
+  template <typename F>
+  static constexpr bool storedInline()
+  {
+    return sizeof(F) <= kInlineBytes &&
+           alignof(F) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible<F>::value;
+  }
+
+private:
+  // Type erased operations on the stored callable
+  struct Ops
+  {
+    R (*invoke)(void* storage_, Args&&... args_);
+    void (*move)(void* to_, void* from_);
+    void (*destroy)(void* storage_);
+  };
+
+  template <typename F>
+  struct InlineOps
+  {
+    static R invoke(void* storage_, Args&&... args_)
+    {
+      return (*static_cast<F*>(storage_))(std::forward<Args>(args_)...);
+    }
+
+    static void move(void* to_, void* from_)
+    {
+      F* from = static_cast<F*>(from_);
+      new (to_) F(std::move(*from));
+      from->~F();
+    }
+
+    static void destroy(void* storage_)
+    {
+      static_cast<F*>(storage_)->~F();
+    }
+
+    static const Ops* get()
+    {
+      static const Ops ops = { &invoke, &move, &destroy };
+      return &ops;
+    }
+  };
+
+  // The storage only holds a pointer to the callable
+  template <typename F>
+  struct HeapOps
+  {
+    static R invoke(void* storage_, Args&&... args_)
+    {
+      return (**static_cast<F**>(storage_))(std::forward<Args>(args_)...);
+    }
+
+    static void move(void* to_, void* from_)
+    {
+      *static_cast<F**>(to_) = *static_cast<F**>(from_);
+    }
+
+    static void destroy(void* storage_)
+    {
+      delete *static_cast<F**>(storage_);
+    }
+
+    static const Ops* get()
+    {
+      static const Ops ops = { &invoke, &move, &destroy };
+      return &ops;
+    }
+  };
+
+  template <typename F>
+  static bool isNull(const F&) { return false; }
+
+  template <typename F>
+  static bool isNull(F* func_) { return func_ == nullptr; }
+
+  template <typename S>
+  static bool isNull(const std::function<S>& func_) { return !func_; }
+
+  template <typename F, typename G>
+  typename std::enable_if<storedInline<F>()>::type construct(G&& func_)
+  {
+    new (&_storage) F(std::forward<G>(func_));
+    _ops = InlineOps<F>::get();
+  }
+
+  template <typename F, typename G>
+  typename std::enable_if<!storedInline<F>()>::type construct(G&& func_)
+  {
+    *reinterpret_cast<F**>(&_storage) = new F(std::forward<G>(func_));
+    _ops = HeapOps<F>::get();
+  }
+
+  void moveFrom(Task& rhs_) noexcept
+  {
+    if (rhs_._ops != nullptr)
+    {
+      rhs_._ops->move(&_storage, &rhs_._storage);
+      _ops = rhs_._ops;
+      rhs_._ops = nullptr;
+    }
+  }
+
+  void reset() noexcept
+  {
+    if (_ops != nullptr)
+    {
+      _ops->destroy(&_storage);
+      _ops = nullptr;
+    }
+  }
+
+  typename std::aligned_storage<kInlineBytes, alignof(std::max_align_t)>::type _storage;
+  const Ops* _ops;
+};
+
+}
+
+#endif /* OPLIB_UTIL_TASK_H_ */
@@ -0,0 +1,36 @@
+#ifndef OPLIB_TESTCHECK_H
+#define OPLIB_TESTCHECK_H
+
+#include <stdio.h>
+
+// Failure counting shared by the standalone test programs: check()
+// prints each failure, result() prints the summary line and returns the
+// exit code.
+namespace oplib
+{
+  namespace test
+  {
+    inline int& failures()
+    {
+      static int count = 0;
+      return count;
+    }
+
+    inline void check(bool ok_, const char* what_, long long value_ = 0)
+    {
+      if (!ok_)
+      {
+        ++failures();
+        printf("FAILED %s (%lld)\n", what_, value_);
+      }
+    }
+
+    inline int result()
+    {
+      printf("RESULT %s: %d failures\n", failures() == 0 ? "OK" : "BAD", failures());
+      return failures() == 0 ? 0 : 1;
+    }
+  }
+}
+
+#endif
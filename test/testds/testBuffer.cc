@@ -78,3 +78,42 @@ TEST_F(BufferTest, testBufferMakespace)
   EXPECT_EQ(buf.writableBytes(), 224u);
   EXPECT_EQ(buf.prependableBytes(), oplib::ds::Buffer::prependSize);
 }
+
+TEST_F(BufferTest, testPooledRelease)
+{
+  oplib::ds::BufferPool pool;
+  oplib::ds::Buffer buf(&pool);
+  EXPECT_EQ(buf.capacity(), 0u);
+  EXPECT_EQ(buf.writableBytes(), 0u);
+  EXPECT_EQ(pool.occupancy().inUseChunks, 0u);
+
+  // Allocated lazily, a whole size class
+  buf.append(std::string(200, 'x'));
+  EXPECT_EQ(buf.capacity(), 2048u);
+  EXPECT_EQ(buf.readableBytes(), 200u);
+  EXPECT_EQ(buf.prependableBytes(), oplib::ds::Buffer::prependSize);
+  EXPECT_EQ(pool.occupancy().inUseBytes, 2048u);
+
+  EXPECT_FALSE(buf.release());
+  buf.retrieveAll();
+  EXPECT_TRUE(buf.release());
+  EXPECT_EQ(buf.capacity(), 0u);
+  EXPECT_EQ(pool.occupancy().inUseChunks, 0u);
+  EXPECT_EQ(pool.occupancy().cachedBytes, 2048u);
+
+  // Reuses the cached chunk
+  buf.append(std::string(100, 'y'));
+  EXPECT_EQ(buf.retrieveAsString(), std::string(100, 'y'));
+  EXPECT_EQ(pool.occupancy().inUseChunks, 1u);
+  EXPECT_EQ(pool.occupancy().cachedChunks, 0u);
+
+  buf.append(std::string(200 * 1000, 'z'));
+  EXPECT_EQ(buf.readableBytes(), 200u * 1000);
+  EXPECT_GT(pool.occupancy().largeBytes, 200u * 1000);
+  buf.retrieveAll();
+  buf.release();
+
+  pool.trim();
+  oplib::ds::BufferPool::Occupancy occupancy = pool.occupancy();
+  EXPECT_EQ(occupancy.inUseBytes + occupancy.cachedBytes + occupancy.largeBytes, 0u);
+}
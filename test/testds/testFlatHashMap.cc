@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+#include <ds/FlatHashMap.h>
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+class FlatHashMapTest : public ::testing::Test
+{
+protected:
+  FlatHashMapTest() {};
+  virtual ~FlatHashMapTest() {};
+  virtual void SetUp() {};
+  virtual void TearDown() {};
+};
+
+namespace
+{
+  // Every key on the same home slot: long probe runs
+  struct ConstantHash
+  {
+    size_t operator()(uint64_t) const { return 7; }
+  };
+}
+
+TEST_F(FlatHashMapTest, testInsertFindErase)
+{
+  oplib::ds::FlatHashMap<uint64_t, std::string> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.find(1), nullptr);
+
+  EXPECT_TRUE(map.insert(1, "one"));
+  EXPECT_TRUE(map.insert(2, "two"));
+  EXPECT_FALSE(map.insert(1, "uno"));
+  EXPECT_EQ(map.size(), 2u);
+  ASSERT_NE(map.find(1), nullptr);
+  EXPECT_EQ(*map.find(1), "one");
+  EXPECT_EQ(map.count(2), 1u);
+
+  EXPECT_EQ(map.erase(1), 1u);
+  EXPECT_EQ(map.erase(1), 0u);
+  EXPECT_EQ(map.find(1), nullptr);
+  EXPECT_EQ(*map.find(2), "two");
+  EXPECT_EQ(map.size(), 1u);
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.find(2), nullptr);
+}
+
+TEST_F(FlatHashMapTest, testGrow)
+{
+  oplib::ds::FlatHashMap<uint64_t, uint64_t> map;
+  const size_t initial = map.capacity();
+  for (uint64_t i = 0; i < 10000; ++i)
+  {
+    EXPECT_TRUE(map.insert(i, i * 3));
+  }
+  EXPECT_EQ(map.size(), 10000u);
+  EXPECT_GT(map.capacity(), initial);
+  EXPECT_LE(map.size() * 4, map.capacity() * 3);
+
+  uint64_t sum = 0;
+  map.forEach([&sum] (uint64_t key_, uint64_t& value_) {
+    EXPECT_EQ(value_, key_ * 3);
+    sum += key_;
+  });
+  EXPECT_EQ(sum, 10000u * 9999u / 2);
+}
+
+TEST_F(FlatHashMapTest, testEraseShiftsCollisions)
+{
+  oplib::ds::FlatHashMap<uint64_t, int, ConstantHash> map;
+  for (uint64_t i = 0; i < 10; ++i)
+  {
+    map.insert(i, static_cast<int>(i));
+  }
+  // Holes in the middle of the run must not hide the keys after them
+  EXPECT_EQ(map.erase(3), 1u);
+  EXPECT_EQ(map.erase(0), 1u);
+  for (uint64_t i = 0; i < 10; ++i)
+  {
+    if (i == 0 || i == 3)
+    {
+      EXPECT_EQ(map.find(i), nullptr);
+    }
+    else
+    {
+      ASSERT_NE(map.find(i), nullptr);
+      EXPECT_EQ(*map.find(i), static_cast<int>(i));
+    }
+  }
+}
+
+TEST_F(FlatHashMapTest, testAgainstStdMap)
+{
+  oplib::ds::FlatHashMap<uint64_t, std::shared_ptr<int>> map;
+  std::map<uint64_t, int> reference;
+  std::mt19937 gen(42);
+
+  for (int n = 0; n < 100000; ++n)
+  {
+    uint64_t key = gen() % 512;
+    if (gen() % 2 == 0)
+    {
+      bool inserted = map.insert(key, std::make_shared<int>(n));
+      EXPECT_EQ(inserted, reference.emplace(key, n).second);
+    }
+    else
+    {
+      EXPECT_EQ(map.erase(key), reference.erase(key));
+    }
+  }
+
+  EXPECT_EQ(map.size(), reference.size());
+  for (auto& entry : reference)
+  {
+    auto value = map.find(entry.first);
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(**value, entry.second);
+  }
+}
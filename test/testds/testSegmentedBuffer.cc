@@ -0,0 +1,102 @@
+#include "gtest/gtest.h"
+#include <ds/SegmentedBuffer.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+class SegmentedBufferTest : public ::testing::Test
+{
+protected:
+  SegmentedBufferTest() {};
+  virtual ~SegmentedBufferTest() {};
+  virtual void SetUp() {};
+  virtual void TearDown() {};
+
+  oplib::ds::BufferPool pool;
+};
+
+TEST_F(SegmentedBufferTest, testAppendRetrieve)
+{
+  oplib::ds::SegmentedBuffer buf(&pool, 64);
+  EXPECT_EQ(buf.readableBytes(), 0u);
+  EXPECT_EQ(buf.numSegments(), 0u);
+
+  std::string str;
+  for (int i = 0; i < 200; ++i)
+  {
+    str.push_back(static_cast<char>('a' + i % 26));
+  }
+  buf.append(str);
+  EXPECT_EQ(buf.readableBytes(), 200u);
+  EXPECT_EQ(buf.numSegments(), 4u);
+  EXPECT_EQ(buf.frontBytes(), 64u);
+  EXPECT_EQ(pool.inUseChunks(0), 4u);
+
+  const std::string str2 = buf.retrieveAsString(100);
+  EXPECT_EQ(str2, str.substr(0, 100));
+  EXPECT_EQ(buf.readableBytes(), 100u);
+  EXPECT_EQ(buf.numSegments(), 3u);
+  EXPECT_EQ(buf.frontBytes(), 28u);
+  EXPECT_EQ(pool.inUseChunks(0), 3u);
+
+  const std::string str3 = buf.retrieveAsString();
+  EXPECT_EQ(str3, str.substr(100));
+  EXPECT_EQ(buf.readableBytes(), 0u);
+  EXPECT_EQ(buf.numSegments(), 0u);
+  EXPECT_EQ(pool.inUseChunks(0), 0u);
+  EXPECT_EQ(pool.cachedChunks(0), 4u);
+}
+
+TEST_F(SegmentedBufferTest, testPrepend)
+{
+  oplib::ds::SegmentedBuffer buf(&pool, 64);
+  buf.append(std::string(100, 'x'));
+  buf.prepend("head", 4);
+  EXPECT_EQ(buf.readableBytes(), 104u);
+  EXPECT_EQ(buf.numSegments(), 3u);
+
+  buf.retrieve(10);
+  buf.prepend("ab", 2);
+  EXPECT_EQ(buf.numSegments(), 2u);
+
+  char data[8];
+  EXPECT_EQ(buf.peek(data, 8), 8u);
+  EXPECT_EQ(std::string(data, 8), "abxxxxxx");
+  EXPECT_EQ(buf.retrieveAsString(), "ab" + std::string(94, 'x'));
+}
+
+TEST_F(SegmentedBufferTest, testReadWriteFd)
+{
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  std::string str;
+  for (int i = 0; i < 1000; ++i)
+  {
+    str.push_back(static_cast<char>('A' + i % 26));
+  }
+
+  oplib::ds::SegmentedBuffer out(&pool, 64);
+  out.append(str);
+  int savedErrno = 0;
+  EXPECT_EQ(out.writeFd(fds[0], &savedErrno), 1000);
+  EXPECT_EQ(out.readableBytes(), 0u);
+
+  oplib::ds::SegmentedBuffer in(&pool, 64);
+  in.append("xyz", 3);
+  ssize_t total = 0;
+  while (total < 1000)
+  {
+    ssize_t n = in.readFd(fds[1], &savedErrno);
+    ASSERT_GT(n, 0);
+    total += n;
+  }
+  EXPECT_EQ(in.readableBytes(), 1003u);
+  EXPECT_EQ(in.retrieveAsString(), "xyz" + str);
+  EXPECT_EQ(pool.inUseChunks(0), 0u);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
@@ -0,0 +1,186 @@
+#include "gtest/gtest.h"
+#include <util/Task.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+class TaskTest : public ::testing::Test
+{
+protected:
+  TaskTest() {};
+  virtual ~TaskTest() {};
+  virtual void SetUp() { Tracker::reset(); };
+  virtual void TearDown() {};
+
+  // Counts its copies, moves and destructions
+  struct Tracker
+  {
+    static int alive;
+    static int copies;
+    static int moves;
+
+    static void reset() { alive = 0; copies = 0; moves = 0; }
+
+    Tracker() { ++alive; }
+    Tracker(const Tracker&) { ++alive; ++copies; }
+    Tracker(Tracker&&) noexcept { ++alive; ++moves; }
+    ~Tracker() { --alive; }
+  };
+};
+
+int TaskTest::Tracker::alive = 0;
+int TaskTest::Tracker::copies = 0;
+int TaskTest::Tracker::moves = 0;
+
+namespace
+{
+  typedef oplib::Task<int(int)> IntTask;
+
+  struct Big
+  {
+    char payload[256];
+    int operator()(int x_) const { return x_ + payload[0]; }
+  };
+
+  // Small, but moving it may throw: kept on the heap
+  struct ThrowingMove
+  {
+    ThrowingMove() {}
+    ThrowingMove(ThrowingMove&&) noexcept(false) {}
+    int operator()(int x_) const { return x_ * 2; }
+  };
+
+  int twice(int x_) { return 2 * x_; }
+}
+
+TEST_F(TaskTest, testStorage)
+{
+  auto small = [](int x_) { return x_ + 1; };
+  EXPECT_TRUE(IntTask::storedInline<decltype(small)>());
+  EXPECT_FALSE(IntTask::storedInline<Big>());
+  EXPECT_FALSE(IntTask::storedInline<ThrowingMove>());
+  EXPECT_TRUE((oplib::Task<int(int), 512>::storedInline<Big>()));
+
+  IntTask inlined(small);
+  Big big;
+  big.payload[0] = 10;
+  IntTask onHeap(big);
+  IntTask throwing { ThrowingMove() };
+  EXPECT_EQ(inlined(1), 2);
+  EXPECT_EQ(onHeap(1), 11);
+  EXPECT_EQ(throwing(3), 6);
+}
+
+TEST_F(TaskTest, testMove)
+{
+  std::unique_ptr<int> value(new int(5));
+  IntTask task([value = std::move(value)](int x_) { return *value + x_; });
+  ASSERT_TRUE(static_cast<bool>(task));
+
+  IntTask moved(std::move(task));
+  EXPECT_FALSE(static_cast<bool>(task));
+  EXPECT_EQ(moved(1), 6);
+
+  IntTask assigned;
+  assigned = std::move(moved);
+  EXPECT_FALSE(static_cast<bool>(moved));
+  EXPECT_EQ(assigned(2), 7);
+
+  // Heap storage moves the pointer
+  Big big;
+  big.payload[0] = 1;
+  IntTask heap(big);
+  IntTask heapMoved(std::move(heap));
+  EXPECT_FALSE(static_cast<bool>(heap));
+  EXPECT_EQ(heapMoved(1), 2);
+
+  // Self move-assignment keeps the callable
+  IntTask& self = heapMoved;
+  heapMoved = std::move(self);
+  EXPECT_EQ(heapMoved(1), 2);
+}
+
+TEST_F(TaskTest, testCapturesDestroyed)
+{
+  {
+    Tracker tracker;
+    oplib::Task<void()> inlined([tracker] { (void) tracker; });
+    EXPECT_EQ(Tracker::alive, 2);
+    oplib::Task<void()> moved(std::move(inlined));
+    // Moved along, the moved-from capture destroyed right away
+    EXPECT_EQ(Tracker::alive, 2);
+    EXPECT_EQ(Tracker::copies, 1);
+  }
+  EXPECT_EQ(Tracker::alive, 0);
+
+  Tracker::reset();
+  {
+    Tracker tracker;
+    char padding[200] = {};
+    oplib::Task<void()> heap([tracker, padding] { (void) tracker; (void) padding; });
+    oplib::Task<void()> moved(std::move(heap));
+    // The pointer moved, not the callable
+    EXPECT_EQ(Tracker::alive, 2);
+    EXPECT_EQ(Tracker::moves, 1);
+  }
+  EXPECT_EQ(Tracker::alive, 0);
+
+  // Replaced by move-assignment and by nullptr
+  Tracker::reset();
+  {
+    Tracker tracker;
+    oplib::Task<void()> first([tracker] {});
+    oplib::Task<void()> second([tracker] {});
+    EXPECT_EQ(Tracker::alive, 3);
+    first = std::move(second);
+    EXPECT_EQ(Tracker::alive, 2);
+    first = nullptr;
+    EXPECT_EQ(Tracker::alive, 1);
+    EXPECT_FALSE(static_cast<bool>(first));
+  }
+  EXPECT_EQ(Tracker::alive, 0);
+}
+
+TEST_F(TaskTest, testEmpty)
+{
+  IntTask none;
+  EXPECT_FALSE(static_cast<bool>(none));
+  IntTask null(nullptr);
+  EXPECT_FALSE(static_cast<bool>(null));
+
+  std::function<int(int)> emptyFunction;
+  IntTask fromEmptyFunction(emptyFunction);
+  EXPECT_FALSE(static_cast<bool>(fromEmptyFunction));
+
+  int (*nullPointer)(int) = nullptr;
+  IntTask fromNullPointer(nullPointer);
+  EXPECT_FALSE(static_cast<bool>(fromNullPointer));
+
+  std::function<int(int)> function(twice);
+  IntTask fromFunction(function);
+  ASSERT_TRUE(static_cast<bool>(fromFunction));
+  EXPECT_EQ(fromFunction(4), 8);
+  IntTask fromPointer(&twice);
+  ASSERT_TRUE(static_cast<bool>(fromPointer));
+  EXPECT_EQ(fromPointer(5), 10);
+
+  // Moving an empty task leaves both empty
+  IntTask moved(std::move(none));
+  EXPECT_FALSE(static_cast<bool>(moved));
+  EXPECT_FALSE(static_cast<bool>(none));
+}
+
+TEST_F(TaskTest, testArguments)
+{
+  oplib::Task<std::string(std::string&&, const std::string&)> concat(
+    [](std::string&& a_, const std::string& b_) { return std::move(a_) + b_; });
+  std::string b("def");
+  EXPECT_EQ(concat(std::string("abc"), b), "abcdef");
+
+  std::unique_ptr<int> moveOnly(new int(3));
+  oplib::Task<int(std::unique_ptr<int>)> take(
+    [](std::unique_ptr<int> p_) { return *p_; });
+  EXPECT_EQ(take(std::move(moveOnly)), 3);
+}
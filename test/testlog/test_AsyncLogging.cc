@@ -0,0 +1,213 @@
+// AsyncLogging: kThreads threads log kMessages numbered messages each
+// into a temp file. Checks that every message was written, in order
+// per thread, and that the compiled-out levels don't evaluate their
+// arguments. Then kStopRounds writers are stopped while the threads
+// log: every message must be in the file or, once stopped, on stderr,
+// none lost at the switch. Reports the CPU cost per message in the
+// logging threads against the synchronous fallback, to an unbuffered
+// /dev/null like stderr, and to a buffered one.
+#include <log/Logging.h>
+#include <log/AsyncLogging.h>
+#include <thread/Thread.h>
+#include <TestCheck.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+  using oplib::test::check;
+
+  const int kThreads = 4;
+  const int kMessages = 200000;
+  const int kStopRounds = 10;
+  const int kStopMessages = 20000;
+
+  std::atomic<int64_t> gNanoSeconds { 0 };
+
+  // CPU time of the calling thread: the loggers and the writer share
+  // the CPUs, the wall time would count the others' turns
+  int64_t threadNanoSeconds()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+  }
+
+  int sideEffect(int* counter_)
+  {
+    return ++*counter_;
+  }
+
+  void logger(int id_, int messages_)
+  {
+    int64_t start = threadNanoSeconds();
+    for (int i = 0; i < messages_; ++i)
+    {
+      LOG_INFO("thread %d message %d", id_, i);
+    }
+    gNanoSeconds += threadNanoSeconds() - start;
+  }
+
+  std::vector<std::unique_ptr<oplib::Thread>> startLoggers(int firstId_, int messages_)
+  {
+    std::vector<std::unique_ptr<oplib::Thread>> threads;
+    for (int i = 0; i < kThreads; ++i)
+    {
+      const int id = firstId_ + i;
+      threads.push_back(std::make_unique<oplib::Thread>([id, messages_] { logger(id, messages_); }));
+      threads.back()->start();
+    }
+    return threads;
+  }
+
+  void join(const std::vector<std::unique_ptr<oplib::Thread>>& threads_)
+  {
+    for (auto& t : threads_)
+    {
+      t->join();
+    }
+  }
+
+  // Start kThreads loggers, returns the nanoseconds per message
+  double run(int messages_)
+  {
+    gNanoSeconds = 0;
+    join(startLoggers(0, messages_));
+    return static_cast<double>(gNanoSeconds) / (kThreads * messages_);
+  }
+
+  std::string tempFile()
+  {
+    char path[] = "/tmp/oplib_logXXXXXX";
+    int fd = ::mkstemp(path);
+    ::close(fd);
+    return path;
+  }
+
+  // The messages of path_, next_ is the sequence number expected of
+  // each thread. Returns false if one came out of order
+  bool readMessages(const std::string& path_, std::map<int, int>* next_, size_t* lines_)
+  {
+    bool ordered = true;
+    FILE* file = ::fopen(path_.c_str(), "r");
+    char line[1024];
+    while (::fgets(line, sizeof(line), file) != nullptr)
+    {
+      const char* msg = ::strstr(line, "thread ");
+      int thread = -1;
+      int seq = -1;
+      if (msg == nullptr || ::sscanf(msg, "thread %d message %d", &thread, &seq) != 2)
+      {
+        continue;
+      }
+      ordered = ordered && (*next_)[thread] == seq;
+      (*next_)[thread] = seq + 1;
+      ++*lines_;
+    }
+    ::fclose(file);
+    ::unlink(path_.c_str());
+    return ordered;
+  }
+
+  // Threads firstId_.. logged messages_ each
+  bool complete(const std::map<int, int>& next_, int firstId_, int messages_)
+  {
+    bool all = true;
+    for (int id = firstId_; id < firstId_ + kThreads; ++id)
+    {
+      auto it = next_.find(id);
+      all = all && it != next_.end() && it->second == messages_;
+    }
+    return all;
+  }
+
+  // A writer stopped a little after the loggers started, while they
+  // log: the file then stderr must hold all their messages, in order
+  void testStop()
+  {
+    FILE* savedStderr = stderr;
+    size_t toFile = 0;
+    size_t toStderr = 0;
+    for (int round = 0; round < kStopRounds; ++round)
+    {
+      const std::string path = tempFile();
+      const std::string stderrPath = tempFile();
+      stderr = ::fopen(stderrPath.c_str(), "w");
+      const int firstId = (round + 1) * kThreads;
+      {
+        oplib::AsyncLogging writer(path);
+        writer.start();
+        std::vector<std::unique_ptr<oplib::Thread>> threads = startLoggers(firstId, kStopMessages);
+        ::usleep(static_cast<useconds_t>(1000 + round * 1000));
+        writer.stop();
+        join(threads);
+      }
+      ::fclose(stderr);
+      stderr = savedStderr;
+
+      std::map<int, int> next;
+      bool ordered = readMessages(path, &next, &toFile);
+      ordered = readMessages(stderrPath, &next, &toStderr) && ordered;
+      check(ordered, "stop: out of order", round);
+      check(complete(next, firstId, kStopMessages), "stop: messages lost", round);
+    }
+    printf("stop while logging: %zu messages to the file, %zu to stderr\n", toFile, toStderr);
+    check(toFile + toStderr == static_cast<size_t>(kStopRounds) * kThreads * kStopMessages,
+          "stop: messages", static_cast<long long>(toFile + toStderr));
+  }
+}
+
+int main()
+{
+  int evaluated = 0;
+  LOG_TRACE("never formatted %d", sideEffect(&evaluated));
+  LOG_DEBUG("never formatted %d", sideEffect(&evaluated));
+  check(evaluated == 0, "filtered arguments evaluated", evaluated);
+
+  // The synchronous fallback, to /dev/null: unbuffered like
+  // stderr, then buffered
+  FILE* savedStderr = stderr;
+  const int kSyncMessages = 20000;
+  stderr = ::fopen("/dev/null", "w");
+  ::setvbuf(stderr, nullptr, _IONBF, 0);
+  double syncCost = run(kSyncMessages);
+  ::fclose(stderr);
+  stderr = ::fopen("/dev/null", "w");
+  double bufferedCost = run(kSyncMessages);
+  ::fclose(stderr);
+  stderr = savedStderr;
+
+  const std::string path = tempFile();
+  double asyncCost = 0.0;
+  {
+    oplib::AsyncLogging writer(path);
+    writer.start();
+    asyncCost = run(kMessages);
+    writer.stop();
+  }
+
+  // Every message, in order per thread
+  std::map<int, int> next;
+  size_t lines = 0;
+  check(readMessages(path, &next, &lines), "out of order");
+  check(next.size() == static_cast<size_t>(kThreads) && complete(next, 0, kMessages),
+        "messages lost", static_cast<long long>(lines));
+  printf("%d threads: %.1f ns per message async, sync to /dev/null %.1f ns "
+         "unbuffered, %.1f ns buffered\n", kThreads, asyncCost, syncCost, bufferedCost);
+
+  testStop();
+  check(oplib::log::dropped() == 0, "dropped",
+        static_cast<long long>(oplib::log::dropped()));
+
+  return oplib::test::result();
+}
@@ -0,0 +1,154 @@
+// Connection storm: client threads open short-lived connections as fast
+// as they can, the server writes one byte and shuts the connection down.
+// Compares a single listener in the master loop handing connections out
+// to the IO loops against one SO_REUSEPORT listener per IO loop.
+// Reports accepted connections per second and the connect-to-first-byte
+// latency, and how many connections a listener wakeup accepts on
+// average. The library logs every connection on stdout, results go to
+// stderr: run as ./acceptbench > /dev/null
+
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <thread/CountdownLatch.h>
+#include <util/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const uint16_t kPort = 9985;
+  const int kClientThreads = 8;
+  const int kConnectionsPerClient = 2000;
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      conn_->send("x");
+      conn_->shutdown();
+    }
+  }
+
+  // One connection: connect, wait for the byte, wait for the EOF.
+  // Returns the latency up to the first byte in us, -1 on failure
+  int64_t connectOnce()
+  {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    oplib::Timestamp start(oplib::Timestamp::now());
+    int64_t latency = -1;
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0)
+    {
+      char buf[16];
+      if (::read(fd, buf, sizeof(buf)) > 0)
+      {
+        latency = oplib::Timestamp::now() - start;
+        while (::read(fd, buf, sizeof(buf)) > 0)
+        {}
+      }
+    }
+    ::close(fd);
+    return latency;
+  }
+
+  int64_t percentile(const std::vector<int64_t>& sorted_, double p_)
+  {
+    size_t index = static_cast<size_t>(p_ * static_cast<double>(sorted_.size() - 1));
+    return sorted_[index];
+  }
+
+  void run(int ioThreads_, bool reusePort_)
+  {
+    oplib::EventLoop loop;
+    oplib::TCPServer server(&loop, oplib::InetAddress(kPort), "acceptbench", ioThreads_);
+    server.setConnectionCallback(onConnection);
+    server.setReusePort(reusePort_);
+    server.start();
+
+    std::vector<std::vector<int64_t>> latencies(kClientThreads);
+    oplib::CountdownLatch done(kClientThreads);
+    std::vector<std::unique_ptr<oplib::Thread>> clients;
+    for (int i = 0; i < kClientThreads; ++i)
+    {
+      std::vector<int64_t>* latency = &latencies[i];
+      clients.push_back(std::make_unique<oplib::Thread>([latency, &done] {
+        latency->reserve(kConnectionsPerClient);
+        for (int n = 0; n < kConnectionsPerClient; ++n)
+        {
+          int64_t us = connectOnce();
+          if (us >= 0)
+          {
+            latency->push_back(us);
+          }
+        }
+        done.countDown();
+      }));
+    }
+
+    // Quits the loop when every client is done
+    oplib::Thread waiter([&done, &loop] {
+      done.wait();
+      loop.quit();
+    });
+
+    oplib::Timestamp start(oplib::Timestamp::now());
+    for (auto& client : clients)
+    {
+      client->start();
+    }
+    waiter.start();
+    loop.loop();
+    oplib::Timestamp end(oplib::Timestamp::now());
+    oplib::AcceptStats acceptStats = server.acceptStats();
+    for (auto& client : clients)
+    {
+      client->join();
+    }
+    waiter.join();
+
+    std::vector<int64_t> all;
+    for (auto& latency : latencies)
+    {
+      all.insert(all.end(), latency.begin(), latency.end());
+    }
+    std::sort(all.begin(), all.end());
+    double seconds = static_cast<double>(end - start) / oplib::Timestamp::numMicroSecondsInSeconds;
+    fprintf(stderr, "%-9s %7d %8zu %12.0f %6.2f %8ld %8ld %8ld\n",
+            reusePort_ ? "reuseport" : "single", ioThreads_, all.size(),
+            all.size() / seconds,
+            static_cast<double>(acceptStats.accepted) / std::max<uint64_t>(acceptStats.wakeups, 1),
+            all.empty() ? 0 : percentile(all, 0.5),
+            all.empty() ? 0 : percentile(all, 0.99),
+            all.empty() ? 0 : all.back());
+  }
+}
+
+int main()
+{
+  const int ioThreads[] = { 1, 2, 4 };
+
+  fprintf(stderr, "%d client threads, %d connections each, latencies in us\n",
+          kClientThreads, kConnectionsPerClient);
+  fprintf(stderr, "%-9s %7s %8s %12s %6s %8s %8s %8s\n",
+          "listener", "threads", "conns", "accepts/s", "batch", "p50", "p99", "max");
+  for (int n : ioThreads)
+  {
+    run(n, false);
+    run(n, true);
+  }
+}
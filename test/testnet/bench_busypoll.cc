@@ -0,0 +1,157 @@
+// Busy polling of an IO loop: one client doing kRequests blocking
+// round trips with a short think time between them, against an echo
+// server with one IO loop, blocking and then spinning for up to
+// kSpinMicroSeconds after each request. Reports the round trip
+// latency and where the IO loop's time went. Results go to stderr:
+// ./busypollbench >/dev/null
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace
+{
+  const uint16_t kBasePort = 9993;
+  const int kRequests = 20000;
+  const size_t kRequestBytes = 64;
+  const int kThinkMicroSeconds = 20;
+  const int64_t kSpinMicroSeconds = 200;
+
+  oplib::EventLoop* gLoop;
+  std::atomic<oplib::EventLoop*> gIoLoop { nullptr };
+
+  int64_t nowNanoSeconds()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+  }
+
+  void onMessage(const oplib::TCPConnectionPtr& conn_,
+                 oplib::ds::Buffer* buf_,
+                 oplib::Timestamp)
+  {
+    conn_->send(buf_);
+  }
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      conn_->enableTcpNoDelay();
+      gIoLoop = conn_->getLoop();
+    }
+  }
+
+  // Round trips, latencies_ in nanoseconds
+  void client(uint16_t port_, std::vector<int64_t>* latencies_)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+
+    char request[kRequestBytes];
+    char response[kRequestBytes];
+    ::memset(request, 'x', sizeof(request));
+    latencies_->reserve(kRequests);
+    for (int i = 0; i < kRequests; ++i)
+    {
+      // Spin rather than sleep, the client's wakeup is not measured
+      int64_t next = nowNanoSeconds() + kThinkMicroSeconds * 1000;
+      while (nowNanoSeconds() < next)
+      {
+      }
+
+      int64_t start = nowNanoSeconds();
+      if (::write(fd, request, sizeof(request)) != static_cast<ssize_t>(sizeof(request)))
+      {
+        perror("write");
+        abort();
+      }
+      size_t got = 0;
+      while (got < sizeof(response))
+      {
+        ssize_t n = ::read(fd, response + got, sizeof(response) - got);
+        if (n <= 0)
+        {
+          perror("read");
+          abort();
+        }
+        got += n;
+      }
+      latencies_->push_back(nowNanoSeconds() - start);
+    }
+    ::close(fd);
+    gLoop->quit();
+  }
+
+  void run(int64_t spinMicroSeconds_, uint16_t port_)
+  {
+    oplib::EventLoop loop;
+    gLoop = &loop;
+    gIoLoop = nullptr;
+
+    oplib::TCPServer server(&loop, oplib::InetAddress(port_), "echo");
+    server.setNumThreads(1);
+    server.setPollerType(oplib::PollerType::EPOLL);
+    server.setConnectionCallback(onConnection);
+    server.setMessageCallback(onMessage);
+    server.start();
+    server.setBusyPoll(spinMicroSeconds_);
+
+    std::vector<int64_t> latencies;
+    oplib::Thread clientThread([port_, &latencies] {
+      usleep(100 * 1000);
+      client(port_, &latencies);
+    });
+    clientThread.start();
+    loop.loop();
+    clientThread.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    // The whole run, idle time before the connection included
+    const oplib::EventLoop::TimeSplit& split = gIoLoop.load()->timeSplit();
+    fprintf(stderr, "%-9lld %10.1f %10.1f %10.1f %10.1f %10.1f %10.3f\n",
+            static_cast<long long>(spinMicroSeconds_),
+            latencies[latencies.size() / 2] / 1000.0,
+            latencies[latencies.size() * 99 / 100] / 1000.0,
+            split.busyMicroSeconds.load() / 1000.0,
+            split.spinningMicroSeconds.load() / 1000.0,
+            split.blockedMicroSeconds.load() / 1000.0,
+            gIoLoop.load()->spinningFraction());
+  }
+}
+
+int main()
+{
+  fprintf(stderr, "%d round trips of %zu bytes, %d us apart\n",
+          kRequests, kRequestBytes, kThinkMicroSeconds);
+  fprintf(stderr, "%-9s %10s %10s %10s %10s %10s %10s\n",
+          "spin us", "p50 us", "p99 us", "busy ms", "spin ms", "block ms", "spinning");
+  run(0, kBasePort);
+  run(kSpinMicroSeconds, kBasePort + 1);
+}
@@ -0,0 +1,197 @@
+// Cross-thread functor posting: N producer threads enqueue into one
+// EventLoop. Compares EventLoop::enqueue (lock-free MPSC queue, one
+// eventfd write per batch) against the previous implementation: a
+// mutex-protected std::vector<Functor> with one eventfd write per
+// enqueue. Reports throughput and the enqueue-to-run latency, once
+// with producers posting flat out (the loop is the bottleneck and the
+// latency is mostly queueing) and once with paced producers.
+
+#include <net/EventLoop.h>
+#include <net/EventDispatcher.h>
+#include <thread/Thread.h>
+#include <thread/Mutex.h>
+#include <thread/CountdownLatch.h>
+#include <util/Timestamp.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const int kPostsPerProducer = 200 * 1000;
+  // Paced producers sleep after every burst
+  const int kBurst = 16;
+  const int kPauseMicroSeconds = 50;
+
+  // The pending functors of EventLoop before the MPSC queue
+  class MutexFunctorQueue
+  {
+   public:
+    explicit MutexFunctorQueue(oplib::EventLoop* loop_)
+    : _wakeupfd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      _dispatcher(loop_, _wakeupfd)
+    {
+      _dispatcher.setReadCallback(std::bind(&MutexFunctorQueue::handleRead, this));
+      _dispatcher.enableReading();
+    }
+
+    ~MutexFunctorQueue()
+    {
+      ::close(_wakeupfd);
+    }
+
+    void enqueue(const std::function<void()>& func_)
+    {
+      {
+        oplib::MutexLockGuard guard(_mutex);
+        _pendingFunctors.push_back(func_);
+      }
+      uint64_t one = 1;
+      ssize_t n = ::write(_wakeupfd, &one, sizeof(one));
+      UNUSED(n);
+    }
+
+    void disable(oplib::EventLoop* loop_)
+    {
+      _dispatcher.disable();
+      loop_->removeEventDispatcher(&_dispatcher);
+    }
+
+   private:
+    void handleRead()
+    {
+      uint64_t value;
+      ssize_t n = ::read(_wakeupfd, &value, sizeof(value));
+      UNUSED(n);
+
+      std::vector<std::function<void()>> toExecute;
+      {
+        oplib::MutexLockGuard guard(_mutex);
+        toExecute.swap(_pendingFunctors);
+      }
+      for (auto& func : toExecute)
+      {
+        func();
+      }
+    }
+
+    int _wakeupfd;
+    oplib::EventDispatcher _dispatcher;
+    std::vector<std::function<void()>> _pendingFunctors;
+    oplib::Mutex _mutex;
+  };
+
+  // Only touched in the loop thread
+  struct Stats
+  {
+    oplib::EventLoop* _loop;
+    int _expected;
+    std::vector<int64_t> _latencies;
+  };
+
+  void onFunctor(Stats* stats_, oplib::Timestamp posted_)
+  {
+    stats_->_latencies.push_back(oplib::Timestamp::now() - posted_);
+    if (static_cast<int>(stats_->_latencies.size()) == stats_->_expected)
+    {
+      stats_->_loop->quit();
+    }
+  }
+
+  int64_t percentile(const std::vector<int64_t>& sorted_, double p_)
+  {
+    size_t index = static_cast<size_t>(p_ * static_cast<double>(sorted_.size() - 1));
+    return sorted_[index];
+  }
+
+  template <typename Enqueue>
+  void run(const char* name_, int producers_, bool paced_,
+           oplib::EventLoop* loop_, const Enqueue& enqueue_)
+  {
+    Stats stats;
+    stats._loop = loop_;
+    stats._expected = producers_ * kPostsPerProducer;
+    stats._latencies.reserve(stats._expected);
+
+    oplib::CountdownLatch ready(producers_);
+    oplib::CountdownLatch go(1);
+    std::vector<std::unique_ptr<oplib::Thread>> threads;
+    for (int i = 0; i < producers_; ++i)
+    {
+      threads.push_back(std::make_unique<oplib::Thread>([&] {
+        ready.countDown();
+        go.wait();
+        for (int n = 0; n < kPostsPerProducer; ++n)
+        {
+          enqueue_(std::bind(onFunctor, &stats, oplib::Timestamp::now()));
+          if (paced_ && n % kBurst == kBurst - 1)
+          {
+            ::usleep(kPauseMicroSeconds);
+          }
+        }
+      }));
+      threads.back()->start();
+    }
+
+    ready.wait();
+    oplib::Timestamp start(oplib::Timestamp::now());
+    go.countDown();
+    loop_->loop();
+    oplib::Timestamp end(oplib::Timestamp::now());
+    for (auto& thread : threads)
+    {
+      thread->join();
+    }
+
+    std::sort(stats._latencies.begin(), stats._latencies.end());
+    double seconds = static_cast<double>(end - start) / oplib::Timestamp::numMicroSecondsInSeconds;
+    printf("%-6s %-6s %9d %12.0f %8ld %8ld %8ld %8ld\n", name_,
+           paced_ ? "paced" : "flat", producers_,
+           stats._expected / seconds,
+           percentile(stats._latencies, 0.5),
+           percentile(stats._latencies, 0.99),
+           percentile(stats._latencies, 0.999),
+           stats._latencies.back());
+  }
+
+  void runMpsc(int producers_, bool paced_)
+  {
+    oplib::EventLoop loop;
+    run("mpsc", producers_, paced_, &loop, [&loop] (oplib::Functor&& func_) {
+      loop.enqueue(std::move(func_));
+    });
+  }
+
+  void runMutex(int producers_, bool paced_)
+  {
+    oplib::EventLoop loop;
+    MutexFunctorQueue queue(&loop);
+    run("mutex", producers_, paced_, &loop, [&queue] (std::function<void()>&& func_) {
+      queue.enqueue(func_);
+    });
+    queue.disable(&loop);
+  }
+}
+
+int main()
+{
+  const int producers[] = { 1, 2, 4, 8 };
+
+  printf("%d posts per producer, latencies in us\n", kPostsPerProducer);
+  printf("%-6s %-6s %9s %12s %8s %8s %8s %8s\n",
+         "queue", "mode", "producers", "posts/s", "p50", "p99", "p99.9", "max");
+  for (bool paced : { false, true })
+  {
+    for (int n : producers)
+    {
+      runMutex(n, paced);
+      runMpsc(n, paced);
+    }
+  }
+}
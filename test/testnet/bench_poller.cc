@@ -0,0 +1,118 @@
+// Wakeup cost of the poll and epoll backends with a growing number of
+// idle fds: one eventfd keeps waking up the loop, the others never fire.
+// With poll(2) the cost grows with the number of idle fds, with epoll(7)
+// it should stay flat.
+
+#include <net/EventLoop.h>
+#include <net/EventDispatcher.h>
+#include <util/Timestamp.h>
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const int kWakeups = 20000;
+
+  oplib::EventLoop* gLoop;
+  int gActivefd;
+  int gCount;
+
+  void wakeup()
+  {
+    uint64_t one = 1;
+    ssize_t n = ::write(gActivefd, &one, sizeof(one));
+    UNUSED(n);
+  }
+
+  void onActive(oplib::Timestamp)
+  {
+    uint64_t value;
+    ssize_t n = ::read(gActivefd, &value, sizeof(value));
+    UNUSED(n);
+    if (++gCount == kWakeups)
+    {
+      gLoop->quit();
+    }
+    else
+    {
+      wakeup();
+    }
+  }
+
+  size_t raiseFdLimit()
+  {
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+  }
+
+  // Returns the average microseconds per wakeup
+  double run(oplib::PollerType type_, size_t nIdle_)
+  {
+    oplib::EventLoop loop(type_);
+    gLoop = &loop;
+    gCount = 0;
+
+    std::vector<int> idlefds;
+    std::vector<std::unique_ptr<oplib::EventDispatcher>> idle;
+    for (size_t i = 0; i < nIdle_; ++i)
+    {
+      int fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      idlefds.push_back(fd);
+      idle.push_back(std::make_unique<oplib::EventDispatcher>(&loop, fd));
+      idle.back()->enableReading();
+    }
+
+    gActivefd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    oplib::EventDispatcher active(&loop, gActivefd);
+    active.setReadCallback(onActive);
+    active.enableReading();
+
+    wakeup();
+    oplib::Timestamp start(oplib::Timestamp::now());
+    loop.loop();
+    oplib::Timestamp end(oplib::Timestamp::now());
+
+    active.disable();
+    loop.removeEventDispatcher(&active);
+    ::close(gActivefd);
+    for (size_t i = 0; i < idle.size(); ++i)
+    {
+      idle[i]->disable();
+      loop.removeEventDispatcher(idle[i].get());
+      ::close(idlefds[i]);
+    }
+
+    return static_cast<double>(end - start) / kWakeups;
+  }
+}
+
+int main()
+{
+  size_t limit = raiseFdLimit();
+  const size_t sizes[] = { 0, 100, 1000, 5000, 10000, 20000, 50000 };
+
+  printf("%10s %16s %16s\n", "idle fds", "poll us/wakeup", "epoll us/wakeup");
+  for (size_t n : sizes)
+  {
+    // Leave some room for the loop's own fds and stdio
+    if (n + 64 > limit)
+    {
+      printf("%10zu skipped, RLIMIT_NOFILE is %zu\n", n, limit);
+      continue;
+    }
+    double pollCost = run(oplib::PollerType::POLL, n);
+    double epollCost = run(oplib::PollerType::EPOLL, n);
+    printf("%10zu %16.3f %16.3f\n", n, pollCost, epollCost);
+  }
+}
@@ -0,0 +1,115 @@
+// Connection registry of TCPServer: the per-connect and per-disconnect
+// bookkeeping, without the sockets. Compares the current registry
+// (64-bit id in a ds::FlatHashMap, name formatted on demand) against
+// the previous one (name built with std::ostringstream on every
+// connect, std::map keyed by that name).
+// kLive connections stay registered, every iteration registers a new
+// connection and removes the oldest one.
+
+#include <ds/FlatHashMap.h>
+#include <util/Timestamp.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace
+{
+  const int kChurn = 1000 * 1000;
+
+  // Stands in for TCPConnection
+  struct Connection
+  {
+    uint64_t _id;
+    std::string _name;
+  };
+  typedef std::shared_ptr<Connection> ConnectionPtr;
+
+  const std::string kServerName = "benchServer_0.0.0.0:9981";
+
+  class LegacyRegistry
+  {
+   public:
+    void add()
+    {
+      std::ostringstream oss;
+      oss << kServerName << "_" << _nextConnId++;
+      auto conn = std::make_shared<Connection>();
+      conn->_name = oss.str();
+      _connections[conn->_name] = conn;
+      _order.push_back(conn);
+    }
+
+    void removeOldest()
+    {
+      _connections.erase(_order.front()->_name);
+      _order.pop_front();
+    }
+
+   private:
+    int _nextConnId { 1 };
+    std::map<std::string, ConnectionPtr> _connections;
+    std::deque<ConnectionPtr> _order;
+  };
+
+  class FlatRegistry
+  {
+   public:
+    void add()
+    {
+      auto conn = std::make_shared<Connection>();
+      conn->_id = _nextConnId++;
+      _connections.insert(conn->_id, conn);
+      _order.push_back(conn);
+    }
+
+    void removeOldest()
+    {
+      _connections.erase(_order.front()->_id);
+      _order.pop_front();
+    }
+
+   private:
+    uint64_t _nextConnId { 1 };
+    oplib::ds::FlatHashMap<uint64_t, ConnectionPtr> _connections;
+    std::deque<ConnectionPtr> _order;
+  };
+
+  template <typename Registry>
+  double run(int live_)
+  {
+    Registry registry;
+    for (int i = 0; i < live_; ++i)
+    {
+      registry.add();
+    }
+
+    oplib::Timestamp start(oplib::Timestamp::now());
+    for (int i = 0; i < kChurn; ++i)
+    {
+      registry.add();
+      registry.removeOldest();
+    }
+    oplib::Timestamp end(oplib::Timestamp::now());
+    return static_cast<double>(end - start) * 1000.0 / kChurn;
+  }
+}
+
+int main()
+{
+  const int live[] = { 100, 10 * 1000, 100 * 1000 };
+
+  printf("%d connect/disconnect pairs, ns per pair\n", kChurn);
+  printf("%8s %12s %12s\n", "live", "map+string", "flat+id");
+  for (int n : live)
+  {
+    double legacy = run<LegacyRegistry>(n);
+    double flat = run<FlatRegistry>(n);
+    printf("%8d %12.1f %12.1f\n", n, legacy, flat);
+  }
+}
@@ -0,0 +1,175 @@
+// Timer store microbenchmark: the TimingWheel and TimerHeap used by
+// TimerManager against the previous multimap + std::set<TimerId>
+// implementation with one shared_ptr per timer.
+// Models idle-connection timeouts: kTimers timers are pending and
+// every message cancels one of them and arms a new one.
+
+#include <net/TimerManager.h>
+#include <net/TimerQueue.h>
+#include <util/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace
+{
+  const int kTimers = 100 * 1000;
+  const int kRearms = 1000 * 1000;
+
+  void noop() {}
+
+  oplib::Timestamp randomExpiration(oplib::Timestamp now_)
+  {
+    // Between 10 and 60 seconds
+    now_ += 10.0 + (::rand() % 50000) / 1000.0;
+    return now_;
+  }
+
+  void report(const char* name_, const char* op_, oplib::Timestamp start_, int ops_)
+  {
+    double ns = static_cast<double>(oplib::Timestamp::now() - start_) * 1000.0 / ops_;
+    printf("%-10s %-8s %10.1f ns/op\n", name_, op_, ns);
+  }
+
+  // The timer store of TimerManager before the timing wheel
+  struct LegacyTimer
+  {
+    LegacyTimer(const std::function<void()>& cb_, oplib::Timestamp when_)
+    : _cb(cb_), _when(when_), _id(++_sequence)
+    {}
+
+    std::function<void()> _cb;
+    oplib::Timestamp _when;
+    int _id;
+
+    static std::atomic<int> _sequence;
+  };
+
+  std::atomic<int> LegacyTimer::_sequence { 0 };
+
+  using LegacyTimerId = std::pair<std::shared_ptr<LegacyTimer>, int>;
+
+  class MultimapTimers
+  {
+   public:
+    LegacyTimerId insert(oplib::Timestamp when_)
+    {
+      auto timer = std::make_shared<LegacyTimer>(noop, when_);
+      _timers.insert(std::make_pair(timer->_when, timer));
+      LegacyTimerId id(timer, timer->_id);
+      _activeTimers.insert(id);
+      return id;
+    }
+
+    void cancel(const LegacyTimerId& id_)
+    {
+      auto iter = _activeTimers.find(id_);
+      if (iter == _activeTimers.end()) return;
+      auto range = _timers.equal_range(id_.first->_when);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        if (it->second->_id == id_.second)
+        {
+          _timers.erase(it);
+          break;
+        }
+      }
+      _activeTimers.erase(iter);
+    }
+
+    size_t expire(oplib::Timestamp now_)
+    {
+      auto end = _timers.lower_bound(now_);
+      size_t n = 0;
+      for (auto it = _timers.begin(); it != end; ++it, ++n)
+      {
+        _activeTimers.erase(LegacyTimerId(it->second, it->second->_id));
+      }
+      _timers.erase(_timers.begin(), end);
+      return n;
+    }
+
+   private:
+    std::multimap<oplib::Timestamp, std::shared_ptr<LegacyTimer>> _timers;
+    std::set<LegacyTimerId> _activeTimers;
+  };
+
+  void benchMultimap(oplib::Timestamp now_)
+  {
+    ::srand(1);
+    MultimapTimers timers;
+    std::vector<LegacyTimerId> ids;
+
+    oplib::Timestamp start(oplib::Timestamp::now());
+    for (int i = 0; i < kTimers; ++i)
+    {
+      ids.push_back(timers.insert(randomExpiration(now_)));
+    }
+    report("multimap", "add", start, kTimers);
+
+    start = oplib::Timestamp::now();
+    for (int i = 0; i < kRearms; ++i)
+    {
+      size_t index = ::rand() % ids.size();
+      timers.cancel(ids[index]);
+      ids[index] = timers.insert(randomExpiration(now_));
+    }
+    report("multimap", "rearm", start, kRearms);
+
+    start = oplib::Timestamp::now();
+    oplib::Timestamp end(now_);
+    end += 120.0;
+    size_t n = timers.expire(end);
+    report("multimap", "expire", start, static_cast<int>(n));
+  }
+
+  // Pooled timers, like TimerManager: a cancelled timer
+  // goes back to the pool and is reused for the next one
+  void benchQueue(const char* name_, oplib::TimerQueueType type_, oplib::Timestamp now_)
+  {
+    ::srand(1);
+    auto timers = oplib::TimerQueue::newTimerQueue(type_, now_);
+    std::unique_ptr<oplib::Timer[]> pool(new oplib::Timer[kTimers]);
+
+    oplib::Timestamp start(oplib::Timestamp::now());
+    for (int i = 0; i < kTimers; ++i)
+    {
+      pool[i].init(noop, randomExpiration(now_), 0.0);
+      timers->insert(&pool[i]);
+    }
+    report(name_, "add", start, kTimers);
+
+    start = oplib::Timestamp::now();
+    for (int i = 0; i < kRearms; ++i)
+    {
+      oplib::Timer* timer = &pool[::rand() % kTimers];
+      timers->remove(timer);
+      timer->init(noop, randomExpiration(now_), 0.0);
+      timers->insert(timer);
+    }
+    report(name_, "rearm", start, kRearms);
+
+    start = oplib::Timestamp::now();
+    oplib::Timestamp end(now_);
+    end += 120.0;
+    std::vector<oplib::Timer*> expired;
+    timers->advance(end, &expired);
+    report(name_, "expire", start, static_cast<int>(expired.size()));
+  }
+}
+
+int main()
+{
+  oplib::Timestamp now(oplib::Timestamp::now());
+  printf("%d pending timers, %d cancel + re-arm\n", kTimers, kRearms);
+  benchMultimap(now);
+  benchQueue("wheel", oplib::TimerQueueType::WHEEL, now);
+  benchQueue("heap", oplib::TimerQueueType::HEAP, now);
+}
@@ -0,0 +1,167 @@
+// Request/response cost of the poll, epoll and io_uring backends: an
+// echo server on one loop, kClients client threads each doing kRequests
+// blocking round trips of kRequestBytes. Reports the poller syscalls
+// per request (poll/epoll_wait/epoll_ctl, or io_uring_enter), the reads
+// per request (every response is one write on top), and the round trip
+// latency. Results go to stderr: ./uringbench >/dev/null
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const uint16_t kBasePort = 9991;
+  const int kClients = 8;
+  const int kRequests = 20000;
+  const size_t kRequestBytes = 64;
+
+  oplib::EventLoop* gLoop;
+  std::atomic_int gClientsDone { 0 };
+
+  int64_t nowNanoSeconds()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+  }
+
+  void onMessage(const oplib::TCPConnectionPtr& conn_,
+                 oplib::ds::Buffer* buf_,
+                 oplib::Timestamp)
+  {
+    conn_->send(buf_);
+  }
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      conn_->enableTcpNoDelay();
+    }
+  }
+
+  // Round trips of one client, latencies_ in nanoseconds
+  void client(uint16_t port_, std::vector<int64_t>* latencies_)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+
+    char request[kRequestBytes];
+    char response[kRequestBytes];
+    ::memset(request, 'x', sizeof(request));
+    latencies_->reserve(kRequests);
+    for (int i = 0; i < kRequests; ++i)
+    {
+      int64_t start = nowNanoSeconds();
+      if (::write(fd, request, sizeof(request)) != static_cast<ssize_t>(sizeof(request)))
+      {
+        perror("write");
+        abort();
+      }
+      size_t got = 0;
+      while (got < sizeof(response))
+      {
+        ssize_t n = ::read(fd, response + got, sizeof(response) - got);
+        if (n <= 0)
+        {
+          perror("read");
+          abort();
+        }
+        got += n;
+      }
+      latencies_->push_back(nowNanoSeconds() - start);
+    }
+    ::close(fd);
+
+    if (++gClientsDone == kClients)
+    {
+      gLoop->quit();
+    }
+  }
+
+  void run(oplib::PollerType type_, const char* name_, uint16_t port_)
+  {
+    oplib::EventLoop loop(type_);
+    gLoop = &loop;
+    gClientsDone = 0;
+
+    oplib::TCPServer server(&loop, oplib::InetAddress(port_), "echo");
+    server.setPollerType(type_);
+    server.setConnectionCallback(onConnection);
+    server.setMessageCallback(onMessage);
+    server.start();
+
+    std::vector<std::vector<int64_t>> latencies(kClients);
+    std::vector<std::unique_ptr<oplib::Thread>> clients;
+    for (int i = 0; i < kClients; ++i)
+    {
+      std::vector<int64_t>* out = &latencies[i];
+      clients.push_back(std::make_unique<oplib::Thread>([port_, out] {
+        usleep(100 * 1000);
+        client(port_, out);
+      }));
+      clients.back()->start();
+    }
+
+    // The connection setup is counted too, noise next to kRequests
+    uint64_t syscallsBefore = loop.pollerSyscalls();
+    uint64_t readsBefore = loop.readStats().reads;
+    loop.loop();
+    uint64_t syscalls = loop.pollerSyscalls() - syscallsBefore;
+    uint64_t reads = loop.readStats().reads - readsBefore;
+    for (auto& c : clients)
+    {
+      c->join();
+    }
+
+    std::vector<int64_t> all;
+    for (auto& l : latencies)
+    {
+      all.insert(all.end(), l.begin(), l.end());
+    }
+    std::sort(all.begin(), all.end());
+    const double requests = static_cast<double>(all.size());
+    const char* actual = loop.pollerType() == type_ ? "" : " (fallback to epoll)";
+    fprintf(stderr, "%-9s %10.3f %10.3f %10.1f %10.1f%s\n",
+            name_, syscalls / requests, reads / requests,
+            all[all.size() / 2] / 1000.0, all[all.size() * 99 / 100] / 1000.0, actual);
+  }
+}
+
+int main()
+{
+  fprintf(stderr, "%d clients x %d round trips of %zu bytes\n",
+          kClients, kRequests, kRequestBytes);
+  fprintf(stderr, "%-9s %10s %10s %10s %10s\n",
+          "backend", "poll/req", "read/req", "p50 us", "p99 us");
+  run(oplib::PollerType::POLL, "poll", kBasePort);
+  run(oplib::PollerType::EPOLL, "epoll", kBasePort + 1);
+  run(oplib::PollerType::IO_URING, "io_uring", kBasePort + 2);
+}
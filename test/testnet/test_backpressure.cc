@@ -0,0 +1,266 @@
+// Proxy with backpressure: a fast source writes kTotalBytes to the
+// proxy, which relays them to a sink reading at kSinkBytesPerSecond
+// through a small receive buffer. The proxy's outbound socket has a
+// small send buffer, and the sink only starts reading once the proxy
+// reported the high-water mark: the mark is reached whatever the CPU
+// count and the kernel's buffer autotuning. The outbound connection
+// throttles the inbound one, so the
+// proxy stops reading from the source at the high-water mark instead
+// of buffering everything. Checks that the sink gets every byte in
+// order, that the marks were hit, and that the proxy's pending output
+// peaked within one inbound read of the high-water mark. The same run
+// without throttle() must buffer many times the mark.
+#include <net/TCPServer.h>
+#include <net/TCPClient.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+#include <util/Timestamp.h>
+#include <TestCheck.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+namespace
+{
+  using oplib::test::check;
+
+  const uint16_t kProxyPort = 9988;
+  const uint16_t kSinkPort = 9989;
+  const size_t kTotalBytes = 32 * 1024 * 1024;
+  const size_t kHighWaterMark = 1024 * 1024;
+  const size_t kLowWaterMark = 256 * 1024;
+  const size_t kSinkBytesPerSecond = 32 * 1024 * 1024;
+  const int kSinkReceiveBuffer = 64 * 1024;
+  const int kOutboundSendBuffer = 64 * 1024;
+  // The sink reads anyway past it, the checks then fail
+  const int kMarkTimeoutMs = 10 * 1000;
+  // One read of the inbound connection: its input buffer, at most
+  // the largest BufferPool class, and the loop's overflow buffer
+  const size_t kMaxReadBytes = 128 * 1024 + 64 * 1024;
+
+  oplib::EventLoop* gLoop;
+  oplib::TCPConnectionPtr gOutbound;
+  bool gThrottle;
+  // Read by the sink
+  std::atomic_int gHighMarks;
+  int gLowMarks;
+  size_t gMaxPending;
+
+  char patternAt(size_t i_)
+  { return static_cast<char>('a' + i_ % 26); }
+
+  int connectTo(uint16_t port_)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+    return fd;
+  }
+
+  void source()
+  {
+    usleep(200 * 1000);
+    int fd = connectTo(kProxyPort);
+    std::string chunk(64 * 1024, 0);
+    size_t sent = 0;
+    while (sent < kTotalBytes)
+    {
+      for (size_t i = 0; i < chunk.size(); ++i)
+      {
+        chunk[i] = patternAt(sent + i);
+      }
+      size_t off = 0;
+      while (off < chunk.size())
+      {
+        ssize_t n = ::write(fd, chunk.data() + off, chunk.size() - off);
+        if (n <= 0)
+        {
+          perror("write");
+          abort();
+        }
+        off += n;
+      }
+      sent += chunk.size();
+    }
+    ::close(fd);
+  }
+
+  // Reads at kSinkBytesPerSecond at most, checks the bytes
+  void sink(int listenFd_, size_t* received_, bool* intact_)
+  {
+    int fd = ::accept(listenFd_, nullptr, nullptr);
+    // Nothing read until the proxy's output piled up
+    for (int waited = 0; gHighMarks == 0 && waited < kMarkTimeoutMs; ++waited)
+    {
+      usleep(1000);
+    }
+    char buf[16 * 1024];
+    const oplib::Timestamp start(oplib::Timestamp::now());
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+      for (ssize_t i = 0; i < n; ++i)
+      {
+        *intact_ = *intact_ && buf[i] == patternAt(*received_ + i);
+      }
+      *received_ += n;
+      // Wait until the bytes so far are due
+      const int64_t due = static_cast<int64_t>(static_cast<double>(*received_) /
+                                               kSinkBytesPerSecond *
+                                               oplib::Timestamp::numMicroSecondsInSeconds);
+      const int64_t elapsed = oplib::Timestamp::now() - start;
+      if (due > elapsed)
+      {
+        usleep(static_cast<useconds_t>(due - elapsed));
+      }
+    }
+    ::close(fd);
+    gLoop->quit();
+  }
+
+  // Only the outbound connection has output queued
+  void samplePending()
+  {
+    gMaxPending = std::max<size_t>(
+      gMaxPending, gLoop->load().pendingOutputBytes.load(std::memory_order_relaxed));
+  }
+
+  void onInboundConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      if (gThrottle)
+      {
+        // The inbound stops reading while the outbound is above its mark
+        gOutbound->throttle(conn_);
+      }
+    }
+    else
+    {
+      gOutbound->shutdown();
+    }
+  }
+
+  void onInboundMessage(const oplib::TCPConnectionPtr&,
+                        oplib::ds::Buffer* buf_,
+                        oplib::Timestamp)
+  {
+    gOutbound->send(buf_);
+    // Pending output only grows here
+    samplePending();
+  }
+
+  void onOutboundConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      gOutbound = conn_;
+      conn_->setHighWaterMarkCallback(
+        [] (const oplib::TCPConnectionPtr&, size_t) { ++gHighMarks; },
+        kHighWaterMark);
+      conn_->setLowWaterMarkCallback(
+        [] (const oplib::TCPConnectionPtr&) { ++gLowMarks; },
+        kLowWaterMark);
+    }
+  }
+
+  int listenSink()
+  {
+    int listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // Inherited by the accepted socket: the kernel can't soak the stream up
+    int rcvbuf = kSinkReceiveBuffer;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kSinkPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listenFd, 1) < 0)
+    {
+      perror("sink");
+      abort();
+    }
+    return listenFd;
+  }
+
+  void run(bool throttle_)
+  {
+    gThrottle = throttle_;
+    gHighMarks = 0;
+    gLowMarks = 0;
+    gMaxPending = 0;
+
+    int listenFd = listenSink();
+    size_t received = 0;
+    bool intact = true;
+    oplib::Thread sinkThread(std::bind(sink, listenFd, &received, &intact));
+    oplib::Thread writer(source);
+
+    {
+      oplib::EventLoop loop;
+      gLoop = &loop;
+
+      oplib::TCPClient client(&loop, oplib::InetAddress("127.0.0.1", kSinkPort), "outbound");
+      client.setConnectionCallback(onOutboundConnection);
+      // The kernel can't take in the relayed bytes either
+      client.setSendBufferSize(kOutboundSendBuffer);
+      client.connect();
+
+      oplib::TCPServer server(&loop, oplib::InetAddress(kProxyPort), "proxy");
+      server.setConnectionCallback(onInboundConnection);
+      server.setMessageCallback(onInboundMessage);
+      server.start();
+
+      sinkThread.start();
+      writer.start();
+      loop.loop();
+      writer.join();
+      sinkThread.join();
+      gOutbound.reset();
+    }
+    ::close(listenFd);
+
+    printf("%s: %zu bytes %s, max pending %zu, %d high / %d low marks\n",
+           throttle_ ? "throttled" : "not throttled", received,
+           intact ? "intact" : "corrupted", gMaxPending, gHighMarks.load(), gLowMarks);
+    check(received == kTotalBytes, "bytes received", static_cast<long long>(received));
+    check(intact, "bytes corrupted");
+    check(gHighMarks > 0, "high-water mark never reached");
+    if (throttle_)
+    {
+      check(gLowMarks > 0, "low-water mark never reached");
+      check(gMaxPending <= kHighWaterMark + kMaxReadBytes, "throttled: pending above the mark",
+            static_cast<long long>(gMaxPending));
+    }
+    else
+    {
+      check(gMaxPending > 8 * kHighWaterMark, "not throttled: pending bounded anyway",
+            static_cast<long long>(gMaxPending));
+    }
+  }
+}
+
+int main()
+{
+  run(true);
+  run(false);
+  return oplib::test::result();
+}
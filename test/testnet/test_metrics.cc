@@ -0,0 +1,221 @@
+// LoopMetrics: an echo server with kThreads IO loops and a timer on
+// each, kClients clients doing kRequests round trips. The main thread
+// scrapes the snapshots while the loops run, then checks the final
+// ones against the traffic: bytes and syscalls of the loops match
+// those of their connections, every dispatcher type seen is timed.
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+  const uint16_t kPort = 9994;
+  const int kThreads = 2;
+  const int kClients = 4;
+  const int kRequests = 2000;
+  const size_t kRequestBytes = 100;
+
+  const char* const kTypeNames[] = {
+    "wakeup", "timer", "listener", "connector", "connection", "other"
+  };
+
+  oplib::EventLoop* gLoop;
+  std::atomic_int gClientsDone { 0 };
+  std::atomic_int gConnectionsClosed { 0 };
+  std::mutex gMutex;
+  // Connection counters, as they were when the connection closed
+  oplib::IOCounters::Snapshot gClosed = {};
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (!conn_->connected())
+    {
+      oplib::IOCounters::Snapshot io = conn_->ioStats();
+      std::lock_guard<std::mutex> lock(gMutex);
+      gClosed.bytesRead += io.bytesRead;
+      gClosed.bytesWritten += io.bytesWritten;
+      gClosed.readCalls += io.readCalls;
+      gClosed.writeCalls += io.writeCalls;
+      ++gConnectionsClosed;
+    }
+  }
+
+  void onMessage(const oplib::TCPConnectionPtr& conn_,
+                 oplib::ds::Buffer* buf_,
+                 oplib::Timestamp)
+  {
+    conn_->send(buf_);
+  }
+
+  void client()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+    char buf[kRequestBytes];
+    ::memset(buf, 'm', sizeof(buf));
+    for (int i = 0; i < kRequests; ++i)
+    {
+      if (::write(fd, buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)))
+      {
+        perror("write");
+        abort();
+      }
+      size_t got = 0;
+      while (got < sizeof(buf))
+      {
+        ssize_t n = ::read(fd, buf + got, sizeof(buf) - got);
+        if (n <= 0)
+        {
+          perror("read");
+          abort();
+        }
+        got += n;
+      }
+    }
+    ::close(fd);
+  }
+
+  void print(const char* name_, const oplib::Histogram::Snapshot& h_)
+  {
+    printf("  %-12s %8llu %10.1f %8llu %8llu %8llu\n", name_,
+           static_cast<unsigned long long>(h_.count), h_.mean(),
+           static_cast<unsigned long long>(h_.percentile(0.5)),
+           static_cast<unsigned long long>(h_.percentile(0.99)),
+           static_cast<unsigned long long>(h_.max));
+  }
+}
+
+int main()
+{
+  oplib::EventLoop loop;
+  gLoop = &loop;
+
+  oplib::TCPServer server(&loop, oplib::InetAddress(kPort), "metrics");
+  server.setNumThreads(kThreads);
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+
+  std::vector<oplib::EventLoop*> ioLoops = server.ioLoops();
+  for (oplib::EventLoop* ioLoop : ioLoops)
+  {
+    ioLoop->runInLoop([ioLoop] { ioLoop->runEvery(0.002, [] {}); });
+  }
+
+  std::vector<std::unique_ptr<oplib::Thread>> clients;
+  for (int i = 0; i < kClients; ++i)
+  {
+    clients.push_back(std::make_unique<oplib::Thread>([] {
+      client();
+      ++gClientsDone;
+    }));
+  }
+
+  // Scrapes from another thread while the loops run
+  uint64_t scrapes = 0;
+  bool monotonic = true;
+  oplib::Thread scraper([&] {
+    uint64_t lastBytes = 0;
+    while (gClientsDone < kClients)
+    {
+      uint64_t bytes = 0;
+      for (oplib::EventLoop* ioLoop : ioLoops)
+      {
+        bytes += ioLoop->metrics().snapshot().io.bytesRead;
+      }
+      monotonic = monotonic && bytes >= lastBytes;
+      lastBytes = bytes;
+      ++scrapes;
+      usleep(1000);
+    }
+    // The close of the last connections, counted by the IO loops
+    for (int i = 0; i < 10 * 1000 && gConnectionsClosed < kClients; ++i)
+    {
+      usleep(1000);
+    }
+    gLoop->quit();
+  });
+
+  for (auto& c : clients)
+  {
+    c->start();
+  }
+  scraper.start();
+  loop.loop();
+  for (auto& c : clients)
+  {
+    c->join();
+  }
+  scraper.join();
+
+  oplib::IOCounters::Snapshot io = {};
+  bool timed = true;
+  for (size_t i = 0; i < ioLoops.size(); ++i)
+  {
+    oplib::LoopMetrics::Snapshot snap = ioLoops[i]->metrics().snapshot();
+    io.bytesRead += snap.io.bytesRead;
+    io.bytesWritten += snap.io.bytesWritten;
+    io.readCalls += snap.io.readCalls;
+    io.writeCalls += snap.io.writeCalls;
+    timed = timed && snap.iteration.count > 0 && snap.timerLateness.count > 0 &&
+            snap.callback[static_cast<int>(oplib::DispatcherType::TIMER)].count > 0;
+
+    printf("loop %zu: %llu bytes in, %llu out, %llu reads, %llu writes\n", i,
+           static_cast<unsigned long long>(snap.io.bytesRead),
+           static_cast<unsigned long long>(snap.io.bytesWritten),
+           static_cast<unsigned long long>(snap.io.readCalls),
+           static_cast<unsigned long long>(snap.io.writeCalls));
+    printf("  %-12s %8s %10s %8s %8s %8s\n", "us / count", "samples", "mean", "p50", "p99", "max");
+    print("iteration", snap.iteration);
+    print("poll wait", snap.pollWait);
+    for (int t = 0; t < oplib::LoopMetrics::kDispatcherTypes; ++t)
+    {
+      if (snap.callback[t].count > 0)
+      {
+        print(kTypeNames[t], snap.callback[t]);
+      }
+    }
+    print("functors", snap.pendingFunctors);
+    print("timer late", snap.timerLateness);
+  }
+
+  const uint64_t total = static_cast<uint64_t>(kClients) * kRequests * kRequestBytes;
+  std::lock_guard<std::mutex> lock(gMutex);
+  const bool counted = gConnectionsClosed == kClients &&
+                       io.bytesRead == total && io.bytesWritten == total &&
+                       io.bytesRead == gClosed.bytesRead && io.readCalls == gClosed.readCalls &&
+                       io.writeCalls == gClosed.writeCalls && io.readCalls >= kClients * kRequests;
+  const bool ok = counted && timed && monotonic && scrapes > 0;
+  printf("RESULT %s: %llu of %llu bytes, %d of %d connections closed, %llu scrapes%s%s\n",
+         ok ? "OK" : "BAD",
+         static_cast<unsigned long long>(io.bytesRead),
+         static_cast<unsigned long long>(total),
+         gConnectionsClosed.load(), kClients,
+         static_cast<unsigned long long>(scrapes),
+         monotonic ? "" : ", went backwards",
+         timed ? "" : ", not timed");
+  return ok ? 0 : 1;
+}
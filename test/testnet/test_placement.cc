@@ -0,0 +1,181 @@
+// Connection placement of EventLoopThreadPool: kLoops IO loops with
+// skewed Load values set by hand, then kPicks calls of getNextLoop()
+// per policy. LEAST_CONNECTIONS and LEAST_PENDING_BYTES always pick
+// the least loaded loop and spread ties. POWER_OF_TWO_CHOICES picks
+// the better of two random loops: with connections 0, 1, 2 and 3 the
+// loops are picked 1/2, 1/3, 1/6 of the time and the last never.
+// The loops are idle: they only publish their own load on a poll
+// timeout, seconds away. Also checks that setBusyPoll() reaches the
+// loops serving the connections, the master loop if there are no IO
+// loops.
+#include <net/EventLoop.h>
+#include <net/EventLoopThreadPool.h>
+#include <TestCheck.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+namespace
+{
+  const int kLoops = 4;
+  const int kPicks = 12000;
+
+  using oplib::test::check;
+
+  void setLoad(const std::vector<oplib::EventLoop*>& loops_,
+               const int connections_[kLoops],
+               const int64_t pendingOutputBytes_[kLoops],
+               const int busyPermille_[kLoops])
+  {
+    for (int i = 0; i < kLoops; ++i)
+    {
+      oplib::EventLoop::Load& load = loops_[i]->load();
+      load.connections.store(connections_[i], std::memory_order_relaxed);
+      load.pendingOutputBytes.store(pendingOutputBytes_[i], std::memory_order_relaxed);
+      load.busyPermille.store(busyPermille_[i], std::memory_order_relaxed);
+    }
+  }
+
+  // How many times each loop is picked
+  std::vector<int> pick(oplib::EventLoopThreadPool* pool_,
+                        const std::vector<oplib::EventLoop*>& loops_)
+  {
+    std::vector<int> picked(kLoops, 0);
+    for (int n = 0; n < kPicks; ++n)
+    {
+      oplib::EventLoop* loop = pool_->getNextLoop();
+      for (int i = 0; i < kLoops; ++i)
+      {
+        if (loops_[i] == loop)
+        {
+          ++picked[i];
+        }
+      }
+    }
+    printf("  picked %d %d %d %d\n", picked[0], picked[1], picked[2], picked[3]);
+    return picked;
+  }
+
+  // Within 3% of kPicks of the expected share
+  bool near(int picked_, double share_)
+  {
+    return abs(picked_ - static_cast<int>(share_ * kPicks)) <= kPicks * 3 / 100;
+  }
+
+  void testLeastConnections(oplib::EventLoopThreadPool* pool_,
+                            const std::vector<oplib::EventLoop*>& loops_)
+  {
+    printf("least connections:\n");
+    pool_->setPlacementPolicy(oplib::PlacementPolicy::LEAST_CONNECTIONS);
+    // Fewest connections, most output bytes and busy: only connections count
+    const int connections[kLoops] = { 5, 1, 7, 3 };
+    const int64_t bytes[kLoops] = { 0, 1 << 20, 0, 0 };
+    const int busy[kLoops] = { 0, 900, 0, 0 };
+    setLoad(loops_, connections, bytes, busy);
+    std::vector<int> picked = pick(pool_, loops_);
+    check(picked[1] == kPicks, "least connections: not the least loaded", picked[1]);
+
+    // Ties spread evenly
+    const int tied[kLoops] = { 2, 2, 9, 9 };
+    setLoad(loops_, tied, bytes, busy);
+    picked = pick(pool_, loops_);
+    check(picked[0] + picked[1] == kPicks, "least connections: tie lost",
+          picked[2] + picked[3]);
+    check(near(picked[0], 0.5) && near(picked[1], 0.5), "least connections: ties uneven",
+          picked[0]);
+  }
+
+  void testLeastPendingBytes(oplib::EventLoopThreadPool* pool_,
+                             const std::vector<oplib::EventLoop*>& loops_)
+  {
+    printf("least pending bytes:\n");
+    pool_->setPlacementPolicy(oplib::PlacementPolicy::LEAST_PENDING_BYTES);
+    const int connections[kLoops] = { 0, 0, 50, 0 };
+    const int64_t bytes[kLoops] = { 1 << 20, 4096, 0, int64_t(1) << 30 };
+    const int busy[kLoops] = { 0, 0, 900, 0 };
+    setLoad(loops_, connections, bytes, busy);
+    std::vector<int> picked = pick(pool_, loops_);
+    check(picked[2] == kPicks, "least pending bytes: not the least loaded", picked[2]);
+  }
+
+  void testPowerOfTwoChoices(oplib::EventLoopThreadPool* pool_,
+                             const std::vector<oplib::EventLoop*>& loops_)
+  {
+    printf("power of two choices:\n");
+    pool_->setPlacementPolicy(oplib::PlacementPolicy::POWER_OF_TWO_CHOICES);
+    // Of the 6 pairs, 3 hold loop 0, 2 hold loop 1 and not loop 0, ...
+    const int connections[kLoops] = { 0, 1, 2, 3 };
+    const int64_t bytes[kLoops] = { 0, 0, 0, 0 };
+    const int busy[kLoops] = { 1000, 0, 0, 0 };
+    setLoad(loops_, connections, bytes, busy);
+    std::vector<int> picked = pick(pool_, loops_);
+    check(picked[3] == 0, "two choices: the most loaded picked", picked[3]);
+    check(near(picked[0], 1.0 / 2), "two choices: loop 0", picked[0]);
+    check(near(picked[1], 1.0 / 3), "two choices: loop 1", picked[1]);
+    check(near(picked[2], 1.0 / 6), "two choices: loop 2", picked[2]);
+
+    // Same connections: the less busy of the two
+    const int same[kLoops] = { 4, 4, 4, 4 };
+    const int skewed[kLoops] = { 900, 100, 900, 500 };
+    setLoad(loops_, same, bytes, skewed);
+    picked = pick(pool_, loops_);
+    check(near(picked[1], 1.0 / 2), "two choices: least busy", picked[1]);
+    check(near(picked[3], 1.0 / 3), "two choices: second least busy", picked[3]);
+    check(picked[0] + picked[2] <= kPicks / 6 + kPicks * 3 / 100, "two choices: busiest",
+          picked[0] + picked[2]);
+  }
+
+  // One loop per thread at a time
+  void testBusyPoll()
+  {
+    {
+      oplib::EventLoop loop;
+      oplib::EventLoopThreadPool noThreads(&loop);
+      noThreads.setBusyPoll(20);
+      noThreads.start();
+      check(loop.busyPoll() == 20, "no IO loops: set before start", loop.busyPoll());
+      noThreads.setBusyPoll(50);
+      check(loop.busyPoll() == 50, "no IO loops: set while running", loop.busyPoll());
+      noThreads.setBusyPoll(0);
+      check(loop.busyPoll() == 0, "no IO loops: turned off", loop.busyPoll());
+    }
+
+    oplib::EventLoop master;
+    oplib::EventLoopThreadPool pool(&master);
+    pool.setNumThreads(2);
+    pool.setBusyPoll(20);
+    pool.start();
+    pool.setBusyPoll(30);
+    for (oplib::EventLoop* io : pool.getAllLoops())
+    {
+      check(io->busyPoll() == 30, "IO loop", io->busyPoll());
+    }
+    check(master.busyPoll() == 0, "master loop of IO loops", master.busyPoll());
+  }
+}
+
+int main()
+{
+  {
+    oplib::EventLoop loop;
+    oplib::EventLoopThreadPool pool(&loop);
+    pool.setNumThreads(kLoops);
+    pool.start();
+    const std::vector<oplib::EventLoop*> loops = pool.getAllLoops();
+
+    testLeastConnections(&pool, loops);
+    testLeastPendingBytes(&pool, loops);
+    testPowerOfTwoChoices(&pool, loops);
+
+    // Back to the real load before the loops stop
+    const int none[kLoops] = { 0, 0, 0, 0 };
+    const int64_t noBytes[kLoops] = { 0, 0, 0, 0 };
+    setLoad(loops, none, noBytes, none);
+  }
+  testBusyPoll();
+
+  return oplib::test::result();
+}
@@ -0,0 +1,238 @@
+// Adaptive input buffer sizing. A client doing kRoundTrips small
+// round trips, then one streaming kStreamBytes in 64KB writes.
+// The small reads keep the read size hint at the smallest size class
+// and never overflow. The stream grows the hint until nearly every
+// read lands in the input buffer: at most one read in kMaxOverflowRatio
+// goes through the loop's overflow buffer. Every hint plus the
+// prepend area is a whole BufferPool size class, and the loop's
+// ReadStats sum those of the connections.
+#include <net/TCPServer.h>
+#include <net/TCPConnection.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+#include <ds/BufferPool.h>
+#include <TestCheck.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+namespace
+{
+  using oplib::test::check;
+
+  const uint16_t kPort = 9995;
+  const int kRoundTrips = 2000;
+  const size_t kMessageBytes = 100;
+  const size_t kStreamBytes = 64 * 1024 * 1024;
+  const size_t kWriteBytes = 64 * 1024;
+  const uint64_t kMaxOverflowRatio = 50;
+
+  oplib::EventLoop* gLoop;
+  // One connection at a time: echoed, then drained
+  bool gEcho = true;
+  bool gHintsRounded = true;
+  size_t gMaxHint = 0;
+  std::atomic_int gClosedChatty { 0 };
+
+  struct Closed
+  {
+    uint64_t bytesRead;
+    uint64_t overflowReads;
+    size_t readSizeAverage;
+    size_t readSizeHint;
+    // The loop's, once closed
+    oplib::ReadStats loopReads;
+    // The largest hint seen by the message callback
+    size_t maxHint;
+  };
+  std::vector<Closed> gClosed;
+
+  bool isClassSize(size_t size_)
+  {
+    const int cls = oplib::ds::BufferPool::classOf(size_);
+    return cls >= 0 && oplib::ds::BufferPool::classSize(cls) == size_;
+  }
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (!conn_->connected())
+    {
+      gClosed.push_back(Closed { conn_->ioStats().bytesRead, conn_->overflowReads(),
+                                 conn_->readSizeAverage(), conn_->readSizeHint(),
+                                 gLoop->readStats(), gMaxHint });
+      // The next connection streams
+      gEcho = false;
+      gMaxHint = 0;
+      gClosedChatty = 1;
+      if (gClosed.size() == 2)
+      {
+        gLoop->quit();
+      }
+    }
+  }
+
+  void onMessage(const oplib::TCPConnectionPtr& conn_,
+                 oplib::ds::Buffer* buf_,
+                 oplib::Timestamp)
+  {
+    const size_t hint = conn_->readSizeHint();
+    gHintsRounded = gHintsRounded && isClassSize(hint + oplib::ds::Buffer::prependSize);
+    gMaxHint = std::max(gMaxHint, hint);
+    if (gEcho)
+    {
+      conn_->send(buf_);
+    }
+    else
+    {
+      buf_->retrieveAll();
+    }
+  }
+
+  int connectToServer()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+    return fd;
+  }
+
+  void chattyClient()
+  {
+    int fd = connectToServer();
+    char buf[kMessageBytes];
+    ::memset(buf, 'c', sizeof(buf));
+    for (int i = 0; i < kRoundTrips; ++i)
+    {
+      if (::write(fd, buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)))
+      {
+        perror("write");
+        abort();
+      }
+      size_t got = 0;
+      while (got < sizeof(buf))
+      {
+        ssize_t n = ::read(fd, buf + got, sizeof(buf) - got);
+        if (n <= 0)
+        {
+          perror("read");
+          abort();
+        }
+        got += n;
+      }
+    }
+    ::close(fd);
+  }
+
+  void streamingClient()
+  {
+    int fd = connectToServer();
+    std::vector<char> buf(kWriteBytes, 's');
+    size_t sent = 0;
+    while (sent < kStreamBytes)
+    {
+      ssize_t n = ::write(fd, buf.data(), buf.size());
+      if (n <= 0)
+      {
+        perror("write");
+        abort();
+      }
+      sent += n;
+    }
+    ::close(fd);
+  }
+
+  // Waits for the server to see the close before streaming
+  void client()
+  {
+    chattyClient();
+    while (gClosedChatty.load() == 0)
+    {
+      ::usleep(1000);
+    }
+    streamingClient();
+  }
+}
+
+int main()
+{
+  oplib::EventLoop loop;
+  gLoop = &loop;
+  oplib::TCPServer server(&loop, oplib::InetAddress(kPort), "readsize");
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+
+  const size_t smallestHint =
+      oplib::ds::BufferPool::classSize(oplib::ds::BufferPool::classOf(
+          oplib::ds::Buffer::initialSize + oplib::ds::Buffer::prependSize)) -
+      oplib::ds::Buffer::prependSize;
+
+  oplib::Thread clientThread(client);
+  clientThread.start();
+  loop.loop();
+  clientThread.join();
+
+  check(gClosed.size() == 2, "connections", static_cast<long long>(gClosed.size()));
+  if (gClosed.size() == 2)
+  {
+    const Closed& chatty = gClosed[0];
+    const Closed& stream = gClosed[1];
+    const oplib::ReadStats& afterChatty = chatty.loopReads;
+    const oplib::ReadStats& afterStream = stream.loopReads;
+    const uint64_t streamReads = afterStream.reads - afterChatty.reads;
+    printf("small reads: %llu bytes, average %zu, hint %zu, %llu overflows\n",
+           static_cast<unsigned long long>(chatty.bytesRead), chatty.readSizeAverage,
+           chatty.readSizeHint, static_cast<unsigned long long>(chatty.overflowReads));
+    printf("stream: %llu bytes in %llu reads, average %zu, hint up to %zu, %llu overflows\n",
+           static_cast<unsigned long long>(stream.bytesRead),
+           static_cast<unsigned long long>(streamReads), stream.readSizeAverage, stream.maxHint,
+           static_cast<unsigned long long>(stream.overflowReads));
+
+    check(chatty.bytesRead == kRoundTrips * kMessageBytes, "small reads: bytes",
+          static_cast<long long>(chatty.bytesRead));
+    check(chatty.overflowReads == 0, "small reads: overflowed",
+          static_cast<long long>(chatty.overflowReads));
+    // Eighths rounded down: the average settles up to 7 bytes off
+    check(chatty.readSizeAverage + 8 > kMessageBytes && chatty.readSizeAverage < kMessageBytes + 8,
+          "small reads: average",
+          static_cast<long long>(chatty.readSizeAverage));
+    check(chatty.maxHint == smallestHint, "small reads: hint grew",
+          static_cast<long long>(chatty.maxHint));
+    check(chatty.readSizeHint == smallestHint, "small reads: final hint",
+          static_cast<long long>(chatty.readSizeHint));
+
+    check(stream.bytesRead == kStreamBytes, "stream: bytes", static_cast<long long>(stream.bytesRead));
+    check(streamReads > 0 && stream.overflowReads * kMaxOverflowRatio <= streamReads,
+          "stream: too many overflows", static_cast<long long>(stream.overflowReads));
+    // The hint follows the reads, up to the largest size class
+    check(stream.maxHint > 4 * smallestHint, "stream: hint did not grow",
+          static_cast<long long>(stream.maxHint));
+    check(stream.readSizeHint >= std::min(2 * stream.readSizeAverage, stream.maxHint),
+          "stream: hint below twice the average", static_cast<long long>(stream.readSizeHint));
+
+    check(afterStream.overflowReads == chatty.overflowReads + stream.overflowReads,
+          "loop overflow reads", static_cast<long long>(afterStream.overflowReads));
+    check(afterChatty.reads >= static_cast<uint64_t>(kRoundTrips), "loop reads",
+          static_cast<long long>(afterChatty.reads));
+  }
+  check(gHintsRounded, "hint not a whole size class");
+
+  return oplib::test::result();
+}
@@ -0,0 +1,163 @@
+// Peers which reset their connection: kClients clients each send a
+// request and close at once with SO_LINGER 0, so an RST follows the
+// request. The server answers every request with kReplyBytes, into
+// a socket which is or soon will be reset: with write(2) to one
+// client, with writev(2) of two slices to the next. Its writes and
+// reads then fail with ECONNRESET or EPIPE, which must close the
+// connection, not abort the server. Level- and edge-triggered: every
+// connection must be closed, and the server must go on serving a
+// well-behaved client.
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+#include <TestCheck.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace
+{
+  const uint16_t kPort = 9996;
+  const int kClients = 200;
+  const size_t kReplyBytes = 256 * 1024;
+
+  oplib::EventLoop* gLoop;
+  std::atomic_int gConnections { 0 };
+  std::atomic_int gClosed { 0 };
+  std::atomic_bool gServed { false };
+  // Half of each reply, shared by the slices
+  const std::shared_ptr<const std::string> gHalfReply =
+    std::make_shared<const std::string>(kReplyBytes / 2, 'r');
+  using oplib::test::check;
+
+  int connectToServer()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+    return fd;
+  }
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      ++gConnections;
+    }
+    else
+    {
+      ++gClosed;
+    }
+  }
+
+  void onMessage(const oplib::TCPConnectionPtr& conn_,
+                 oplib::ds::Buffer* buf_,
+                 oplib::Timestamp)
+  {
+    const std::string request = buf_->retrieveAsString();
+    if (conn_->id() % 2 == 0)
+    {
+      conn_->send(std::string(kReplyBytes, 'r'));
+    }
+    else
+    {
+      conn_->send(oplib::SliceList{ oplib::Slice(gHalfReply), oplib::Slice(gHalfReply) });
+    }
+    if (request == "last")
+    {
+      conn_->shutdown();
+    }
+  }
+
+  void clients()
+  {
+    usleep(100 * 1000);
+    for (int i = 0; i < kClients; ++i)
+    {
+      int fd = connectToServer();
+      if (::write(fd, "request", 7) != 7)
+      {
+        perror("write");
+      }
+      // Sends an RST, whatever the server is writing
+      struct linger lingerOff = { 1, 0 };
+      ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lingerOff, sizeof(lingerOff));
+      ::close(fd);
+    }
+
+    // Still serving
+    int fd = connectToServer();
+    if (::write(fd, "last", 4) != 4)
+    {
+      perror("write");
+    }
+    size_t received = 0;
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+      received += n;
+    }
+    ::close(fd);
+    gServed = received == kReplyBytes;
+  }
+
+  void run(bool edgeTriggered_)
+  {
+    gConnections = 0;
+    gClosed = 0;
+    gServed = false;
+    {
+      oplib::EventLoop loop(oplib::PollerType::EPOLL);
+      gLoop = &loop;
+      oplib::TCPServer server(&loop, oplib::InetAddress(kPort), "reset");
+      server.setEdgeTriggered(edgeTriggered_);
+      server.setConnectionCallback(onConnection);
+      server.setMessageCallback(onMessage);
+      server.start();
+
+      oplib::Thread thread(clients);
+      thread.start();
+      // Until every connection is closed, 10s at most
+      loop.runEvery(0.01, [&loop] {
+        if (gClosed == kClients + 1)
+        {
+          loop.quit();
+        }
+      });
+      loop.runAfter(10.0, [&loop] { loop.quit(); });
+      loop.loop();
+      thread.join();
+    }
+    printf("%s: %d connections, %d closed, %s\n",
+           edgeTriggered_ ? "edge-triggered" : "level-triggered",
+           gConnections.load(), gClosed.load(), gServed ? "served" : "not served");
+    check(gConnections == kClients + 1, "connections", gConnections.load());
+    check(gClosed == kClients + 1, "closed", gClosed.load());
+    check(gServed, "last client not served");
+  }
+}
+
+int main()
+{
+  run(false);
+  run(true);
+  return oplib::test::result();
+}
@@ -0,0 +1,121 @@
+// sendFile(): every connection gets buffered data, a range of a temp
+// file, more buffered data, a second range and a trailer, in that
+// order. The client checks the bytes, the server that the write
+// complete callback fired. "et" as argument for an edge-triggered
+// epoll loop.
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <net/Slice.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+
+namespace
+{
+  const uint16_t kPort = 9990;
+  const size_t kFileBytes = 8 * 1024 * 1024;
+  const off_t kOffset1 = 1000;
+  const size_t kLen1 = 5 * 1024 * 1024;
+  const off_t kOffset2 = 7;
+  const size_t kLen2 = 300 * 1000;
+
+  int gFile = -1;
+  std::string gFileData;
+  std::atomic_int gWriteCompletes { 0 };
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (!conn_->connected())
+    {
+      return;
+    }
+    conn_->send(std::string("header\n"));
+    conn_->sendFile(gFile, kOffset1, kLen1);
+    conn_->send(oplib::SliceList{ oplib::Slice("between\n", 8) });
+    conn_->sendFile(gFile, kOffset2, kLen2);
+    conn_->send(std::string("trailer\n"));
+    conn_->shutdown();
+  }
+
+  void onWriteComplete(const oplib::TCPConnectionPtr&)
+  {
+    ++gWriteCompletes;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  bool edgeTriggered = argc > 1 && strcmp(argv[1], "et") == 0;
+
+  char path[] = "/tmp/oplib_sendfileXXXXXX";
+  gFile = ::mkstemp(path);
+  ::unlink(path);
+  for (size_t i = 0; i < kFileBytes; ++i)
+  {
+    gFileData.push_back(static_cast<char>('A' + (i * 7) % 26));
+  }
+  if (::write(gFile, gFileData.data(), gFileData.size()) != static_cast<ssize_t>(kFileBytes))
+  {
+    perror("write");
+    abort();
+  }
+
+  std::string expected = "header\n" + gFileData.substr(kOffset1, kLen1) + "between\n" +
+                         gFileData.substr(kOffset2, kLen2) + "trailer\n";
+
+  oplib::PollerType pollerType = edgeTriggered ? oplib::PollerType::EPOLL
+                                               : oplib::PollerType::POLL;
+  oplib::EventLoop loop(pollerType);
+  oplib::TCPServer server(&loop, oplib::InetAddress(kPort), "sendfileServer");
+  server.setPollerType(pollerType);
+  server.setEdgeTriggered(edgeTriggered);
+  server.setConnectionCallback(onConnection);
+  server.setWriteCompleteCallback(onWriteComplete);
+  server.start();
+
+  std::string received;
+  oplib::Thread client([&] {
+    usleep(100 * 1000);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+    // Slow start, so the socket buffer fills and the file
+    // ranges are sent from handleWrite()
+    usleep(100 * 1000);
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+      received.append(buf, n);
+    }
+    ::close(fd);
+    loop.quit();
+  });
+  client.start();
+  loop.loop();
+  client.join();
+  ::close(gFile);
+
+  const bool ok = received == expected && gWriteCompletes > 0;
+  printf("RESULT %s: %zu bytes of %zu, %d write completes\n", ok ? "OK" : "BAD",
+         received.size(), expected.size(), gWriteCompletes.load());
+  return ok ? 0 : 1;
+}
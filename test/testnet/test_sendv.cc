@@ -0,0 +1,129 @@
+// Scatter/gather send: every connection gets a small header built on
+// the fly plus a body shared by all connections, written with one
+// writev and no copy of the body. The header is a view, overwritten
+// right after send() returns: what the socket could not take must have
+// been copied. kClients clients connect at once, read until the server
+// shuts down and check they got exactly the header and the body.
+#include <net/TCPServer.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <net/Slice.h>
+#include <thread/Thread.h>
+#include <ds/Buffer.h>
+#include <util/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const uint16_t kPort = 9981;
+  const int kClients = 4;
+
+  oplib::EventLoop* gLoop;
+  std::shared_ptr<const std::string> gBody;
+  std::atomic_int gClientsDone { 0 };
+  std::atomic_int gClientsOk { 0 };
+
+  std::string headerOf(size_t length_)
+  {
+    return "Length: " + std::to_string(length_) + "\r\n\r\n";
+  }
+
+  void onConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      // The header is a view, only copied if the socket can't take it all
+      std::string header = headerOf(gBody->size());
+      conn_->send(oplib::SliceList{ oplib::Slice(header), oplib::Slice(gBody) });
+      header.assign(header.size(), 'X');
+      conn_->shutdown();
+    }
+  }
+
+  void onMessage(const oplib::TCPConnectionPtr& conn_,
+                 oplib::ds::Buffer* buf_,
+                 oplib::Timestamp receiveTime_)
+  {
+    buf_->retrieveAll();
+  }
+
+  // Reads until the server shuts the connection down
+  bool client()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+      perror("connect");
+      ::close(fd);
+      return false;
+    }
+    std::string got;
+    char buf[65536];
+    ssize_t n = 0;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+      got.append(buf, n);
+    }
+    ::close(fd);
+    return got == headerOf(gBody->size()) + *gBody;
+  }
+}
+
+int main()
+{
+  std::string body;
+  for (int i = 0; i < 1000 * 1000; ++i)
+  {
+    body.push_back(static_cast<char>('A' + i % 26));
+  }
+  gBody = std::make_shared<const std::string>(std::move(body));
+
+  oplib::InetAddress listenAddr(kPort);
+  oplib::EventLoop loop;
+  gLoop = &loop;
+
+  oplib::TCPServer server(&loop, listenAddr, "sendvServer");
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+
+  std::vector<std::unique_ptr<oplib::Thread>> clients;
+  for (int i = 0; i < kClients; ++i)
+  {
+    clients.push_back(std::make_unique<oplib::Thread>([] {
+      if (client())
+      {
+        ++gClientsOk;
+      }
+      if (++gClientsDone == kClients)
+      {
+        gLoop->quit();
+      }
+    }));
+    clients.back()->start();
+  }
+  loop.loop();
+  for (auto& c : clients)
+  {
+    c->join();
+  }
+
+  const bool ok = gClientsOk == kClients;
+  printf("RESULT %s: %d of %d clients got %zu bytes intact\n", ok ? "OK" : "BAD",
+         gClientsOk.load(), kClients, headerOf(gBody->size()).size() + gBody->size());
+  return ok ? 0 : 1;
+}
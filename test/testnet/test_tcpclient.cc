@@ -0,0 +1,230 @@
+// TCPConnectionPool against an echo server: kRequests line requests,
+// kConcurrency of them outstanding at a time, over at most kMaxInFlight
+// connections. Checks every response and that the server saw no more
+// connections than the pool limit: requests reuse idle connections.
+// Then a pool to a port nobody listens on: its kConcurrency requests
+// must fail, within the connect timeout, and the pool drop its clients.
+
+#include <net/TCPServer.h>
+#include <net/TCPConnectionPool.h>
+#include <net/EventLoop.h>
+#include <net/InetAddress.h>
+#include <ds/Buffer.h>
+#include <util/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace
+{
+  const uint16_t kPort = 9986;
+  const int kRequests = 2000;
+  const int kConcurrency = 16;
+  const size_t kMaxInFlight = 4;
+  const size_t kMaxIdle = 4;
+  const double kConnectTimeout = 0.3;
+
+  std::atomic_int gServerConnections { 0 };
+
+  void onServerConnection(const oplib::TCPConnectionPtr& conn_)
+  {
+    if (conn_->connected())
+    {
+      ++gServerConnections;
+    }
+  }
+
+  void onServerMessage(const oplib::TCPConnectionPtr& conn_,
+                       oplib::ds::Buffer* buf_,
+                       oplib::Timestamp)
+  {
+    conn_->send(buf_->retrieveAsString());
+  }
+
+  // A loopback port nothing listens on
+  uint16_t unusedPort()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) < 0)
+    {
+      perror("unusedPort");
+    }
+    ::close(fd);
+    return ntohs(addr.sin_port);
+  }
+
+  class Requester
+  {
+   public:
+    Requester(oplib::TCPConnectionPool* pool_, const std::function<void()>& done_)
+    : _pool(pool_), _doneCallback(done_), _sent(0), _done(0), _failed(0)
+    {
+      using namespace std::placeholders;
+      _pool->setMessageCallback(std::bind(&Requester::onMessage, this, _1, _2, _3));
+    }
+
+    void start()
+    {
+      for (int i = 0; i < kConcurrency; ++i)
+      {
+        sendNext();
+      }
+    }
+
+    int done() const { return _done; }
+    int failed() const { return _failed; }
+
+   private:
+    void sendNext()
+    {
+      if (_sent == kRequests)
+      {
+        return;
+      }
+      std::string request = "request " + std::to_string(_sent++) + "\n";
+      _pool->acquire([this, request] (const oplib::TCPConnectionPtr& conn_) {
+        if (!conn_)
+        {
+          ++_failed;
+          finish();
+          return;
+        }
+        _pending[conn_.get()] = request;
+        conn_->send(request);
+      });
+    }
+
+    void onMessage(const oplib::TCPConnectionPtr& conn_,
+                   oplib::ds::Buffer* buf_,
+                   oplib::Timestamp)
+    {
+      const std::string& expected = _pending[conn_.get()];
+      if (buf_->readableBytes() < expected.size())
+      {
+        return;
+      }
+      if (buf_->retrieveAsString(expected.size()) != expected)
+      {
+        ++_failed;
+      }
+      _pending.erase(conn_.get());
+      _pool->release(conn_);
+      finish();
+    }
+
+    void finish()
+    {
+      if (++_done == kRequests)
+      {
+        _doneCallback();
+      }
+      sendNext();
+    }
+
+    oplib::TCPConnectionPool* _pool;
+    std::function<void()> _doneCallback;
+    int _sent;
+    int _done;
+    int _failed;
+    // Request in flight on each connection
+    std::map<oplib::TCPConnection*, std::string> _pending;
+  };
+
+  // kConcurrency requests to the pool, counts those failed
+  class Unreachable
+  {
+   public:
+    Unreachable(oplib::EventLoop* loop_, oplib::TCPConnectionPool* pool_)
+    : _loop(loop_), _pool(pool_), _failed(0), _connected(0), _lastFailure(0.0)
+    {}
+
+    void start()
+    {
+      _start = oplib::Timestamp::now();
+      for (int i = 0; i < kConcurrency; ++i)
+      {
+        _pool->acquire([this] (const oplib::TCPConnectionPtr& conn_) {
+          if (conn_)
+          {
+            ++_connected;
+            return;
+          }
+          _lastFailure = static_cast<double>(oplib::Timestamp::now() - _start) /
+                         oplib::Timestamp::numMicroSecondsInSeconds;
+          if (++_failed == kConcurrency)
+          {
+            _loop->quit();
+          }
+        });
+      }
+    }
+
+    int failed() const { return _failed; }
+    int connected() const { return _connected; }
+    // Seconds from start() to the last failure
+    double lastFailure() const { return _lastFailure; }
+
+   private:
+    oplib::EventLoop* _loop;
+    oplib::TCPConnectionPool* _pool;
+    oplib::Timestamp _start;
+    int _failed;
+    int _connected;
+    double _lastFailure;
+  };
+}
+
+int main()
+{
+  oplib::EventLoop loop;
+  oplib::InetAddress addr("127.0.0.1", kPort);
+  oplib::InetAddress deadAddr("127.0.0.1", unusedPort());
+
+  oplib::TCPServer server(&loop, oplib::InetAddress(kPort), "echoServer", 1);
+  server.setConnectionCallback(onServerConnection);
+  server.setMessageCallback(onServerMessage);
+  server.start();
+
+  bool ok = false;
+  {
+    oplib::TCPConnectionPool pool(&loop, addr, "pool", kMaxInFlight, kMaxIdle);
+    oplib::TCPConnectionPool deadPool(&loop, deadAddr, "deadPool", kMaxInFlight, kMaxIdle);
+    deadPool.setConnectTimeout(kConnectTimeout);
+    Unreachable unreachable(&loop, &deadPool);
+    Requester requester(&pool, std::bind(&Unreachable::start, &unreachable));
+    loop.runAfter(0.1, std::bind(&Requester::start, &requester));
+    // Neither may hang the test
+    loop.runAfter(30.0, [&loop] { loop.quit(); });
+    loop.loop();
+
+    const bool served = requester.failed() == 0 && requester.done() == kRequests &&
+                        gServerConnections <= static_cast<int>(kMaxInFlight);
+    printf("%d responses, %d bad, %d server connections, %zu idle\n",
+           requester.done(), requester.failed(), gServerConnections.load(), pool.numIdle());
+    // The first attempts to time out fail them all, scheduling aside
+    const bool failed = unreachable.failed() == kConcurrency && unreachable.connected() == 0 &&
+                        unreachable.lastFailure() >= kConnectTimeout &&
+                        unreachable.lastFailure() <= kConnectTimeout + 0.5 &&
+                        deadPool.numConnections() == 0 &&
+                        deadPool.numWaiting() == 0;
+    printf("unreachable: %d failed, %d connected, last after %.3fs, %zu clients, %zu waiting\n",
+           unreachable.failed(), unreachable.connected(), unreachable.lastFailure(),
+           deadPool.numConnections(), deadPool.numWaiting());
+    ok = served && failed;
+  }
+  printf("RESULT %s\n", ok ? "OK" : "BAD");
+  return ok ? 0 : 1;
+}
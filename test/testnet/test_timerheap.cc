@@ -0,0 +1,211 @@
+// TimerHeap and the pooled TimerIds. The heap is driven with a
+// simulated clock: a random mix of inserts, removes from any position
+// and advances must hand back exactly the timers due, earliest first.
+// Then on an EventLoop with either timer queue: a TimerId whose timer
+// was recycled for another one cancels nothing, a repeating timer
+// cancelling itself from its callback stops, a timer added from
+// another thread can be cancelled right away, and one the loop never
+// got to adopt is freed with the loop.
+#include <net/EventLoop.h>
+#include <net/TimerHeap.h>
+#include <net/TimerManager.h>
+#include <thread/Thread.h>
+#include <util/Timestamp.h>
+#include <TestCheck.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+  using oplib::test::check;
+
+  const char* nameOf(oplib::TimerQueueType type_)
+  {
+    return type_ == oplib::TimerQueueType::HEAP ? "heap" : "wheel";
+  }
+
+  // Random operations against a multimap of the pending timers
+  void testHeapRandom()
+  {
+    std::mt19937_64 rng(7);
+    oplib::TimerHeap heap;
+    std::vector<std::unique_ptr<oplib::Timer>> timers;
+    std::multimap<int64_t, oplib::Timer*> pending;
+    int64_t now = 1000000000LL;
+    int64_t expiredCount = 0;
+
+    for (int round = 0; round < 50000; ++round)
+    {
+      const int op = static_cast<int>(rng() % 10);
+      if (op < 5)
+      {
+        // Few distinct times: many ties
+        const int64_t when = now + static_cast<int64_t>(rng() % 500) * 10;
+        timers.push_back(std::make_unique<oplib::Timer>());
+        oplib::Timer* timer = timers.back().get();
+        timer->init([] {}, oplib::Timestamp(when), 0.0);
+        heap.insert(timer);
+        pending.emplace(when, timer);
+      }
+      else if (op < 7 && !pending.empty())
+      {
+        // Anywhere in the heap, not only the top
+        auto it = pending.begin();
+        std::advance(it, static_cast<long>(rng() % pending.size()));
+        heap.remove(it->second);
+        check(!it->second->active(), "heap: removed timer still active");
+        pending.erase(it);
+      }
+      else
+      {
+        now += static_cast<int64_t>(rng() % 300);
+        std::vector<oplib::Timer*> expired;
+        heap.advance(oplib::Timestamp(now), &expired);
+        int64_t last = 0;
+        for (oplib::Timer* timer : expired)
+        {
+          const int64_t when = timer->expireTime().microseconds();
+          check(when <= now, "heap: expired early", when - now);
+          check(when >= last, "heap: out of order", when - last);
+          check(!timer->active(), "heap: expired timer still active");
+          last = when;
+          auto range = pending.equal_range(when);
+          bool found = false;
+          for (auto it = range.first; it != range.second; ++it)
+          {
+            if (it->second == timer)
+            {
+              pending.erase(it);
+              found = true;
+              break;
+            }
+          }
+          check(found, "heap: expired an unknown timer");
+        }
+        expiredCount += static_cast<int64_t>(expired.size());
+        check(pending.empty() || pending.begin()->first > now, "heap: left a due timer");
+      }
+
+      check(heap.size() == pending.size(), "heap: size", static_cast<long long>(heap.size()));
+      if (!pending.empty())
+      {
+        check(heap.nextExpiration().microseconds() == pending.begin()->first,
+              "heap: next expiration");
+      }
+    }
+    check(expiredCount > 0, "heap: nothing expired");
+
+    std::vector<oplib::Timer*> rest;
+    heap.removeAll(&rest);
+    check(rest.size() == pending.size() && heap.empty(), "heap: removeAll",
+          static_cast<long long>(rest.size()));
+    check(!heap.nextExpiration().valid(), "heap: empty next expiration");
+  }
+
+  // A TimerId outliving its timer: the pool hands the same Timer
+  // to the next timer added, the old id must not cancel it
+  void testStaleTimerId(oplib::TimerQueueType type_)
+  {
+    oplib::EventLoop loop(oplib::PollerType::POLL, type_);
+    int first = 0;
+    int second = 0;
+    oplib::TimerId stale = loop.runAfter(0.001, [&first] { ++first; });
+    loop.runAfter(0.02, [&] {
+      // The first one was released by now, this one takes its place
+      loop.runAfter(0.01, [&second] { ++second; });
+      loop.cancel(stale);
+      // Cancelling twice is harmless as well
+      loop.cancel(stale);
+    });
+    loop.runAfter(0.1, [&loop] { loop.quit(); });
+    loop.loop();
+    check(first == 1, "stale: first timer", first);
+    check(second == 1, "stale TimerId cancelled the new timer", second);
+  }
+
+  // cancel() of its own id from within the callback of a repeating timer
+  void testSelfCancel(oplib::TimerQueueType type_)
+  {
+    oplib::EventLoop loop(oplib::PollerType::POLL, type_);
+    int runs = 0;
+    oplib::TimerId self;
+    self = loop.runEvery(0.002, [&] {
+      if (++runs == 3)
+      {
+        loop.cancel(self);
+      }
+    });
+    // Something else repeating which lives on
+    int other = 0;
+    loop.runEvery(0.005, [&other] { ++other; });
+    loop.runAfter(0.1, [&loop] { loop.quit(); });
+    loop.loop();
+    check(runs == 3, "repeating timer ran after cancelling itself", runs);
+    check(other >= 5, "other repeating timer stopped", other);
+  }
+
+  // Added from another thread, cancelled before or after the loop
+  // adopted it: it never runs, the others do
+  void testCrossThread(oplib::TimerQueueType type_)
+  {
+    oplib::EventLoop loop(oplib::PollerType::POLL, type_);
+    std::atomic_int cancelledRuns { 0 };
+    std::atomic_int runs { 0 };
+    const int kTimers = 200;
+    oplib::Thread adder([&] {
+      for (int i = 0; i < kTimers; ++i)
+      {
+        oplib::TimerId id = loop.runAfter(0.01, [&cancelledRuns] { ++cancelledRuns; });
+        loop.cancel(id);
+        loop.runAfter(0.01, [&runs] { ++runs; });
+      }
+    });
+    adder.start();
+    loop.runAfter(0.2, [&loop] { loop.quit(); });
+    loop.loop();
+    adder.join();
+    check(cancelledRuns == 0, "cancelled cross-thread timer ran", cancelledRuns.load());
+    check(runs == kTimers, "cross-thread timers", runs.load());
+  }
+
+  // Added from another thread to a loop destroyed without running:
+  // the timer, and what its callback holds, must be freed
+  void testCrossThreadNeverAdopted(oplib::TimerQueueType type_)
+  {
+    auto held = std::make_shared<int>(0);
+    {
+      oplib::EventLoop loop(oplib::PollerType::POLL, type_);
+      oplib::Thread adder([&loop, held] { loop.runAfter(0.01, [held] { ++*held; }); });
+      adder.start();
+      adder.join();
+    }
+    check(held.use_count() == 1, "timer of a destroyed loop leaked", held.use_count());
+  }
+}
+
+int main()
+{
+  testHeapRandom();
+  const oplib::TimerQueueType types[] = { oplib::TimerQueueType::WHEEL,
+                                          oplib::TimerQueueType::HEAP };
+  for (oplib::TimerQueueType type : types)
+  {
+    const int before = oplib::test::failures();
+    testStaleTimerId(type);
+    testSelfCancel(type);
+    testCrossThread(type);
+    testCrossThreadNeverAdopted(type);
+    if (oplib::test::failures() != before)
+    {
+      printf("  with the %s\n", nameOf(type));
+    }
+  }
+  return oplib::test::result();
+}
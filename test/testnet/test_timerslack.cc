@@ -0,0 +1,110 @@
+// Timer slack: kTimers one-shot timers with deadlines kSpacing apart
+// are run on an EventLoop, once with a slack of kSlack and once
+// without. With slack they share a few timerfd expirations: fewer
+// timerfd_settime() calls and wakeups. Every timer runs at or after
+// its deadline, and with slack at most kSlack later than the same
+// timers without it, scheduling delays aside (measured by the run
+// without slack).
+#include <net/EventLoop.h>
+#include <util/Timestamp.h>
+#include <TestCheck.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  const int kTimers = 50;
+  const double kFirst = 0.02;
+  const double kSpacing = 0.0002;
+  const double kSlack = 0.01;
+  // Timer lateness the scheduler may add on top, without slack
+  const int64_t kJitterMicroSeconds = 2000;
+
+  using oplib::test::check;
+
+  struct Run
+  {
+    uint64_t arms;
+    uint64_t wakeups;
+    int fired;
+    // Fire time minus deadline, microseconds
+    int64_t minLate;
+    int64_t maxLate;
+  };
+
+  Run run(oplib::TimerQueueType type_, double slack_)
+  {
+    oplib::EventLoop loop(oplib::PollerType::POLL, type_);
+    std::vector<int64_t> late(kTimers, -1);
+    const oplib::LoopMetrics::Snapshot before = loop.metrics().snapshot();
+    const int timerIndex = static_cast<int>(oplib::DispatcherType::TIMER);
+
+    for (int i = 0; i < kTimers; ++i)
+    {
+      const double delay = kFirst + i * kSpacing;
+      oplib::Timestamp deadline(oplib::Timestamp::now());
+      deadline += delay;
+      loop.runAfter(delay, [deadline, i, &late] {
+        late[i] = oplib::Timestamp::now() - deadline;
+      }, slack_);
+    }
+    loop.runAfter(kFirst + kTimers * kSpacing + kSlack + 0.05, [&loop] { loop.quit(); });
+    loop.loop();
+
+    const oplib::LoopMetrics::Snapshot after = loop.metrics().snapshot();
+    Run result;
+    result.arms = after.timerfdArms - before.timerfdArms;
+    // The quit timer's wakeup included
+    result.wakeups = after.callback[timerIndex].count - before.callback[timerIndex].count;
+    result.fired = static_cast<int>(std::count_if(late.begin(), late.end(),
+                                                  [](int64_t l) { return l >= 0; }));
+    result.minLate = *std::min_element(late.begin(), late.end());
+    result.maxLate = *std::max_element(late.begin(), late.end());
+    return result;
+  }
+
+  void print(const char* name_, const Run& run_)
+  {
+    printf("  %-10s %4llu arms %4llu wakeups, %2d fired, late %lld to %lld us\n", name_,
+           static_cast<unsigned long long>(run_.arms),
+           static_cast<unsigned long long>(run_.wakeups), run_.fired,
+           static_cast<long long>(run_.minLate), static_cast<long long>(run_.maxLate));
+  }
+
+  void test(oplib::TimerQueueType type_, const char* name_)
+  {
+    const Run exact = run(type_, 0.0);
+    const Run slack = run(type_, kSlack);
+    printf("%s:\n", name_);
+    print("no slack", exact);
+    print("slack", slack);
+
+    // minLate is -1 if one never ran, and a timer never runs early
+    check(exact.fired == kTimers && exact.minLate >= 0, "no slack: fired", exact.fired);
+    check(slack.fired == kTimers && slack.minLate >= 0, "slack: fired", slack.fired);
+
+    // The deadlines span kTimers * kSpacing, within kSlack of each
+    // other: a few shared expirations and the quit timer
+    check(slack.wakeups <= 5, "slack: wakeups", static_cast<long long>(slack.wakeups));
+    check(slack.arms <= 5, "slack: arms", static_cast<long long>(slack.arms));
+    check(slack.wakeups < exact.wakeups, "slack: no fewer wakeups",
+          static_cast<long long>(exact.wakeups));
+    check(slack.arms < exact.arms, "slack: no fewer arms", static_cast<long long>(exact.arms));
+
+    // The late bound
+    const int64_t bound = static_cast<int64_t>(kSlack * oplib::Timestamp::numMicroSecondsInSeconds) +
+                          std::max(exact.maxLate, kJitterMicroSeconds);
+    check(slack.maxLate <= bound, "slack: later than the slack", static_cast<long long>(slack.maxLate));
+  }
+}
+
+int main()
+{
+  test(oplib::TimerQueueType::WHEEL, "wheel");
+  test(oplib::TimerQueueType::HEAP, "heap");
+  return oplib::test::result();
+}
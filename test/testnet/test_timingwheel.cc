@@ -0,0 +1,298 @@
+// TimingWheel: drives the wheel with a simulated clock and checks
+// every timer against its expire time rounded up to the tick:
+// expiry order across the level boundaries (256 and 256 * 64 ticks),
+// timers beyond the top level, removing a timer which was cascaded
+// already, timers armed again while the expired ones are handled,
+// and a random mix of all of them.
+#include <net/TimingWheel.h>
+#include <net/TimerManager.h>
+#include <util/Timestamp.h>
+#include <TestCheck.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace
+{
+  const int64_t kTick = oplib::TimingWheel::kTickMicroSeconds;
+  // Not a multiple of 256 ticks, the cascades don't line up with it
+  const int64_t kStart = 1000000000LL * kTick + 77 * kTick;
+
+  using oplib::test::check;
+
+  int64_t ceilTick(oplib::Timestamp when_)
+  {
+    return (when_.microseconds() + kTick - 1) / kTick;
+  }
+
+  // Timers of one test, and what the wheel handed back
+  class Driver
+  {
+   public:
+    Driver() : _wheel(oplib::Timestamp(kStart)), _now(kStart), _late(0), _early(0) {}
+
+    oplib::Timer* add(int64_t whenMicroSeconds_)
+    {
+      _timers.push_back(std::make_unique<oplib::Timer>());
+      oplib::Timer* timer = _timers.back().get();
+      timer->init([] {}, oplib::Timestamp(whenMicroSeconds_), 0.0);
+      _wheel.insert(timer);
+      _pending.insert(timer);
+      return timer;
+    }
+
+    void remove(oplib::Timer* timer_)
+    {
+      _wheel.remove(timer_);
+      _pending.erase(timer_);
+    }
+
+    // Advance to now_, every timer due by then must come out, none other
+    std::vector<oplib::Timer*> advance(int64_t now_)
+    {
+      _now = now_;
+      std::vector<oplib::Timer*> expired;
+      _wheel.advance(oplib::Timestamp(now_), &expired);
+      const int64_t nowTick = now_ / kTick;
+      for (oplib::Timer* timer : expired)
+      {
+        if (_pending.erase(timer) != 1 || timer->active())
+        {
+          check(false, "expired a timer twice or left it linked");
+        }
+        if (ceilTick(timer->expireTime()) > nowTick)
+        {
+          ++_early;
+        }
+      }
+      for (oplib::Timer* timer : _pending)
+      {
+        if (ceilTick(timer->expireTime()) <= nowTick)
+        {
+          ++_late;
+        }
+      }
+      check(_wheel.size() == _pending.size(), "size", static_cast<long long>(_wheel.size()));
+      return expired;
+    }
+
+    // Advance the way TimerManager does: to the next expiration
+    // of the wheel, until nothing is pending
+    void drain(std::vector<oplib::Timer*>* order_)
+    {
+      // A timer the wheel lost track of would never come out
+      int rounds = 0;
+      while (!_wheel.empty())
+      {
+        if (++rounds > 10000)
+        {
+          check(false, "drain: stuck", static_cast<long long>(_wheel.size()));
+          return;
+        }
+        oplib::Timestamp next = _wheel.nextExpiration();
+        check(next.valid() && next.microseconds() / kTick >= _now / kTick,
+              "next expiration in the past", next.microseconds() - _now);
+        for (oplib::Timer* timer : advance(std::max(next.microseconds(), _now)))
+        {
+          order_->push_back(timer);
+        }
+      }
+    }
+
+    oplib::TimingWheel& wheel() { return _wheel; }
+    size_t pending() const { return _pending.size(); }
+    int64_t late() const { return _late; }
+    int64_t early() const { return _early; }
+
+   private:
+    oplib::TimingWheel _wheel;
+    int64_t _now;
+    std::vector<std::unique_ptr<oplib::Timer>> _timers;
+    std::set<oplib::Timer*> _pending;
+    int64_t _late;
+    int64_t _early;
+  };
+
+  void checkOrder(const std::vector<oplib::Timer*>& order_, const char* what_)
+  {
+    for (size_t i = 1; i < order_.size(); ++i)
+    {
+      if (ceilTick(order_[i]->expireTime()) < ceilTick(order_[i - 1]->expireTime()))
+      {
+        check(false, what_, static_cast<long long>(i));
+        return;
+      }
+    }
+  }
+
+  // Timers on and around the boundaries of the levels
+  void testLevelBoundaries()
+  {
+    Driver driver;
+    const int64_t distances[] = {
+      0, 1, 254, 255, 256, 257, 511, 512, 1000,
+      256 * 64 - 1, 256 * 64, 256 * 64 + 1, 256 * 64 * 2 + 3,
+      256 * 64 * 64 - 1, 256 * 64 * 64, 256 * 64 * 64 + 1,
+      256LL * 64 * 64 * 64 + 5
+    };
+    for (int64_t distance : distances)
+    {
+      // On the tick, and just after it
+      driver.add(kStart + distance * kTick);
+      driver.add(kStart + distance * kTick + 1);
+    }
+    std::vector<oplib::Timer*> order;
+    driver.drain(&order);
+    check(order.size() == 2 * sizeof(distances) / sizeof(distances[0]), "boundaries: all expired",
+          static_cast<long long>(order.size()));
+    checkOrder(order, "boundaries: order");
+    check(driver.late() == 0, "boundaries: late", driver.late());
+    check(driver.early() == 0, "boundaries: early", driver.early());
+  }
+
+  // Farther than 2^32 ticks: parked in the last slot, placed again
+  // with its real expire time when cascaded
+  void testBeyondTopLevel()
+  {
+    Driver driver;
+    const int64_t top = int64_t(1) << 32;
+    driver.add(kStart + (top + 1000) * kTick);
+    driver.add(kStart + (2 * top + 7) * kTick);
+    driver.add(kStart + 10 * kTick);
+
+    std::vector<oplib::Timer*> order;
+    driver.drain(&order);
+    check(order.size() == 3, "beyond: all expired", static_cast<long long>(order.size()));
+    checkOrder(order, "beyond: order");
+    check(driver.late() == 0, "beyond: late", driver.late());
+    check(driver.early() == 0, "beyond: early", driver.early());
+  }
+
+  // A timer moved down a level by a cascade is removed, its
+  // neighbours in the slot expire on time
+  void testRemoveCascaded()
+  {
+    Driver driver;
+    oplib::Timer* first = driver.add(kStart + 300 * kTick);
+    oplib::Timer* middle = driver.add(kStart + 301 * kTick);
+    oplib::Timer* last = driver.add(kStart + 302 * kTick);
+    oplib::Timer* far = driver.add(kStart + (256 * 64 + 300) * kTick);
+
+    // Past the wrap of the root level, before any expires
+    const int64_t wrap = ((kStart / kTick) | 255) + 1;
+    check(driver.advance((wrap + 10) * kTick).empty(), "cascaded: expired early");
+    check(driver.pending() == 4, "cascaded: pending", static_cast<long long>(driver.pending()));
+    driver.remove(middle);
+    driver.remove(first);
+
+    // The level 2 timer, once cascaded twice
+    std::vector<oplib::Timer*> expired = driver.advance(kStart + 302 * kTick);
+    check(expired.size() == 1 && expired[0] == last, "cascaded: neighbour");
+    const int64_t wrap2 = (((kStart / kTick) + 256 * 64) | 255) + 1;
+    check(driver.advance((wrap2 + 1) * kTick).empty(), "cascaded: far expired early");
+    driver.remove(far);
+    check(driver.wheel().empty(), "cascaded: empty");
+    check(driver.advance(kStart + 256 * 64 * 4 * kTick).empty(), "cascaded: removed one expired");
+    check(driver.late() == 0, "cascaded: late", driver.late());
+  }
+
+  // While the expired timers are handled, some are armed again one
+  // interval later, and new ones are added for the current tick
+  // and for the past: all of them come out on the next advance
+  // which reaches them, none is lost
+  void testRearmWhileFiring()
+  {
+    Driver driver;
+    const int64_t kInterval = 7 * kTick;
+    const int kRepeats = 200;
+    for (int i = 0; i < 5; ++i)
+    {
+      driver.add(kStart + (i + 1) * kTick);
+    }
+
+    int rearmed = 0;
+    int extra = 0;
+    int64_t now = kStart;
+    // Bounded: a lost timer would keep it going
+    while (driver.pending() > 0 && now < kStart + 100000 * kTick)
+    {
+      now += kTick * 3;
+      for (oplib::Timer* timer : driver.advance(now))
+      {
+        (void) timer;
+        if (rearmed < kRepeats)
+        {
+          ++rearmed;
+          driver.add(now + kInterval);
+          if (rearmed % 10 == 0)
+          {
+            // Due already
+            driver.add(now);
+            driver.add(now - 5 * kTick);
+            extra += 2;
+          }
+        }
+      }
+    }
+    check(driver.pending() == 0, "rearm: pending", static_cast<long long>(driver.pending()));
+    check(rearmed == kRepeats, "rearm: repeats", rearmed);
+    check(extra == kRepeats / 10 * 2, "rearm: extra", extra);
+    check(driver.late() == 0, "rearm: late", driver.late());
+    check(driver.early() == 0, "rearm: early", driver.early());
+  }
+
+  // Random inserts, removes and advances of random length
+  void testRandom()
+  {
+    std::mt19937_64 rng(42);
+    Driver driver;
+    std::vector<oplib::Timer*> live;
+    int64_t now = kStart;
+    for (int round = 0; round < 20000; ++round)
+    {
+      const int op = static_cast<int>(rng() % 10);
+      if (op < 5)
+      {
+        // Mostly near, sometimes in the higher levels
+        const int64_t range = rng() % 8 == 0 ? 256LL * 64 * 64 * kTick : 2000 * kTick;
+        live.push_back(driver.add(now + static_cast<int64_t>(rng() % range)));
+      }
+      else if (op < 7 && !live.empty())
+      {
+        const size_t i = rng() % live.size();
+        if (live[i]->active())
+        {
+          driver.remove(live[i]);
+        }
+        live[i] = live.back();
+        live.pop_back();
+      }
+      else
+      {
+        now += static_cast<int64_t>(rng() % (300 * kTick));
+        driver.advance(now);
+      }
+    }
+    std::vector<oplib::Timer*> order;
+    driver.drain(&order);
+    checkOrder(order, "random: order");
+    check(driver.pending() == 0, "random: pending", static_cast<long long>(driver.pending()));
+    check(driver.late() == 0, "random: late", driver.late());
+    check(driver.early() == 0, "random: early", driver.early());
+  }
+}
+
+int main()
+{
+  testLevelBoundaries();
+  testBeyondTopLevel();
+  testRemoveCascaded();
+  testRearmWhileFiring();
+  testRandom();
+  return oplib::test::result();
+}
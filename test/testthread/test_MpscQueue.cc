@@ -0,0 +1,189 @@
+// MpscQueue under contention: kProducers threads push kPushes
+// numbered nodes each while the consumer drains the way EventLoop
+// does, at most size() nodes per round until pop() returns nullptr.
+// Every node must come out exactly once and in push order per
+// producer. Once the producers are done, a single bounded round must
+// take what is left: no node may get stuck behind the stub the
+// consumer puts back when it takes the last node.
+#include <thread/MpscQueue.h>
+#include <thread/Thread.h>
+#include <TestCheck.h>
+
+#include <sched.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const int kProducers = 4;
+  const int kPushes = 100000;
+
+  struct Item : oplib::MpscNode
+  {
+    Item(int producer_, int seq_) : producer(producer_), seq(seq_) {}
+
+    int producer;
+    int seq;
+  };
+
+  using oplib::test::check;
+
+  class Consumer
+  {
+   public:
+    explicit Consumer(oplib::MpscQueue<Item>* queue_)
+    : _queue(queue_), _next(kProducers, 0), _popped(0), _shortRounds(0)
+    {}
+
+    // One round: returns how many were popped
+    size_t drain()
+    {
+      const size_t queued = _queue->size();
+      size_t popped = 0;
+      while (popped < queued)
+      {
+        Item* item = _queue->pop();
+        if (item == nullptr)
+        {
+          // A producer in the middle of its push
+          ++_shortRounds;
+          break;
+        }
+        ++popped;
+        if (item->producer < 0 || item->producer >= kProducers)
+        {
+          check(false, "unknown producer", item->producer);
+        }
+        else
+        {
+          check(item->seq == _next[item->producer], "out of order", item->seq);
+          _next[item->producer] = item->seq + 1;
+        }
+        delete item;
+      }
+      _popped += popped;
+      return popped;
+    }
+
+    int64_t popped() const { return _popped; }
+    int64_t shortRounds() const { return _shortRounds; }
+
+   private:
+    oplib::MpscQueue<Item>* _queue;
+    std::vector<int> _next;
+    int64_t _popped;
+    int64_t _shortRounds;
+  };
+
+  // Producers racing with the consumer, which often takes the last node
+  void testRace()
+  {
+    oplib::MpscQueue<Item> queue;
+    Consumer consumer(&queue);
+    std::atomic_int done { 0 };
+    std::vector<std::unique_ptr<oplib::Thread>> producers;
+    for (int p = 0; p < kProducers; ++p)
+    {
+      producers.push_back(std::make_unique<oplib::Thread>([p, &queue, &done] {
+        for (int i = 0; i < kPushes; ++i)
+        {
+          queue.push(new Item(p, i));
+          if (i % 64 == 0)
+          {
+            // Let the consumer empty the queue now and then
+            sched_yield();
+          }
+        }
+        ++done;
+      }));
+      producers.back()->start();
+    }
+
+    int64_t rounds = 0;
+    while (done < kProducers)
+    {
+      if (consumer.drain() == 0)
+      {
+        // Fewer CPUs than threads: let the producers run
+        sched_yield();
+      }
+      ++rounds;
+    }
+    for (auto& p : producers)
+    {
+      p->join();
+    }
+
+    // Everything is linked by now: one round takes all
+    const size_t left = queue.size();
+    const size_t popped = consumer.drain();
+    check(popped == left, "stuck in the queue", static_cast<long long>(left - popped));
+    check(queue.size() == 0 && queue.pop() == nullptr, "queue not empty");
+    check(consumer.popped() == static_cast<int64_t>(kProducers) * kPushes, "popped",
+          consumer.popped());
+    printf("race: %lld rounds, %lld cut short by a push in progress\n",
+           static_cast<long long>(rounds), static_cast<long long>(consumer.shortRounds()));
+  }
+
+  // The consumer takes the last node, pushing the stub back, while
+  // the producer pushes: once both pushes of a round are done, one
+  // round of the consumer must take whatever the race left
+  void testLastNode()
+  {
+    oplib::MpscQueue<Item> queue;
+    Consumer consumer(&queue);
+    std::atomic_int turn { -1 };
+    std::atomic_int pushed { 0 };
+    const int kRounds = 20000;
+    oplib::Thread producer([&] {
+      for (int i = 0; i < kRounds; ++i)
+      {
+        while (turn.load(std::memory_order_acquire) != i)
+        {
+          sched_yield();
+        }
+        queue.push(new Item(0, 2 * i));
+        queue.push(new Item(0, 2 * i + 1));
+        pushed.store(i + 1, std::memory_order_release);
+      }
+    });
+    producer.start();
+
+    int stuck = 0;
+    for (int i = 0; i < kRounds; ++i)
+    {
+      turn.store(i, std::memory_order_release);
+      consumer.drain();
+      while (pushed.load(std::memory_order_acquire) != i + 1)
+      {
+        if (consumer.drain() == 0)
+        {
+          sched_yield();
+        }
+      }
+      consumer.drain();
+      if (consumer.popped() != 2 * (i + 1))
+      {
+        ++stuck;
+        // Recover for the next rounds
+        while (consumer.drain() > 0)
+        {
+        }
+      }
+    }
+    producer.join();
+    check(stuck == 0, "last node: stuck after a round", stuck);
+    check(consumer.popped() == 2 * kRounds, "last node: popped", consumer.popped());
+    check(queue.pop() == nullptr, "last node: queue not empty");
+  }
+}
+
+int main()
+{
+  testRace();
+  testLastNode();
+  return oplib::test::result();
+}
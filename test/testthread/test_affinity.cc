@@ -0,0 +1,132 @@
+// CPU affinity of Thread. cpusOfList() parses the sysfs CPU lists
+// read by cpusOfNumaNode(). A thread pinned to one CPU this process
+// may use must find itself bound to that CPU alone, out of range
+// values aside, and say so with pinned(). A thread given only
+// unusable CPUs must still run, unpinned, with the affinity of the
+// process.
+#include <thread/Thread.h>
+#include <TestCheck.h>
+
+#include <sched.h>
+#include <stdio.h>
+
+#include <vector>
+
+namespace
+{
+  using oplib::test::check;
+
+  std::vector<int> cpusOf(const cpu_set_t& set_)
+  {
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET(cpu, &set_))
+      {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  std::vector<int> currentAffinity()
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+      perror("sched_getaffinity");
+      return std::vector<int>();
+    }
+    return cpusOf(set);
+  }
+
+  void testList()
+  {
+    check(oplib::cpusOfList("0-3,8,10-11\n") == std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }),
+          "list: ranges");
+    check(oplib::cpusOfList("5") == std::vector<int>({ 5 }), "list: one CPU");
+    check(oplib::cpusOfList("").empty(), "list: empty");
+    check(oplib::cpusOfList("\n").empty(), "list: newline");
+    // Malformed: what was parsed before is kept
+    check(oplib::cpusOfList("1,x,3") == std::vector<int>({ 1 }), "list: garbage");
+    check(oplib::cpusOfList("4-2").empty(), "list: reversed range");
+    check(oplib::cpusOfList("-1").empty(), "list: negative");
+    // Ends at CPU_SETSIZE
+    char list[32];
+    snprintf(list, sizeof(list), "%d-%d", CPU_SETSIZE - 2, CPU_SETSIZE + 100);
+    check(oplib::cpusOfList(list) == std::vector<int>({ CPU_SETSIZE - 2, CPU_SETSIZE - 1 }),
+          "list: beyond CPU_SETSIZE");
+
+    // The real ones, if there is sysfs
+    const std::vector<int> node0 = oplib::cpusOfNumaNode(0);
+    printf("node 0: %zu CPUs\n", node0.size());
+    for (int cpu : node0)
+    {
+      check(cpu >= 0 && cpu < CPU_SETSIZE, "node 0: CPU", cpu);
+    }
+    check(oplib::cpusOfNumaNode(-1).empty(), "node -1");
+    check(oplib::cpusOfNumaNode(1 << 20).empty(), "node 2^20");
+  }
+
+  // The affinity the thread started with, checks pinned()
+  std::vector<int> affinityOfThread(const std::vector<int>& cpus_, bool pinned_)
+  {
+    std::vector<int> affinity;
+    oplib::Thread thread([&affinity] { affinity = currentAffinity(); }, "affinity");
+    thread.setCpuAffinity(cpus_);
+    thread.start();
+    check(thread.started(), "not started");
+    check(thread.pinned() == pinned_, "pinned()", thread.pinned());
+    if (thread.started())
+    {
+      thread.join();
+    }
+    return affinity;
+  }
+
+  void testAffinity()
+  {
+    const std::vector<int> allowed = currentAffinity();
+    check(!allowed.empty(), "process affinity");
+    if (allowed.empty())
+    {
+      return;
+    }
+    const int cpu = allowed.back();
+
+    check(affinityOfThread(std::vector<int>({ cpu }), true) == std::vector<int>({ cpu }),
+          "pinned", cpu);
+    check(affinityOfThread(std::vector<int>(), false) == allowed, "no affinity");
+    // Out of range values skipped, the valid one kept
+    check(affinityOfThread(std::vector<int>({ -1, cpu, CPU_SETSIZE, 1 << 30 }), true) ==
+          std::vector<int>({ cpu }), "pinned, out of range skipped", cpu);
+    // Nothing left: unpinned
+    check(affinityOfThread(std::vector<int>({ -5, CPU_SETSIZE + 3 }), false) == allowed,
+          "all out of range");
+
+    // In range but not usable: unpinned as well
+    int unusable = -1;
+    for (int c = CPU_SETSIZE - 1; c >= 0 && unusable < 0; --c)
+    {
+      bool found = false;
+      for (int a : allowed)
+      {
+        found = found || a == c;
+      }
+      unusable = found ? -1 : c;
+    }
+    if (unusable >= 0)
+    {
+      check(affinityOfThread(std::vector<int>({ unusable }), false) == allowed, "unusable CPU",
+            unusable);
+    }
+  }
+}
+
+int main()
+{
+  testList();
+  testAffinity();
+  return oplib::test::result();
+}